@@ -0,0 +1,43 @@
+// Disassembles every class of one or more jars to stdout, in the style of javap -c -v.
+//
+// Usage: cjbp_jar_disassembler <jar>...
+
+#include <cstdio>
+#include <vector>
+
+#include <cjbp/cjbp.h>
+
+int main(int argc, char **argv) {
+    std::vector<std::string> jars(argv + 1, argv + argc);
+    if (jars.empty()) {
+        std::fprintf(stderr, "Usage: %s <jar>...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::shared_ptr<cjbp::ClassPath>> classPaths;
+    try {
+        for (const std::string &jar : jars) classPaths.push_back(std::make_shared<cjbp::JarClassPath>(jar));
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    cjbp::CompositeClassPath classPath(classPaths);
+
+    // One disassembler is shared by every class, so its buffer is allocated once for the whole run.
+    cjbp::Disassembler disassembler(stdout);
+
+    // Malformed code may only be found while writing, so a class that fails halfway is left partly written, followed by the
+    // error, and the dump goes on with the next class.
+    for (const std::string &name : classPath.listClasses()) {
+        try {
+            std::shared_ptr<std::istream> stream = classPath.findClass(name);
+            if (stream == nullptr) continue;
+            std::unique_ptr<cjbp::ClassFile> classFile = cjbp::ClassFile::read(*stream);
+            disassembler.writeClass(*classFile);
+        } catch (const std::exception &e) {
+            disassembler.flush();
+            std::fprintf(stderr, "%s: %s\n", name.c_str(), e.what());
+        }
+    }
+    return 0;
+}
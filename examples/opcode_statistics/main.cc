@@ -0,0 +1,265 @@
+// Reports opcode, opcode-pair and opcode-triple frequencies, method size distributions and per-class totals for every
+// class in one or more jars.
+//
+// Usage: cjbp_opcode_statistics [-j threads] [-n top] <jar>...
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cjbp/cjbp.h>
+
+namespace {
+
+struct ClassTotals {
+    std::string name;
+    uint32_t methods;
+    uint64_t instructions;
+    uint64_t codeBytes;
+};
+
+/**
+ * Counters gathered by one worker thread. Workers never share a Statistics object, so counting needs no synchronization;
+ * the per-thread results are merged once every class has been processed.
+ */
+struct Statistics {
+    static constexpr uint32_t SizeBuckets = 33; // Bucket i holds methods whose code length is in [2^(i - 1), 2^i)
+
+    std::array<uint64_t, 256> opcodes {};
+    std::vector<uint64_t> pairs = std::vector<uint64_t>(256 * 256); // Indexed by (first << 8) | second
+    std::unordered_map<uint32_t, uint64_t> triples;                  // Keyed by (first << 16) | (second << 8) | third
+    std::array<uint64_t, SizeBuckets> sizes {};
+    std::vector<ClassTotals> classes;
+    uint64_t failedClasses = 0;
+    uint64_t methods = 0;
+    uint64_t instructions = 0;
+    uint64_t codeBytes = 0;
+
+    void merge(Statistics &other) {
+        for (uint32_t i = 0; i < 256; i++) this->opcodes[i] += other.opcodes[i];
+        for (uint32_t i = 0; i < this->pairs.size(); i++) this->pairs[i] += other.pairs[i];
+        for (const auto &[key, count] : other.triples) this->triples[key] += count;
+        for (uint32_t i = 0; i < SizeBuckets; i++) this->sizes[i] += other.sizes[i];
+        std::move(other.classes.begin(), other.classes.end(), std::back_inserter(this->classes));
+        this->failedClasses += other.failedClasses;
+        this->methods += other.methods;
+        this->instructions += other.instructions;
+        this->codeBytes += other.codeBytes;
+    }
+};
+
+uint32_t sizeBucket(uint32_t size) {
+    uint32_t bucket = 0;
+    while (size != 0) {
+        size >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/// @return true if the instruction after one with the given opcode never runs right after it.
+bool endsRun(uint8_t opcode) {
+    return (cjbp::Opcode::Goto <= opcode && opcode <= cjbp::Opcode::Return) || opcode == cjbp::Opcode::AThrow ||
+           opcode == cjbp::Opcode::GotoW || opcode == cjbp::Opcode::JsrW;
+}
+
+/**
+ * Counts the opcodes of one method. Pairs and triples are only counted within straight-line runs: a sequence that can not
+ * run back to back can not be fused into a superinstruction, so the window restarts wherever control may arrive from
+ * elsewhere (jump targets and exception handlers) and after instructions that cannot fall through (goto, jsr, ret,
+ * switches, returns, athrow).
+ */
+uint64_t countMethod(Statistics &statistics, const cjbp::CodeAttributeInfo &code) {
+    cjbp::CodeBitmap bitmap = code.scan();
+    cjbp::CodeIterator iterator = code.iterator();
+
+    std::vector<bool> handlers(code.code().size());
+    for (const cjbp::ExceptionTableEntry &entry : code.exceptionTable()) {
+        if (entry.handler() < handlers.size()) handlers[entry.handler()] = true;
+    }
+
+    uint32_t window = 0;
+    uint32_t run = 0;
+    while (!iterator.eof()) {
+        uint32_t index = iterator.next();
+        uint8_t opcode = iterator[index];
+        if (bitmap.isBranchTarget(index) || handlers[index]) run = 0;
+
+        window = ((window << 8) | opcode) & 0xFFFFFF;
+        run++;
+        statistics.opcodes[opcode]++;
+        if (run >= 2) statistics.pairs[window & 0xFFFF]++;
+        if (run >= 3) statistics.triples[window]++;
+        if (endsRun(opcode)) run = 0;
+    }
+
+    statistics.methods++;
+    statistics.sizes[sizeBucket(code.code().size())]++;
+    return bitmap.instructionCount();
+}
+
+void countClass(Statistics &statistics, const std::string &name, const cjbp::ClassFile &classFile) {
+    ClassTotals totals { name, 0, 0, 0 };
+    for (const auto &method : classFile.methods()) {
+        cjbp::CodeAttributeInfo *code = method->code();
+        if (code == nullptr) continue;
+
+        totals.methods++;
+        totals.instructions += countMethod(statistics, *code);
+        totals.codeBytes += code->code().size();
+    }
+
+    statistics.instructions += totals.instructions;
+    statistics.codeBytes += totals.codeBytes;
+    statistics.classes.push_back(std::move(totals));
+}
+
+std::string opcodeSequenceName(uint32_t key, uint32_t length) {
+    std::string result;
+    for (uint32_t i = length; i-- > 0;) {
+        if (!result.empty()) result += ' ';
+        result += cjbp::opcodeName((key >> (i * 8)) & 0xFF);
+    }
+    return result;
+}
+
+template<typename T>
+std::vector<std::pair<uint32_t, uint64_t>> topEntries(const T &counts, uint32_t limit) {
+    std::vector<std::pair<uint32_t, uint64_t>> result;
+    for (const auto &[key, count] : counts) {
+        if (count != 0) result.emplace_back(key, count);
+    }
+
+    auto byCount = [](const auto &a, const auto &b) { return a.second != b.second ? a.second > b.second : a.first < b.first; };
+    if (result.size() > limit) {
+        std::partial_sort(result.begin(), result.begin() + limit, result.end(), byCount);
+        result.resize(limit);
+    } else {
+        std::sort(result.begin(), result.end(), byCount);
+    }
+    return result;
+}
+
+void printSequences(const char *title, const std::vector<std::pair<uint32_t, uint64_t>> &entries, uint32_t length, uint64_t total) {
+    std::printf("\n%s:\n", title);
+    for (const auto &[key, count] : entries) {
+        std::printf("  %-48s %12llu %7.3f%%\n", opcodeSequenceName(key, length).c_str(), static_cast<unsigned long long>(count),
+                    total == 0 ? 0.0 : 100.0 * count / total);
+    }
+}
+
+void printStatistics(const Statistics &statistics, uint32_t top, double seconds) {
+    std::printf("Classes: %zu (%llu failed)\n", statistics.classes.size(), static_cast<unsigned long long>(statistics.failedClasses));
+    std::printf("Methods with code: %llu\n", static_cast<unsigned long long>(statistics.methods));
+    std::printf("Instructions: %llu\n", static_cast<unsigned long long>(statistics.instructions));
+    std::printf("Code bytes: %llu\n", static_cast<unsigned long long>(statistics.codeBytes));
+    std::printf("Time: %.3f s\n", seconds);
+
+    std::vector<std::pair<uint32_t, uint64_t>> opcodes;
+    for (uint32_t i = 0; i < 256; i++) opcodes.emplace_back(i, statistics.opcodes[i]);
+    printSequences("Opcode frequencies", topEntries(opcodes, 256), 1, statistics.instructions);
+
+    std::vector<std::pair<uint32_t, uint64_t>> pairs;
+    for (uint32_t i = 0; i < statistics.pairs.size(); i++) {
+        if (statistics.pairs[i] != 0) pairs.emplace_back(i, statistics.pairs[i]);
+    }
+    printSequences("Opcode pair frequencies", topEntries(pairs, top), 2, statistics.instructions);
+    printSequences("Opcode triple frequencies", topEntries(statistics.triples, top), 3, statistics.instructions);
+
+    std::printf("\nMethod size distribution (code bytes):\n");
+    for (uint32_t i = 0; i < Statistics::SizeBuckets; i++) {
+        if (statistics.sizes[i] == 0) continue;
+        uint64_t low = i == 0 ? 0 : uint64_t(1) << (i - 1);
+        uint64_t high = uint64_t(1) << i;
+        std::printf("  [%6llu, %6llu) %12llu %7.3f%%\n", static_cast<unsigned long long>(low), static_cast<unsigned long long>(high),
+                    static_cast<unsigned long long>(statistics.sizes[i]), 100.0 * statistics.sizes[i] / statistics.methods);
+    }
+
+    std::vector<const ClassTotals *> classes;
+    for (const ClassTotals &totals : statistics.classes) classes.push_back(&totals);
+    auto byInstructions = [](const ClassTotals *a, const ClassTotals *b) {
+        return a->instructions != b->instructions ? a->instructions > b->instructions : a->name < b->name;
+    };
+    uint32_t count = std::min<size_t>(top, classes.size());
+    std::partial_sort(classes.begin(), classes.begin() + count, classes.end(), byInstructions);
+
+    std::printf("\nPer-class totals (top %u by instructions):\n", count);
+    std::printf("  %-64s %8s %12s %12s\n", "class", "methods", "instructions", "code bytes");
+    for (uint32_t i = 0; i < count; i++) {
+        const ClassTotals &totals = *classes[i];
+        std::printf("  %-64s %8u %12llu %12llu\n", totals.name.c_str(), totals.methods, static_cast<unsigned long long>(totals.instructions),
+                    static_cast<unsigned long long>(totals.codeBytes));
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t top = 50;
+    std::vector<std::string> jars;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threadCount = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            top = std::max(1, std::atoi(argv[++i]));
+        } else {
+            jars.emplace_back(argv[i]);
+        }
+    }
+    if (jars.empty()) {
+        std::fprintf(stderr, "Usage: %s [-j threads] [-n top] <jar>...\n", argv[0]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::shared_ptr<cjbp::ClassPath>> classPaths;
+    try {
+        for (const std::string &jar : jars) classPaths.push_back(std::make_shared<cjbp::JarClassPath>(jar));
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    cjbp::CompositeClassPath classPath(classPaths);
+    std::vector<std::string> names = classPath.listClasses();
+
+    // Class paths that are not safe to read from concurrently have only the lookup serialized; parsing and counting, which
+    // is where the time goes, runs in parallel.
+    std::mutex classPathMutex;
+    std::atomic<size_t> nextClass { 0 };
+    std::vector<Statistics> statistics(threadCount);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; t++) {
+        threads.emplace_back([&, t] {
+            Statistics &local = statistics[t];
+            for (size_t i; (i = nextClass.fetch_add(1, std::memory_order_relaxed)) < names.size();) {
+                std::shared_ptr<std::istream> stream = classPath.findClassSerialized(names[i], classPathMutex);
+
+                try {
+                    if (stream == nullptr) throw std::runtime_error("Class not found");
+                    std::unique_ptr<cjbp::ClassFile> classFile = cjbp::ClassFile::read(*stream);
+                    countClass(local, names[i], *classFile);
+                } catch (const std::exception &) {
+                    local.failedClasses++;
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+
+    Statistics &total = statistics[0];
+    for (uint32_t t = 1; t < threadCount; t++) total.merge(statistics[t]);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printStatistics(total, top, seconds);
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Builds the control flow graph and the chosen analyses of every method in one or more jars on a thread pool, and reports
+// the throughput. With -s, runs again with 1, 2, 4... threads up to the given count, to measure scaling.
+//
+// Usage: cjbp_parallel_analysis [-j threads] [-s] [-a analyses] [-e] <jar>...
+//
+// Analyses are given as a comma-separated list of: dominators, loops, liveness, slots, types, registers, escapes, all.
+// Only the control flow graph is built by default.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <cjbp/cjbp.h>
+
+namespace {
+
+bool parseAnalyses(const std::string &argument, uint32_t &analyses) {
+    std::istringstream names(argument);
+    for (std::string name; std::getline(names, name, ',');) {
+        if (name == "dominators") {
+            analyses |= cjbp::AnalysisDriver::Dominators;
+        } else if (name == "loops") {
+            analyses |= cjbp::AnalysisDriver::Loops;
+        } else if (name == "liveness") {
+            analyses |= cjbp::AnalysisDriver::Liveness;
+        } else if (name == "slots") {
+            analyses |= cjbp::AnalysisDriver::CacheSlots;
+        } else if (name == "types") {
+            analyses |= cjbp::AnalysisDriver::Types;
+        } else if (name == "registers") {
+            analyses |= cjbp::AnalysisDriver::Registers;
+        } else if (name == "escapes") {
+            analyses |= cjbp::AnalysisDriver::Escapes;
+        } else if (name == "all") {
+            analyses |= cjbp::AnalysisDriver::All;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t analyses = cjbp::AnalysisDriver::Cfg;
+    bool scaling = false;
+    bool errors = false;
+    std::vector<std::string> jars;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threadCount = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-s") == 0) {
+            scaling = true;
+        } else if (std::strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            if (!parseAnalyses(argv[++i], analyses)) {
+                std::fprintf(stderr, "Invalid analyses: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-e") == 0) {
+            errors = true;
+        } else {
+            jars.emplace_back(argv[i]);
+        }
+    }
+    if (jars.empty()) {
+        std::fprintf(stderr, "Usage: %s [-j threads] [-s] [-a analyses] [-e] <jar>...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::shared_ptr<cjbp::ClassPath>> classPaths;
+    try {
+        for (const std::string &jar : jars) classPaths.push_back(std::make_shared<cjbp::JarClassPath>(jar));
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    cjbp::CompositeClassPath classPath(classPaths);
+
+    std::vector<uint32_t> runs;
+    if (scaling) {
+        for (uint32_t threads = 1; threads < threadCount; threads *= 2) runs.push_back(threads);
+    }
+    runs.push_back(threadCount);
+
+    std::mutex outputMutex;
+    for (uint32_t threads : runs) {
+        cjbp::AnalysisDriver driver(analyses, threads);
+        if (errors) {
+            driver.onError([&](const std::string &className, const cjbp::MethodInfo *method, const std::exception &e) {
+                std::lock_guard<std::mutex> lock(outputMutex);
+                if (method == nullptr) {
+                    std::fprintf(stderr, "%s: %s\n", className.c_str(), e.what());
+                } else {
+                    std::fprintf(stderr, "%s.%s%s: %s\n", className.c_str(), method->name().c_str(), method->type().c_str(), e.what());
+                }
+            });
+        }
+
+        cjbp::AnalysisDriver::Statistics statistics = driver.run(classPath);
+        std::printf("%3u threads: %s\n", threads, statistics.toString().c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Measures how many dispatches a SuperinstructionSet saves over every method of one or more jars.
+//
+// Usage: cjbp_superinstruction_fusion [--no-defaults] [-p name:opcodes...]... [-v class] <jar>...
+//
+// A pattern is given as space-separated elements, each a list of opcode names separated by '|', for example
+// -p "iload_iadd:iload|iload_0|iload_1 iadd". Custom patterns are tried before the default ones.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <cjbp/cjbp.h>
+
+namespace {
+
+bool parseOpcode(const std::string &name, uint8_t &opcode) {
+    for (uint32_t i = 0; i < 256; i++) {
+        const char *candidate = cjbp::opcodeName(i);
+        if (candidate != nullptr && name == candidate) {
+            opcode = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parsePattern(cjbp::SuperinstructionSet &set, const std::string &argument) {
+    size_t colon = argument.find(':');
+    if (colon == std::string::npos) return false;
+
+    std::vector<std::vector<uint8_t>> elements;
+    std::istringstream words(argument.substr(colon + 1));
+    for (std::string word; words >> word;) {
+        std::vector<uint8_t> &element = elements.emplace_back();
+        std::istringstream names(word);
+        for (std::string name; std::getline(names, name, '|');) {
+            uint8_t opcode;
+            if (!parseOpcode(name, opcode)) return false;
+            element.push_back(opcode);
+        }
+    }
+
+    try {
+        set.add(argument.substr(0, colon), elements);
+    } catch (const std::invalid_argument &) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    cjbp::SuperinstructionSet set;
+    bool defaults = true;
+    std::string verboseClass;
+    std::vector<std::string> jars;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--no-defaults") == 0) {
+            defaults = false;
+        } else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            if (!parsePattern(set, argv[++i])) {
+                std::fprintf(stderr, "Invalid pattern: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            verboseClass = argv[++i];
+        } else {
+            jars.emplace_back(argv[i]);
+        }
+    }
+    if (jars.empty()) {
+        std::fprintf(stderr, "Usage: %s [--no-defaults] [-p name:opcodes...]... [-v class] <jar>...\n", argv[0]);
+        return 1;
+    }
+    if (defaults) set.addDefaults();
+
+    std::vector<std::shared_ptr<cjbp::ClassPath>> classPaths;
+    try {
+        for (const std::string &jar : jars) classPaths.push_back(std::make_shared<cjbp::JarClassPath>(jar));
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    cjbp::CompositeClassPath classPath(classPaths);
+
+    uint64_t methods = 0;
+    uint64_t skippedMethods = 0;
+    uint64_t instructions = 0;
+    uint64_t dispatches = 0;
+    std::vector<uint64_t> matches(set.size());
+    std::chrono::steady_clock::duration fusionTime {};
+    for (const std::string &name : classPath.listClasses()) {
+        std::unique_ptr<cjbp::ClassFile> classFile;
+        try {
+            std::shared_ptr<std::istream> stream = classPath.findClass(name);
+            if (stream == nullptr) continue;
+            classFile = cjbp::ClassFile::read(*stream);
+        } catch (const std::exception &) {
+            continue;
+        }
+
+        for (const auto &method : classFile->methods()) {
+            cjbp::CodeAttributeInfo *code = method->code();
+            if (code == nullptr) continue;
+
+            try {
+                auto start = std::chrono::steady_clock::now();
+                cjbp::FusedInstructionStream stream = cjbp::FusedInstructionStream::build(*code, set);
+                fusionTime += std::chrono::steady_clock::now() - start;
+
+                methods++;
+                instructions += stream.instructions().size();
+                dispatches += stream.fused().size();
+                for (const cjbp::FusedInstruction &fused : stream.fused()) {
+                    if (fused.isFused()) matches[fused.pattern()]++;
+                }
+                if (name == verboseClass) std::printf("%s%s\n%s\n\n", method->name().c_str(), method->type().c_str(), stream.toString(set).c_str());
+            } catch (const std::exception &) {
+                skippedMethods++;
+            }
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(fusionTime).count();
+    std::printf("Methods: %llu (%llu skipped)\n", static_cast<unsigned long long>(methods), static_cast<unsigned long long>(skippedMethods));
+    std::printf("Instructions: %llu\n", static_cast<unsigned long long>(instructions));
+    std::printf("Dispatches after fusion: %llu (%.2f%% fewer)\n", static_cast<unsigned long long>(dispatches),
+                instructions == 0 ? 0.0 : 100.0 * (instructions - dispatches) / instructions);
+    std::printf("Fusion time: %.3f s (%.1f ns per instruction)\n", seconds, instructions == 0 ? 0.0 : seconds * 1e9 / instructions);
+
+    std::printf("\nMatches per pattern:\n");
+    for (uint32_t i = 0; i < set.size(); i++) {
+        std::printf("  %-32s %12llu\n", set.pattern(i).name.c_str(), static_cast<unsigned long long>(matches[i]));
+    }
+    return 0;
+}
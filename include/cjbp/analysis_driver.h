@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "inline.h"
+
+namespace cjbp {
+
+class ClassFile;
+class ClassPath;
+class MethodInfo;
+
+/**
+ * AnalysisDriver builds the ControlFlowGraph and a chosen set of analyses for every method of every class of a ClassPath,
+ * in parallel, e.g. for an ahead-of-time analysis step or to benchmark the library.
+ *
+ * Classes are read in parallel if the ClassPath is thread safe (see ClassPath::isThreadSafe()), and one at a time if not,
+ * but are always parsed in parallel. Every method is then analyzed as a separate task on a work-stealing thread pool, so
+ * that one giant class does not hold up a thread while the others sit idle. Cached analyses stay cached on the method's
+ * CodeAttributeInfo, for the callback to use.
+ */
+class AnalysisDriver {
+public:
+    /// Analyses to run on every method, as bit flags. The ControlFlowGraph is always built.
+    enum Analysis : uint32_t {
+        Cfg = 0,
+        Dominators = 1 << 0,    // CodeAttributeInfo::dominators()
+        Loops = 1 << 1,         // CodeAttributeInfo::loops()
+        Liveness = 1 << 2,      // CodeAttributeInfo::liveness()
+        CacheSlots = 1 << 3,    // CodeAttributeInfo::cacheSlots()
+        Types = 1 << 4,         // TypeInference, for every block; not cached
+        Registers = 1 << 5,     // RegisterCode, including TypeInference; not cached
+        Escapes = 1 << 6,       // EscapeAnalysis, including RegisterCode; not cached
+        All = (1 << 7) - 1
+    };
+
+    struct Statistics {
+        uint64_t classes = 0;
+        uint64_t methods = 0;   // Methods with code that were analyzed
+        uint64_t bytes = 0;     // Total length of their bytecode
+        uint64_t failedClasses = 0;
+        uint64_t failedMethods = 0;
+        double seconds = 0;
+
+        CJBP_INLINE double methodsPerSecond() const { return this->seconds > 0 ? this->methods / this->seconds : 0; }
+        CJBP_INLINE double bytesPerSecond() const { return this->seconds > 0 ? this->bytes / this->seconds : 0; }
+
+        std::string toString() const;
+    };
+
+    /// Called from a worker thread once a method has been analyzed. Calls may run concurrently.
+    using MethodCallback = std::function<void(const ClassFile &, const MethodInfo &)>;
+
+    /**
+     * Called from a worker thread when a class cannot be read or a method cannot be analyzed. The method is nullptr if the
+     * class could not be read. Calls may run concurrently.
+     */
+    using ErrorCallback = std::function<void(const std::string &className, const MethodInfo *, const std::exception &)>;
+
+    /**
+     * @param analyses The Analysis flags to run, in addition to the ControlFlowGraph.
+     * @param threadCount The number of worker threads, or 0 for one per hardware thread.
+     */
+    explicit AnalysisDriver(uint32_t analyses, uint32_t threadCount = 0);
+
+    CJBP_INLINE uint32_t analyses() const { return this->analyses_; }
+    CJBP_INLINE uint32_t threadCount() const { return this->threadCount_; }
+
+    CJBP_INLINE void onMethod(MethodCallback callback) { this->methodCallback_ = std::move(callback); }
+    CJBP_INLINE void onError(ErrorCallback callback) { this->errorCallback_ = std::move(callback); }
+
+    /**
+     * Analyzes every class that the class path lists (see ClassPath::listClasses()), and returns once all are done.
+     * Malformed classes and methods are counted and reported to the error callback, and do not stop the run.
+     */
+    Statistics run(ClassPath &classPath);
+
+private:
+    uint32_t analyses_;
+    uint32_t threadCount_;
+    MethodCallback methodCallback_;
+    ErrorCallback errorCallback_;
+
+    void analyze(const ClassFile &classFile, const MethodInfo &method) const;
+};
+
+} // namespace cjbp
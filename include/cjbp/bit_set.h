@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "inline.h"
+
+namespace cjbp {
+
+/**
+ * BitSet is a fixed-size set of bits packed into 64-bit words.
+ *
+ * Bulk operations work a word at a time, so set algebra over a BitSet costs one instruction per 64 members.
+ */
+class BitSet {
+public:
+    using Word = uint64_t;
+    static constexpr uint32_t WordBits = 64;
+
+    CJBP_INLINE static uint32_t wordCount(uint32_t size) { return (size + WordBits - 1) / WordBits; }
+
+    CJBP_INLINE BitSet() : size_(0) { }
+    CJBP_INLINE explicit BitSet(uint32_t size) : size_(size), words_(wordCount(size), 0) { }
+
+    CJBP_INLINE uint32_t size() const { return this->size_; }
+    CJBP_INLINE const std::vector<Word> &words() const { return this->words_; }
+    CJBP_INLINE std::vector<Word> &words() { return this->words_; }
+
+    CJBP_INLINE bool test(uint32_t index) const { return (this->words_[index / WordBits] >> (index % WordBits)) & 1; }
+    CJBP_INLINE void set(uint32_t index) { this->words_[index / WordBits] |= Word(1) << (index % WordBits); }
+    CJBP_INLINE void reset(uint32_t index) { this->words_[index / WordBits] &= ~(Word(1) << (index % WordBits)); }
+    CJBP_INLINE void clear() {
+        for (Word &word : this->words_) word = 0;
+    }
+
+    /// @return The number of set bits.
+    CJBP_INLINE uint32_t count() const {
+        uint32_t result = 0;
+        for (Word word : this->words_) result += __builtin_popcountll(word);
+        return result;
+    }
+
+    CJBP_INLINE bool any() const {
+        for (Word word : this->words_) {
+            if (word != 0) return true;
+        }
+        return false;
+    }
+    CJBP_INLINE bool none() const { return !this->any(); }
+
+    /// @return The index of the first set bit at or after `from`, or `size()` if there is none.
+    CJBP_INLINE uint32_t nextSetBit(uint32_t from) const {
+        if (from >= this->size_) return this->size_;
+        uint32_t wordIndex = from / WordBits;
+        Word word = this->words_[wordIndex] & (~Word(0) << (from % WordBits));
+        while (word == 0) {
+            if (++wordIndex >= this->words_.size()) return this->size_;
+            word = this->words_[wordIndex];
+        }
+        return wordIndex * WordBits + __builtin_ctzll(word);
+    }
+
+    /// Calls `f(index)` for every set bit in ascending order.
+    template<typename F>
+    CJBP_INLINE void forEach(F &&f) const {
+        for (uint32_t i = 0; i < this->words_.size(); i++) {
+            for (Word word = this->words_[i]; word != 0; word &= word - 1) f(i * WordBits + __builtin_ctzll(word));
+        }
+    }
+
+    /// @return true if any bit set in this set is not set in `other`.
+    CJBP_INLINE bool hasBitsOutside(const BitSet &other) const {
+        for (uint32_t i = 0; i < this->words_.size(); i++) {
+            if ((this->words_[i] & ~other.words_[i]) != 0) return true;
+        }
+        return false;
+    }
+
+    /// Adds every bit of `other` to this set. @return true if this set changed.
+    CJBP_INLINE bool unionWith(const BitSet &other) {
+        Word changed = 0;
+        for (uint32_t i = 0; i < this->words_.size(); i++) {
+            Word word = this->words_[i] | other.words_[i];
+            changed |= word ^ this->words_[i];
+            this->words_[i] = word;
+        }
+        return changed != 0;
+    }
+
+    CJBP_INLINE void intersectWith(const BitSet &other) {
+        for (uint32_t i = 0; i < this->words_.size(); i++) this->words_[i] &= other.words_[i];
+    }
+
+    /// Removes every bit of `other` from this set.
+    CJBP_INLINE void subtract(const BitSet &other) {
+        for (uint32_t i = 0; i < this->words_.size(); i++) this->words_[i] &= ~other.words_[i];
+    }
+
+    CJBP_INLINE bool operator==(const BitSet &other) const { return this->size_ == other.size_ && this->words_ == other.words_; }
+    CJBP_INLINE bool operator!=(const BitSet &other) const { return !(*this == other); }
+
+private:
+    uint32_t size_;
+    std::vector<Word> words_;
+};
+
+} // namespace cjbp
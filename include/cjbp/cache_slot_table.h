@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "inline.h"
+
+namespace cjbp {
+
+class CodeAttributeInfo;
+
+/**
+ * CacheSlotTable assigns a dense cache slot to every instruction of a method that references the constant pool (ldc,
+ * getfield, invoke*, new, checkcast, ...).
+ *
+ * An interpreter can keep one array of resolved entries per method, indexed by slot, and fill each entry the first time the
+ * instruction executes. Instructions that resolve the same constant pool entry the same way share a slot, except for
+ * invokedynamic, where every instruction is its own call site and gets its own slot.
+ */
+class CacheSlotTable {
+public:
+    /**
+     * How the constant pool entry of a slot is resolved.
+     */
+    enum class Kind : uint8_t {
+        Constant,        // ldc, ldc_w, ldc2_w
+        StaticField,     // getstatic, putstatic
+        InstanceField,   // getfield, putfield
+        VirtualMethod,   // invokevirtual
+        SpecialMethod,   // invokespecial
+        StaticMethod,    // invokestatic
+        InterfaceMethod, // invokeinterface
+        CallSite,        // invokedynamic
+        Class,           // new, anewarray, checkcast, instanceof, multianewarray
+    };
+
+    struct Slot {
+        uint16_t poolIndex;
+        Kind kind;
+    };
+
+    /// Returned by slot() for offsets that do not hold a constant pool referencing instruction.
+    static constexpr uint16_t NoSlot = 0xFFFF;
+
+    static std::unique_ptr<CacheSlotTable> build(const CodeAttributeInfo &code);
+
+    CJBP_INLINE CacheSlotTable(std::vector<uint16_t> slotByIndex, std::vector<Slot> slots) :
+        slotByIndex_(std::move(slotByIndex)), slots_(std::move(slots)) { }
+
+    /// @return The number of slots, i.e. the size of the array the embedder should allocate for the method.
+    CJBP_INLINE uint32_t size() const { return this->slots_.size(); }
+
+    /// @return The slot used by the instruction at the given index, or NoSlot if it does not reference the constant pool.
+    CJBP_INLINE uint16_t slot(uint32_t index) const { return this->slotByIndex_[index]; }
+
+    CJBP_INLINE const Slot &operator[](uint16_t slot) const { return this->slots_[slot]; }
+    CJBP_INLINE const std::vector<Slot> &slots() const { return this->slots_; }
+
+private:
+    std::vector<uint16_t> slotByIndex_; // Indexed by code index
+    std::vector<Slot> slots_;
+};
+
+} // namespace cjbp
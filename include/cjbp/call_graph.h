@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bit_set.h"
+#include "inline.h"
+#include "span.h"
+
+namespace cjbp {
+
+class ClassPath;
+
+/**
+ * CallGraph holds the static calls between the methods of every class that a ClassPath lists, e.g. to plan ahead-of-time
+ * compilation or to find methods that no entry point can reach.
+ *
+ * Methods are numbered densely. The methods declared by the classes of the class path come first; methods that are called
+ * but could not be found (e.g. those of the JDK, when it is not on the class path) are added after them as undeclared
+ * methods, so every call site has a target. The callees and callers of every method are stored in compressed sparse row
+ * form: one flat array of method numbers, and an array of offsets into it per method.
+ *
+ * Calls are resolved by class hierarchy analysis. invokestatic and invokespecial call the one method that they resolve to
+ * (JVMS 5.4.3.3). invokevirtual and invokeinterface may call the method that every concrete subclass of the referenced
+ * class selects (JVMS 5.4.6), walking up its superclasses and then to default methods of its interfaces. A walk that
+ * reaches a superclass that is not on the class path (e.g. java.lang.Object) calls both the undeclared method of that
+ * class, which it may declare, and the default method that is selected if it does not. Subclasses that are not on the
+ * class path cannot be seen, so a method that is overridden outside of it looks like it has fewer callees.
+ * invokedynamic is not followed, so the bodies of lambdas and the targets of other call sites that are bound at run time
+ * (or by reflection) must be added as roots by the caller, e.g. for dead-code trimming.
+ *
+ * Classes are read in parallel if the ClassPath is thread safe (see ClassPath::isThreadSafe()), and one at a time if not,
+ * but are always parsed and resolved in parallel.
+ */
+class CallGraph {
+public:
+    static constexpr uint32_t NotFound = UINT32_MAX;
+
+    /**
+     * Reads every class that the class path lists (see ClassPath::listClasses()) and builds the graph of their calls.
+     * Classes that cannot be read, and methods whose code is malformed, are counted and left without callees.
+     *
+     * @param threadCount The number of worker threads, or 0 for one per hardware thread.
+     */
+    static std::unique_ptr<CallGraph> build(ClassPath &classPath, uint32_t threadCount = 0);
+
+    /// @return The number of methods, declared or not.
+    CJBP_INLINE uint32_t size() const { return this->methods_.size(); }
+
+    /// @return The number of methods declared by the classes of the class path, which are numbered first.
+    CJBP_INLINE uint32_t declaredCount() const { return this->declaredCount_; }
+
+    /// @return The number of distinct caller-callee pairs.
+    CJBP_INLINE uint32_t edgeCount() const { return this->callees_.size(); }
+
+    CJBP_INLINE uint32_t classCount() const { return this->classNames_.size(); }
+    CJBP_INLINE const std::string &className(uint32_t classIndex) const { return this->classNames_[classIndex]; }
+
+    /// @return The index of the class that declares (or, for an undeclared method, is referenced as declaring) a method.
+    CJBP_INLINE uint32_t owner(uint32_t method) const { return this->methods_[method].owner; }
+
+    CJBP_INLINE const std::string &name(uint32_t method) const { return this->signatures_[this->methods_[method].signature].first; }
+    CJBP_INLINE const std::string &type(uint32_t method) const { return this->signatures_[this->methods_[method].signature].second; }
+
+    /// @return The access flags of a declared method, or 0 for an undeclared one.
+    CJBP_INLINE uint16_t accessFlags(uint32_t method) const { return this->methods_[method].accessFlags; }
+
+    CJBP_INLINE bool isDeclared(uint32_t method) const { return method < this->declaredCount_; }
+
+    /// @return The methods that a method may call, sorted by number.
+    CJBP_INLINE Span<uint32_t> callees(uint32_t method) const {
+        return { this->callees_.data() + this->calleeOffsets_[method], this->calleeOffsets_[method + 1] - this->calleeOffsets_[method] };
+    }
+
+    /// @return The methods that may call a method, sorted by number.
+    CJBP_INLINE Span<uint32_t> callers(uint32_t method) const {
+        return { this->callers_.data() + this->callerOffsets_[method], this->callerOffsets_[method + 1] - this->callerOffsets_[method] };
+    }
+
+    /**
+     * @param className The fully-qualified name of the class (e.g. "java.lang.String").
+     * @param type The raw descriptor of the method (e.g. "(I)Ljava/lang/String;").
+     * @return The number of the method, declared or not, or NotFound if no class of the class path declares or calls it.
+     */
+    uint32_t find(const std::string &className, const std::string &name, const std::string &type) const;
+
+    /// @return The set of methods that can be reached from the given methods by following calls, including themselves.
+    BitSet reachable(Span<uint32_t> roots) const;
+
+    /// @return The number of listed classes that could not be read.
+    CJBP_INLINE uint32_t failedClasses() const { return this->failedClasses_; }
+
+    /// @return The number of methods whose code was malformed, and whose calls are thus missing.
+    CJBP_INLINE uint32_t failedMethods() const { return this->failedMethods_; }
+
+private:
+    struct Method {
+        uint32_t owner;
+        uint32_t signature; // Index in signatures_
+        uint16_t accessFlags;
+    };
+
+    std::vector<std::string> classNames_;
+    std::unordered_map<std::string, uint32_t> classIndices_;
+    std::vector<std::pair<std::string, std::string>> signatures_; // Name and type
+    std::unordered_map<std::string, uint32_t> signatureIndices_;   // By name followed by type
+    std::vector<Method> methods_;
+    std::unordered_map<uint64_t, uint32_t> methodIndices_; // By class index and signature index
+    uint32_t declaredCount_ = 0;
+    std::vector<uint32_t> calleeOffsets_, callees_;
+    std::vector<uint32_t> callerOffsets_, callers_;
+    uint32_t failedClasses_ = 0;
+    uint32_t failedMethods_ = 0;
+
+    CallGraph() = default;
+
+    friend class CallGraphBuilder;
+};
+
+} // namespace cjbp
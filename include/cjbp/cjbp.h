@@ -1,14 +1,28 @@
 #pragma once
 
+#include "analysis_driver.h"
 #include "attribute.h"
+#include "bit_set.h"
+#include "cache_slot_table.h"
+#include "call_graph.h"
 #include "class_file.h"
 #include "class_path.h"
 #include "code_attribute.h"
+#include "code_bitmap.h"
 #include "code_iterator.h"
 #include "constant_pool.h"
 #include "control_flow_graph.h"
+#include "disassembler.h"
+#include "dominator_tree.h"
 #include "endian_util.h"
+#include "escape_analysis.h"
 #include "exception.h"
 #include "field_info.h"
 #include "inline.h"
+#include "liveness.h"
 #include "method_info.h"
+#include "register_code.h"
+#include "span.h"
+#include "superinstruction.h"
+#include "type_inference.h"
+#include "verifier.h"
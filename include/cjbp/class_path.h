@@ -1,12 +1,13 @@
 #pragma once
 
+#include <cstdint>
 #include <istream>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
-struct zip_t;
-
 namespace cjbp {
 
 /**
@@ -31,12 +32,31 @@ public:
      */
     virtual std::shared_ptr<std::istream> findClass(const std::string &name) = 0;
 
+    /**
+     * Lists the fully-qualified names (e.g. "java.lang.String") of every class that can be found in this class path. A class
+     * path that cannot enumerate its contents returns an empty list.
+     */
+    virtual std::vector<std::string> listClasses() { return {}; }
+
+    /**
+     * @return Whether findClass() and listClasses() may be called from several threads at once. Callers must otherwise
+     *         serialize them, e.g. with a mutex.
+     */
+    virtual bool isThreadSafe() const { return false; }
+
+    /**
+     * Calls findClass() while holding mutex, unless the class path is thread safe, so that callers on several threads
+     * can share one class path whatever its kind.
+     */
+    std::shared_ptr<std::istream> findClassSerialized(const std::string &name, std::mutex &mutex);
+
 protected:
     ClassPath() = default;
 };
 
 /**
  * A CompositeClassPath combines multiple ClassPaths. It will search each ClassPath in order until it finds the requested class.
+ * It is thread safe if all of its ClassPaths are.
  */
 class CompositeClassPath : public ClassPath {
 public:
@@ -44,6 +64,8 @@ public:
     ~CompositeClassPath() noexcept override = default;
 
     std::shared_ptr<std::istream> findClass(const std::string &name) override;
+    std::vector<std::string> listClasses() override;
+    bool isThreadSafe() const override;
 
 private:
     std::vector<std::shared_ptr<ClassPath>> classPaths_;
@@ -58,6 +80,8 @@ public:
     ~FileClassPath() noexcept override = default;
 
     std::shared_ptr<std::istream> findClass(const std::string &name) override;
+    std::vector<std::string> listClasses() override;
+    bool isThreadSafe() const override { return true; }
 
 private:
     bool isValid_;
@@ -73,6 +97,8 @@ public:
     ~DirectoryClassPath() noexcept override = default;
 
     std::shared_ptr<std::istream> findClass(const std::string &name) override;
+    std::vector<std::string> listClasses() override;
+    bool isThreadSafe() const override { return true; }
 
 private:
     std::string path_;
@@ -81,7 +107,11 @@ private:
 /**
  * A JarClassPath represents a JAR file containing .class files.
  *
- * It uses the kuba-zip library to read the JAR file.
+ * The jar is mapped into memory, and its central directory is indexed by class name when it is opened, so finding a class
+ * is one hash lookup. Stored (uncompressed) entries are then parsed straight out of the mapping, without copying them;
+ * deflated entries are inflated with miniz into buffers that are pooled and reused once their streams are destroyed.
+ * Nothing but the pool changes after construction, so any number of threads may find classes at once. Streams keep the
+ * mapping alive, and may outlive the JarClassPath. Encrypted entries are skipped.
  */
 class JarClassPath : public ClassPath {
 public:
@@ -89,9 +119,24 @@ public:
     ~JarClassPath() noexcept override;
 
     std::shared_ptr<std::istream> findClass(const std::string &name) override;
+    std::vector<std::string> listClasses() override;
+    bool isThreadSafe() const override { return true; }
 
 private:
-    zip_t *zip_;
+    struct Entry {
+        uint64_t offset; // Of the local header
+        uint64_t compressedSize, size;
+        uint32_t crc32;
+        uint16_t method;
+    };
+
+    class Archive;
+
+    std::shared_ptr<Archive> archive_;
+    std::vector<std::string> classNames_; // In the order of the central directory
+    std::unordered_map<std::string, Entry> entries_; // By fully-qualified class name
+
+    void readCentralDirectory();
 };
 
 } // namespace cjbp
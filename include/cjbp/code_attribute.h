@@ -1,30 +1,69 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <istream>
+#include <string>
 #include <vector>
 
 #include "attribute.h"
+#include "code_iterator.h"
 #include "constant_pool.h"
 #include "inline.h"
+#include "span.h"
 
 namespace cjbp {
 
-class CodeIterator;
+class CacheSlotTable;
+class CodeBitmap;
 class ControlFlowGraph;
-class AbsoluteStackMapFrame;
+class DominatorTree;
+class Liveness;
+class LoopNest;
+class MethodDescriptor;
 class StackMapTableAttributeInfo;
 
+/**
+ * ExceptionTableEntry is one entry of the exception table of a Code attribute: a handler that catches exceptions of a given
+ * class thrown by the instructions in [start, end).
+ */
+class ExceptionTableEntry {
+public:
+    static ExceptionTableEntry read(std::istream &s);
+
+    CJBP_INLINE ExceptionTableEntry(uint16_t start, uint16_t end, uint16_t handler, uint16_t catchType) :
+        start_(start), end_(end), handler_(handler), catchType_(catchType) { }
+
+    CJBP_INLINE uint16_t start() const { return this->start_; }
+    CJBP_INLINE uint16_t end() const { return this->end_; } // Exclusive
+    CJBP_INLINE uint16_t handler() const { return this->handler_; }
+
+    /// @return The constant pool index of the caught class, or 0 if the handler catches every exception (i.e. finally).
+    CJBP_INLINE uint16_t catchType() const { return this->catchType_; }
+    CJBP_INLINE bool isCatchAll() const { return this->catchType_ == 0; }
+
+    CJBP_INLINE bool covers(uint32_t index) const { return this->start_ <= index && index < this->end_; }
+
+private:
+    uint16_t start_;
+    uint16_t end_;
+    uint16_t handler_;
+    uint16_t catchType_;
+};
+
 /**
  * CodeAttributeInfo represents the Code attribute of a method.
+ *
+ * The analyses that it computes lazily and caches (bitmap(), cfg(), dominators(), loops(), liveness(), cacheSlots()) may
+ * be requested from several threads at once. Once computed, requesting one again costs a single atomic load.
  */
 class CodeAttributeInfo : public AttributeInfo {
 public:
     static std::unique_ptr<CodeAttributeInfo> read(std::istream &s, const ConstantPool &constantPool);
 
-    CodeAttributeInfo(uint16_t maxStack, uint16_t maxLocals, std::vector<uint8_t> code, StackMapTableAttributeInfo *stackMapTable,
-                      std::vector<std::unique_ptr<AttributeInfo>> attributes);
+    CodeAttributeInfo(uint16_t maxStack, uint16_t maxLocals, std::vector<uint8_t> code, std::vector<ExceptionTableEntry> exceptionTable,
+                      StackMapTableAttributeInfo *stackMapTable, std::vector<std::unique_ptr<AttributeInfo>> attributes);
     ~CodeAttributeInfo() override;
 
     /**
@@ -33,16 +72,75 @@ public:
     CodeIterator iterator() const;
 
     /**
-     * Computes and caches a ControlFlowGraph for the method.
+     * Creates a range of decoded instructions, for use in a range-based for loop.
+     */
+    InstructionRange instructions() const;
+
+    /**
+     * Scans the code for instruction starts and jump targets in a single pass.
+     */
+    CodeBitmap scan() const;
+
+    /**
+     * Validates the code and caches its CodeBitmap. Validation happens once; later calls return the cached bitmap.
+     *
+     * @throws CorruptClassFile If the code is malformed.
+     */
+    const CodeBitmap &bitmap();
+
+    /**
+     * Creates an iterator that reads the code without bounds checks, for hot loops over code that is known to be valid. The
+     * code is validated (see bitmap()) before the first unchecked iterator is handed out.
      *
-     * Note: CFG calculation currently makes use of the StackMapTable attribute. This attribute was introduced in Java 6;
-     * thus, class files compiled with Java 5 may produce incorrect CFGs.
+     * @throws CorruptClassFile If the code is malformed.
+     */
+    UncheckedCodeIterator uncheckedIterator();
+
+    /**
+     * Creates a range of decoded instructions that reads the code without bounds checks. See uncheckedIterator().
+     */
+    UncheckedInstructionRange uncheckedInstructions();
+
+    /**
+     * Computes and caches a ControlFlowGraph for the method. Blocks are discovered from the bytecode, so methods without a
+     * StackMapTable (e.g. those compiled for Java 5 or earlier) are supported.
+     *
+     * @throws CorruptClassFile If the code or its exception table is malformed.
      */
     ControlFlowGraph *cfg();
 
+    /**
+     * Computes and caches the DominatorTree of the method's ControlFlowGraph.
+     *
+     * @throws CorruptClassFile If the CFG cannot be built.
+     */
+    const DominatorTree *dominators();
+
+    /**
+     * Computes and caches the LoopNest of the method, i.e. its natural loops with their headers, back edges and nesting
+     * depths.
+     *
+     * @throws CorruptClassFile If the CFG cannot be built.
+     */
+    const LoopNest *loops();
+
+    /**
+     * Computes and caches the Liveness of the method's local variables, per block and per instruction.
+     *
+     * @throws CorruptClassFile If the CFG cannot be built, or if the code accesses a local variable past maxLocals.
+     */
+    const Liveness *liveness();
+
+    /**
+     * Computes and caches the CacheSlotTable of the method, which gives every constant pool referencing instruction a dense
+     * index into a per-method resolution cache.
+     */
+    const CacheSlotTable *cacheSlots();
+
     CJBP_INLINE uint16_t maxStack() const { return this->maxStack_; }
     CJBP_INLINE uint16_t maxLocals() const { return this->maxLocals_; }
     CJBP_INLINE const std::vector<uint8_t> &code() const { return this->code_; }
+    CJBP_INLINE const std::vector<ExceptionTableEntry> &exceptionTable() const { return this->exceptionTable_; }
     CJBP_INLINE const StackMapTableAttributeInfo *stackMap() const { return this->stackMapTable_; }
     CJBP_INLINE const std::vector<std::unique_ptr<AttributeInfo>> &attributes() const { return this->attributes_; }
 
@@ -50,12 +148,23 @@ public:
     std::string toString(const ConstantPool &constantPool) override;
 
 private:
+    friend class MethodInfo;
+
     uint16_t maxStack_;
     uint16_t maxLocals_;
     std::vector<uint8_t> code_;
+    std::vector<ExceptionTableEntry> exceptionTable_;
     StackMapTableAttributeInfo *stackMapTable_; // May be nullptr
     std::vector<std::unique_ptr<AttributeInfo>> attributes_;
-    std::unique_ptr<ControlFlowGraph> cfg_;
+
+    // Lazily computed analyses, owned by this object. They are published atomically, so that threads that share the code
+    // (e.g. several compiler threads) never see a partly built one; see cached() in code_attribute.cc.
+    std::atomic<const CodeBitmap *> bitmap_;
+    std::atomic<ControlFlowGraph *> cfg_;
+    std::atomic<const DominatorTree *> dominators_;
+    std::atomic<const LoopNest *> loops_;
+    std::atomic<const Liveness *> liveness_;
+    std::atomic<const CacheSlotTable *> cacheSlots_;
 };
 
 
@@ -79,6 +188,7 @@ public:
     CJBP_INLINE Tag tag() const { return this->tag_; }
 
     // @formatter:off
+    /// @return The constant pool index of the class of an Object type, or 0 if the method descriptor names it (see className()).
     CJBP_INLINE uint16_t constantPoolIndex() const {
         assert(this->tag_ == Tag::Object);
         return this->data_;
@@ -89,18 +199,33 @@ public:
     }
     // @formatter:on
 
+    /**
+     * @return The name of the class of an Object type that the method descriptor names, i.e. a parameter in the implicit
+     *     initial frame (see StackMapTableAttributeInfo::frames()), or nullptr for a type that the constant pool names.
+     */
+    CJBP_INLINE const std::string *className() const { return this->className_; }
+
     std::string toString() const;
 
 private:
+    friend class StackMapTableAttributeInfo;
+
     Tag tag_;
     uint16_t data_;
+    const std::string *className_;
 
-    CJBP_INLINE /* implicit */ VerificationTypeInfo(Tag tag) : tag_(tag), data_(0) { } // NOLINT(google-explicit-constructor)
-    CJBP_INLINE /* implicit */ VerificationTypeInfo(Tag tag, uint16_t data) : tag_(tag), data_(data) {
+    CJBP_INLINE /* implicit */ VerificationTypeInfo(Tag tag) : tag_(tag), data_(0), className_(nullptr) { } // NOLINT(google-explicit-constructor)
+    CJBP_INLINE /* implicit */ VerificationTypeInfo(Tag tag, uint16_t data) : tag_(tag), data_(data), className_(nullptr) {
         assert(tag == Tag::Object || tag == Tag::Uninitialized);
     }
+    CJBP_INLINE explicit VerificationTypeInfo(const std::string *className) : tag_(Tag::Object), data_(0), className_(className) { }
 };
 
+/**
+ * StackMapFrame is an entry of a StackMapTable, as encoded: relative to the previous frame. Frames are small values stored
+ * in one array per table, and the types that they list are packed in a second array shared by the whole table, which
+ * locals() and stack() point into.
+ */
 class StackMapFrame {
 public:
     enum class Type : uint8_t {
@@ -113,34 +238,124 @@ public:
         Full = 255
     };
 
-    static std::unique_ptr<StackMapFrame> read(std::istream &s);
+    std::string toString() const;
 
-    virtual ~StackMapFrame() noexcept = default;
+    /// @return The kind of the frame. Chop and Append frames are Type::Chop and Type::Append whatever their count.
+    CJBP_INLINE Type type() const { return this->type_; }
 
-    virtual AbsoluteStackMapFrame apply(const AbsoluteStackMapFrame &previous) const = 0;
-    virtual std::string toString() const = 0;
+    /// @return The offset delta of the frame, i.e. its distance from the previous frame.
+    CJBP_INLINE uint16_t offsetDelta() const { return this->offsetDelta_; }
+
+    /// @return The number of locals that a Chop frame removes from the previous frame, 0 for other frames.
+    CJBP_INLINE uint8_t chopCount() const { return this->chopCount_; }
+
+    /// @return The locals that an Append frame adds to the previous frame, or every local of a Full frame. Empty for other
+    ///     frames, which keep the locals of the previous frame.
+    CJBP_INLINE Span<VerificationTypeInfo> locals() const { return { this->types_ + this->firstType_, this->localCount_ }; }
+
+    /// @return The operand stack of the frame, which has at most one item unless this is a Full frame.
+    CJBP_INLINE Span<VerificationTypeInfo> stack() const {
+        return { this->types_ + this->firstType_ + this->localCount_, this->stackCount_ };
+    }
 
 private:
-    class Same;
-    class Chop;
-    class Append;
-    class Full;
+    friend class StackMapTableAttributeInfo;
+
+    const VerificationTypeInfo *types_; // The types of the table, set by the table once they are all read
+    uint32_t firstType_;                // Position of the first local, then of the stack, in the types of the table
+    uint16_t offsetDelta_;
+    uint16_t localCount_;
+    uint16_t stackCount_;
+    Type type_;
+    uint8_t chopCount_;
+
+    CJBP_INLINE StackMapFrame(Type type, uint16_t offsetDelta, uint8_t chopCount, uint32_t firstType, uint16_t localCount, uint16_t stackCount) :
+        types_(nullptr), firstType_(firstType), offsetDelta_(offsetDelta), localCount_(localCount), stackCount_(stackCount), type_(type),
+        chopCount_(chopCount) { }
+
+    /// Reads a frame, appending its types to the types of the table.
+    static StackMapFrame read(std::istream &s, std::vector<VerificationTypeInfo> &types);
+};
+
+/**
+ * AbsoluteStackMapFrame is a StackMapTable frame in absolute form: with its code index, and with all of its locals rather
+ * than their difference from the previous frame. It does not own its types, which live in its StackMapTableAttributeInfo.
+ */
+class AbsoluteStackMapFrame {
+public:
+    CJBP_INLINE AbsoluteStackMapFrame() : start_(0), initial_(true) { }
+    CJBP_INLINE AbsoluteStackMapFrame(uint32_t start, Span<VerificationTypeInfo> locals, Span<VerificationTypeInfo> stack) :
+        start_(start), initial_(false), locals_(locals), stack_(stack) { }
+
+    CJBP_INLINE uint32_t start() const { return this->start_; }
+
+    /// @return true for a default constructed frame, which stands for the implicit frame that precedes the first entry of a
+    ///     StackMapTable.
+    CJBP_INLINE bool isInitial() const { return this->initial_; }
+
+    CJBP_INLINE Span<VerificationTypeInfo> locals() const { return this->locals_; }
+    CJBP_INLINE Span<VerificationTypeInfo> stack() const { return this->stack_; }
+
+private:
+    uint32_t start_;
+    bool initial_;
+    Span<VerificationTypeInfo> locals_;
+    Span<VerificationTypeInfo> stack_;
 };
 
 class StackMapTableAttributeInfo : public AttributeInfo {
 public:
     static std::unique_ptr<StackMapTableAttributeInfo> read(std::istream &s);
 
-    CJBP_INLINE explicit StackMapTableAttributeInfo(std::vector<std::unique_ptr<StackMapFrame>> entries) : entries_(std::move(entries)) { }
-    ~StackMapTableAttributeInfo() override = default;
+    /// @param types The types of every frame, in the order the frames list them.
+    StackMapTableAttributeInfo(std::vector<StackMapFrame> entries, std::vector<VerificationTypeInfo> types);
+    ~StackMapTableAttributeInfo() override;
+
+    // The entries point into types_
+    StackMapTableAttributeInfo(const StackMapTableAttributeInfo &) = delete;
+    StackMapTableAttributeInfo &operator=(const StackMapTableAttributeInfo &) = delete;
+
+    CJBP_INLINE const std::vector<StackMapFrame> &entries() const { return this->entries_; }
+
+    /**
+     * @return Every frame in absolute form, in code order. They are decoded on first use and kept, and may be requested
+     *     from several threads at once. The first frame is decoded against the implicit initial frame, whose locals hold
+     *     the receiver and the parameters of the method (JVMS 4.7.4), as MethodInfo::read() sets them; a table that is
+     *     not read as part of a method starts from no locals.
+     * @throws CorruptClassFile If a Chop frame removes more locals than the previous frame has.
+     */
+    Span<AbsoluteStackMapFrame> frames() const;
 
-    CJBP_INLINE const std::vector<std::unique_ptr<StackMapFrame>> &entries() const { return this->entries_; }
+    /**
+     * @return The last frame that starts at or before the given code index, found by binary search of frames(), e.g. to
+     *     find the types at a safepoint from the frame of its block. nullptr if every frame starts after the index.
+     * @throws CorruptClassFile If a Chop frame removes more locals than the previous frame has.
+     */
+    const AbsoluteStackMapFrame *frameAt(uint32_t index) const;
 
     Type type() const override { return Type::StackMapTable; }
     std::string toString(const ConstantPool &constantPool) override;
 
 private:
-    std::vector<std::unique_ptr<StackMapFrame>> entries_;
+    friend class MethodInfo;
+
+    struct Absolute;
+
+    std::vector<StackMapFrame> entries_;
+    std::vector<VerificationTypeInfo> types_;
+    std::vector<VerificationTypeInfo> initialLocals_; // Of the implicit initial frame
+    std::vector<std::string> initialClassNames_;      // Of the parameters in initialLocals_ that are references
+    mutable std::atomic<const Absolute *> absolute_;  // Lazily decoded frames(), see cached() in code_attribute.cc
+
+    /**
+     * Sets the locals of the implicit initial frame from the method that the table belongs to (JVMS 4.10.1.6): this, unless
+     * the method is static, and then its parameters. Called while the method is read, before frames() can be.
+     *
+     * @param thisClass The constant pool index of the class that declares the method.
+     * @param constructor Whether the method is an instance initializer of a class other than java.lang.Object, whose this
+     *     is uninitialized.
+     */
+    void setInitialFrame(uint16_t thisClass, bool isStatic, bool constructor, const MethodDescriptor &descriptor);
 };
 
 } // namespace cjbp
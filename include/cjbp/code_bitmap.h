@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "bit_set.h"
+#include "inline.h"
+
+namespace cjbp {
+
+/**
+ * CodeBitmap records, for every offset of a method's code array, whether an instruction starts there and whether it is the
+ * target of a jump (including goto_w, jsr_w and every tableswitch/lookupswitch target).
+ *
+ * Both sets are computed in a single linear pass over the code, so block leaders can be found without re-walking the code
+ * for each block.
+ */
+class CodeBitmap {
+public:
+    /**
+     * Scans the given code array.
+     *
+     * @throws CorruptClassFile If an instruction is malformed or runs past the end of the code, or if a jump targets an offset
+     *     that is not the start of an instruction.
+     */
+    static CodeBitmap scan(const uint8_t *code, uint32_t size);
+
+    CJBP_INLINE CodeBitmap(BitSet instructionStarts, BitSet branchTargets, uint32_t instructionCount) :
+        instructionStarts_(std::move(instructionStarts)), branchTargets_(std::move(branchTargets)), instructionCount_(instructionCount) { }
+
+    /// @return The set of offsets at which an instruction starts.
+    CJBP_INLINE const BitSet &instructionStarts() const { return this->instructionStarts_; }
+
+    /// @return The set of offsets that are the target of at least one jump.
+    CJBP_INLINE const BitSet &branchTargets() const { return this->branchTargets_; }
+
+    CJBP_INLINE bool isInstructionStart(uint32_t index) const { return this->instructionStarts_.test(index); }
+    CJBP_INLINE bool isBranchTarget(uint32_t index) const { return this->branchTargets_.test(index); }
+    CJBP_INLINE uint32_t instructionCount() const { return this->instructionCount_; }
+
+private:
+    BitSet instructionStarts_;
+    BitSet branchTargets_;
+    uint32_t instructionCount_;
+};
+
+} // namespace cjbp
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
+#include <stdexcept>
 #include <string>
 
 #include "endian_util.h"
+#include "exception.h"
 #include "inline.h"
 
 namespace cjbp {
@@ -241,24 +246,211 @@ enum NewArrayType : uint8_t {
 } // namespace ArrayTypeNamespace
 using NewArrayType = NewArrayTypeNamespace::NewArrayType;
 
+/// @return The mnemonic of the given opcode (e.g. "invokevirtual"), or nullptr if the opcode is not defined.
+const char *opcodeName(uint8_t opcode);
+
+/**
+ * SwitchTable is a view of the jump table of a tableswitch or lookupswitch instruction.
+ */
+class SwitchTable {
+public:
+    CJBP_INLINE SwitchTable(const uint8_t *code, uint32_t index) :
+        code_(code), index_(index), operands_((index + 4) & ~3), lookup_(code[index] == Opcode::LookupSwitch) {
+        if (this->lookup_) {
+            this->low_ = 0;
+            this->size_ = this->read(this->operands_ + 4);
+        } else {
+            this->low_ = this->read(this->operands_ + 4);
+            this->size_ = static_cast<uint32_t>(this->read(this->operands_ + 8) - this->low_ + 1);
+        }
+    }
+
+    /// @return true if this is the table of a lookupswitch, false if it is the table of a tableswitch.
+    CJBP_INLINE bool isLookup() const { return this->lookup_; }
+
+    /// @return The number of cases in the table, not counting the default case.
+    CJBP_INLINE uint32_t size() const { return this->size_; }
+
+    /// @return The absolute index that the switch jumps to if no case matches.
+    CJBP_INLINE uint32_t defaultTarget() const { return this->index_ + this->read(this->operands_); }
+
+    /// @return The value matched by the i-th case.
+    CJBP_INLINE int32_t key(uint32_t i) const { return this->lookup_ ? this->read(this->operands_ + 8 + i * 8) : this->low_ + static_cast<int32_t>(i); }
+
+    /// @return The absolute index that the i-th case jumps to.
+    CJBP_INLINE uint32_t target(uint32_t i) const {
+        return this->index_ + this->read(this->lookup_ ? this->operands_ + 12 + i * 8 : this->operands_ + 12 + i * 4);
+    }
+
+private:
+    const uint8_t *code_;
+    uint32_t index_;
+    uint32_t operands_;
+    bool lookup_;
+    int32_t low_;
+    uint32_t size_;
+
+    CJBP_INLINE int32_t read(uint32_t index) const { return toBigEndian(*reinterpret_cast<const int32_t *>(this->code_ + index)); }
+};
+
+/**
+ * Instruction is a single decoded instruction, with its operands already read out of the code array.
+ *
+ * Instructions are created by CodeIterator::decode, which is the only place operands are decoded.
+ */
+class Instruction {
+public:
+    /**
+     * The layout of an instruction's operands.
+     */
+    enum class Format : uint8_t {
+        None,           // No operands
+        Local,          // Local variable index (iload, istore, ret, and their _<n> forms)
+        Immediate,      // Signed immediate (bipush, sipush), or array type (newarray)
+        Pool,           // Constant pool index (ldc, getfield, invokevirtual, new, ...)
+        PoolImmediate,  // Constant pool index and an unsigned immediate (invokeinterface count, multianewarray dimensions)
+        LocalImmediate, // Local variable index and signed increment (iinc)
+        Branch,         // Branch offset (if<cond>, goto, jsr, goto_w, jsr_w)
+        Switch,         // Jump table (tableswitch, lookupswitch)
+    };
+
+    CJBP_INLINE Instruction() : code_(nullptr), index_(0), length_(0), immediate_(0), operand_(0), opcode_(Opcode::Nop), format_(Format::None), wide_(false) { }
+    CJBP_INLINE Instruction(const uint8_t *code, uint32_t index, uint32_t length, Opcode opcode, Format format, bool wide, uint16_t operand,
+                            int32_t immediate) :
+        code_(code), index_(index), length_(length), immediate_(immediate), operand_(operand), opcode_(opcode), format_(format), wide_(wide) { }
+
+    /// @return The index of the instruction in the code array.
+    CJBP_INLINE uint32_t index() const { return this->index_; }
+
+    /// @return The length of the instruction in bytes, including any wide prefix and switch padding.
+    CJBP_INLINE uint32_t length() const { return this->length_; }
+
+    /// @return The index of the instruction that follows this one.
+    CJBP_INLINE uint32_t nextIndex() const { return this->index_ + this->length_; }
+
+    /// @return The opcode of the instruction. For wide instructions, this is the modified opcode rather than `wide`.
+    CJBP_INLINE Opcode opcode() const { return this->opcode_; }
+    CJBP_INLINE Format format() const { return this->format_; }
+    CJBP_INLINE bool isWide() const { return this->wide_; }
+
+    CJBP_INLINE bool hasLocalIndex() const { return this->format_ == Format::Local || this->format_ == Format::LocalImmediate; }
+    CJBP_INLINE bool hasPoolIndex() const { return this->format_ == Format::Pool || this->format_ == Format::PoolImmediate; }
+    CJBP_INLINE bool isBranch() const { return this->format_ == Format::Branch; }
+    CJBP_INLINE bool isSwitch() const { return this->format_ == Format::Switch; }
+
+    // @formatter:off
+    /// @return The local variable index operand, including the implicit index of the _<n> forms.
+    CJBP_INLINE uint16_t localIndex() const {
+        assert(this->hasLocalIndex());
+        return this->operand_;
+    }
+    /// @return The constant pool index operand.
+    CJBP_INLINE uint16_t poolIndex() const {
+        assert(this->hasPoolIndex());
+        return this->operand_;
+    }
+    /// @return The immediate operand: the pushed value of bipush/sipush, the increment of iinc, the array type of newarray, the
+    ///     count of invokeinterface, or the dimensions of multianewarray.
+    CJBP_INLINE int32_t immediate() const {
+        assert(this->format_ == Format::Immediate || this->format_ == Format::PoolImmediate || this->format_ == Format::LocalImmediate);
+        return this->immediate_;
+    }
+    /// @return The branch offset, relative to the index of this instruction.
+    CJBP_INLINE int32_t branchOffset() const {
+        assert(this->isBranch());
+        return this->immediate_;
+    }
+    /// @return The absolute index the branch jumps to.
+    CJBP_INLINE uint32_t branchTarget() const { return this->index_ + this->branchOffset(); }
+    CJBP_INLINE SwitchTable switchTable() const {
+        assert(this->isSwitch());
+        return { this->code_, this->index_ };
+    }
+    // @formatter:on
+
+    std::string toString() const;
+
+private:
+    const uint8_t *code_;
+    uint32_t index_;
+    uint32_t length_;
+    int32_t immediate_; // Also holds the branch offset
+    uint16_t operand_;  // Local variable index or constant pool index
+    Opcode opcode_;
+    Format format_;
+    bool wide_;
+};
+
 /**
- * CodeIterator iterates over individual instructions of a CodeAttribute's code array.
+ * CheckedAccess is the BasicCodeIterator policy for code that has not been validated: every read of the code array is
+ * bounds-checked, and running past the end of the code throws.
  */
-class CodeIterator {
+struct CheckedAccess {
+    static constexpr bool Checked = true;
+
+    CJBP_INLINE static void check(uint64_t index, uint64_t width, uint32_t size) {
+        if (index + width > size) throw CorruptClassFile("CodeIterator: Read past end of code");
+    }
+};
+
+/**
+ * UncheckedAccess is the BasicCodeIterator policy for code that has passed validation (see
+ * CodeAttributeInfo::uncheckedIterator): reads compile to raw loads, with no bounds checks.
+ */
+struct UncheckedAccess {
+    static constexpr bool Checked = false;
+
+    CJBP_INLINE static void check(uint64_t, uint64_t, uint32_t) { }
+};
+
+template<typename Access>
+class BasicInstructionRange;
+
+/**
+ * BasicCodeIterator iterates over individual instructions of a CodeAttribute's code array.
+ *
+ * The Access policy decides whether reads are bounds-checked. Use CodeIterator for untrusted code, and
+ * UncheckedCodeIterator only for code that has been validated.
+ */
+template<typename Access>
+class BasicCodeIterator {
 public:
-    CJBP_INLINE explicit CodeIterator(const uint8_t *code, uint32_t size) : code_(code), size_(size), position_(0) { }
+    CJBP_INLINE explicit BasicCodeIterator(const uint8_t *code, uint32_t size) : code_(code), size_(size), position_(0) { }
 
     /// Returns the index of the next opcode in the code.
     uint32_t next();
 
+    /// Decodes the next instruction in the code and advances past it.
+    CJBP_INLINE Instruction nextInstruction() {
+        if constexpr (Access::Checked) {
+            if (this->position_ >= this->size_) throw std::out_of_range("CodeIterator::nextInstruction: End of code");
+        }
+        Instruction instruction = this->decode(this->position_);
+        this->position_ = instruction.nextIndex();
+        return instruction;
+    }
+
+    /// Decodes the instruction at the given index without moving the iterator.
+    Instruction decode(uint32_t index) const;
+
     CJBP_INLINE void moveTo(uint32_t position) { this->position_ = position; }
     CJBP_INLINE uint32_t peek() const { return this->position_; }
     CJBP_INLINE bool eof() const { return this->position_ >= this->size_; }
+    CJBP_INLINE uint32_t size() const { return this->size_; }
 
-    CJBP_INLINE uint8_t operator[](uint32_t index) const { return this->code_[index]; }
+    CJBP_INLINE uint8_t operator[](uint32_t index) const {
+        Access::check(index, 1, this->size_);
+        return this->code_[index];
+    }
 
     template<typename T>
-    CJBP_INLINE T read(uint32_t index) const { return toBigEndian(*reinterpret_cast<const T *>(this->code_ + index)); }
+    CJBP_INLINE T read(uint32_t index) const {
+        Access::check(index, sizeof(T), this->size_);
+        return toBigEndian(*reinterpret_cast<const T *>(this->code_ + index));
+    }
+
+    /// @return A range over the instructions from the iterator's current position to the end of the code.
+    BasicInstructionRange<Access> instructions() const;
 
     std::string toString(uint32_t index) const;
 
@@ -268,4 +460,70 @@ private:
     uint32_t position_;
 };
 
+using CodeIterator = BasicCodeIterator<CheckedAccess>;
+using UncheckedCodeIterator = BasicCodeIterator<UncheckedAccess>;
+
+extern template class BasicCodeIterator<CheckedAccess>;
+extern template class BasicCodeIterator<UncheckedAccess>;
+
+/**
+ * BasicInstructionRange allows iterating over decoded instructions with a range-based for loop:
+ *
+ *     for (const Instruction &instruction : code.instructions()) { ... }
+ */
+template<typename Access>
+class BasicInstructionRange {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Instruction;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Instruction *;
+        using reference = const Instruction &;
+
+        CJBP_INLINE Iterator(BasicCodeIterator<Access> code, uint32_t index) : code_(code), index_(index) {
+            if (this->index_ < this->code_.size()) this->current_ = this->code_.decode(this->index_);
+        }
+
+        CJBP_INLINE const Instruction &operator*() const { return this->current_; }
+        CJBP_INLINE const Instruction *operator->() const { return &this->current_; }
+
+        CJBP_INLINE Iterator &operator++() {
+            this->index_ = this->current_.nextIndex();
+            if (this->index_ < this->code_.size()) {
+                this->current_ = this->code_.decode(this->index_);
+            } else {
+                this->index_ = this->code_.size();
+            }
+            return *this;
+        }
+
+        CJBP_INLINE bool operator==(const Iterator &other) const { return this->index_ == other.index_; }
+        CJBP_INLINE bool operator!=(const Iterator &other) const { return this->index_ != other.index_; }
+
+    private:
+        BasicCodeIterator<Access> code_;
+        uint32_t index_;
+        Instruction current_;
+    };
+
+    CJBP_INLINE BasicInstructionRange(BasicCodeIterator<Access> code, uint32_t start) : code_(code), start_(start) { }
+
+    CJBP_INLINE Iterator begin() const { return { this->code_, this->start_ }; }
+    CJBP_INLINE Iterator end() const { return { this->code_, this->code_.size() }; }
+
+private:
+    BasicCodeIterator<Access> code_;
+    uint32_t start_;
+};
+
+using InstructionRange = BasicInstructionRange<CheckedAccess>;
+using UncheckedInstructionRange = BasicInstructionRange<UncheckedAccess>;
+
+template<typename Access>
+CJBP_INLINE BasicInstructionRange<Access> BasicCodeIterator<Access>::instructions() const {
+    return { *this, this->position_ };
+}
+
 } // namespace cjbp
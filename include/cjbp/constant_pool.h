@@ -43,6 +43,9 @@ public:
     /// @return The type of the entry at the given index.
     Tag tag(uint16_t index) const;
 
+    /// @return true if the given index holds an entry of the given type.
+    bool isValid(uint16_t index, Tag tag) const;
+
     /// @return The UTF-8 string at the given index. The entry must be of type `Utf8`.
     const std::string &utf8(uint16_t index) const;
 
@@ -103,6 +106,15 @@ public:
     /// @return A parsed version of the type of the interface method reference at the given index. The entry must be of type `InterfaceMethodRef`.
     const MethodDescriptor &interfaceMethodRefDesc(uint16_t index) const;
 
+    /// @return The raw method type descriptor at the given index. The entry must be of type `MethodType`.
+    const std::string &methodType(uint16_t index) const;
+
+    /// @return The name of the invoke dynamic call site at the given index. The entry must be of type `InvokeDynamic`.
+    const std::string &invokeDynamicName(uint16_t index) const;
+
+    /// @return The raw type of the invoke dynamic call site at the given index. The entry must be of type `InvokeDynamic`.
+    const std::string &invokeDynamicType(uint16_t index) const;
+
     std::string toString() const;
 
 private:
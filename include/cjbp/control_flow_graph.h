@@ -2,88 +2,225 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
-#include <map>
 
+#include "code_attribute.h"
 #include "inline.h"
+#include "span.h"
 
 namespace cjbp {
 
-class CodeAttributeInfo;
-class VerificationTypeInfo;
+class SwitchTable;
 
-class AbsoluteStackMapFrame {
+/**
+ * JumpTable is the decoded table of the tableswitch or lookupswitch that ends a basic block, so that consumers can dispatch
+ * the switch without reading the code array again.
+ *
+ * Cases refer to their target by its position in the ControlFlowGraph::successors() of the block, which are deduplicated,
+ * so the table stays small even when many cases share a target.
+ */
+class JumpTable {
 public:
-    AbsoluteStackMapFrame();
-    AbsoluteStackMapFrame(uint32_t start, std::shared_ptr<std::vector<VerificationTypeInfo>> locals,
-                          std::vector<VerificationTypeInfo> stack);
-    ~AbsoluteStackMapFrame() noexcept;
+    /**
+     * Decodes a switch table. The code indices of the targets of the switch are appended to successors, unless already
+     * present.
+     *
+     * @throws CorruptClassFile If the keys of a lookupswitch are not sorted.
+     */
+    JumpTable(const SwitchTable &table, std::vector<uint32_t> &successors);
 
-    AbsoluteStackMapFrame(const AbsoluteStackMapFrame &) = default;
-    AbsoluteStackMapFrame(AbsoluteStackMapFrame &&) = default;
-    AbsoluteStackMapFrame &operator=(const AbsoluteStackMapFrame &) = default;
-    AbsoluteStackMapFrame &operator=(AbsoluteStackMapFrame &&) = default;
+    /// @return true if this is the table of a lookupswitch, false if it is the table of a tableswitch.
+    CJBP_INLINE bool isLookup() const { return this->lookup_; }
 
-    CJBP_INLINE uint32_t start() const { return this->start_; }
-    CJBP_INLINE const std::vector<VerificationTypeInfo> &locals() const { return *this->locals_; }
-    CJBP_INLINE const std::vector<VerificationTypeInfo> &stack() const { return this->stack_; }
-    CJBP_INLINE const std::shared_ptr<std::vector<VerificationTypeInfo>> &localsPtr() const { return this->locals_; }
+    /// @return The number of cases in the table, not counting the default case.
+    CJBP_INLINE uint32_t size() const { return this->successors_.size(); }
 
-protected:
-    friend class ControlFlowGraph;
+    /// @return The value matched by the i-th case.
+    CJBP_INLINE int32_t key(uint32_t i) const { return this->lookup_ ? this->keys_[i] : this->low_ + static_cast<int32_t>(i); }
+
+    /// @return The position in the successors of the block of the target of the i-th case.
+    CJBP_INLINE uint16_t successor(uint32_t i) const { return this->successors_[i]; }
 
-    void start(uint32_t start) { this->start_ = start; }
+    /// @return The position in the successors of the block of the default target.
+    CJBP_INLINE uint16_t defaultSuccessor() const { return this->defaultSuccessor_; }
+
+    /// @return The position in the successors of the block of the target that the switch jumps to for the given value.
+    uint16_t dispatch(int32_t value) const;
 
 private:
-    uint32_t start_;
-    std::shared_ptr<std::vector<VerificationTypeInfo>> locals_;
-    std::vector<VerificationTypeInfo> stack_;
+    int32_t low_;
+    std::vector<int32_t> keys_; // Sorted; empty for a tableswitch
+    std::vector<uint16_t> successors_;
+    uint16_t defaultSuccessor_;
+    bool lookup_;
 };
 
+/**
+ * BasicBlock is a maximal run of instructions that is only entered at its first instruction and only left after its last.
+ *
+ * Blocks are plain values stored in one array of their ControlFlowGraph, which also holds their edges; a block is
+ * identified by its position in that array.
+ */
 class BasicBlock {
 public:
-    BasicBlock(AbsoluteStackMapFrame stackMap, uint32_t end, std::vector<uint32_t> successors,
-               std::vector<uint32_t> predecessors);
-
-    BasicBlock(const BasicBlock &) = delete;
-    BasicBlock(BasicBlock &&) = default;
-    BasicBlock &operator=(const BasicBlock &) = delete;
-    BasicBlock &operator=(BasicBlock &&) = default;
-
-    CJBP_INLINE const AbsoluteStackMapFrame &stackMap() const { return this->stackMap_; }
-    CJBP_INLINE uint32_t start() const { return this->stackMap_.start(); }
-    CJBP_INLINE uint32_t end() const { return this->end_; }
-    CJBP_INLINE const std::vector<VerificationTypeInfo> &locals() const { return this->stackMap_.locals(); }
-    CJBP_INLINE const std::vector<VerificationTypeInfo> &stack() const { return this->stackMap_.stack(); }
-    CJBP_INLINE const std::vector<uint32_t> &successors() const { return this->successors_; }
-    CJBP_INLINE const std::vector<uint32_t> &predecessors() const { return this->predecessors_; }
-
-protected:
-    friend class ControlFlowGraph;
+    static constexpr uint32_t None = UINT32_MAX;
 
-    CJBP_INLINE void end(uint32_t end) { this->end_ = end; }
-    CJBP_INLINE void successors(std::vector<uint32_t> successors) { this->successors_ = std::move(successors); }
-    CJBP_INLINE void addPredecessor(uint32_t predecessor) { this->predecessors_.push_back(predecessor); }
+    CJBP_INLINE BasicBlock(uint32_t id, uint32_t start, uint32_t end, uint32_t stackMap, uint32_t jumpTable, bool handler) :
+        id_(id), start_(start), end_(end), stackMap_(stackMap), jumpTable_(jumpTable), handler_(handler) { }
+
+    /// @return The position of the block in ControlFlowGraph::blocks(). Blocks are numbered in code order, from 0.
+    CJBP_INLINE uint32_t id() const { return this->id_; }
+
+    CJBP_INLINE uint32_t start() const { return this->start_; }
+    CJBP_INLINE uint32_t end() const { return this->end_; } // Exclusive
+
+    /// @return true if the block is the start of an exception handler.
+    CJBP_INLINE bool isHandler() const { return this->handler_; }
 
 private:
-    AbsoluteStackMapFrame stackMap_;
-    uint32_t end_;  // Exclusive
-    std::vector<uint32_t> successors_;
-    std::vector<uint32_t> predecessors_;
+    friend class ControlFlowGraph;
+
+    uint32_t id_;
+    uint32_t start_;
+    uint32_t end_;
+    uint32_t stackMap_;  // Index into ControlFlowGraph::stackMaps_, or None
+    uint32_t jumpTable_; // Index into ControlFlowGraph::jumpTables_, or None
+    bool handler_;
 };
 
-class ControlFlowGraph {
+/**
+ * ExceptionalEdge leads from a block to a handler that catches exceptions thrown by the block's instructions.
+ */
+class ExceptionalEdge {
 public:
-    static std::unique_ptr<ControlFlowGraph> build(const CodeAttributeInfo &code);
+    CJBP_INLINE ExceptionalEdge(uint32_t handler, uint16_t catchType) : handler_(handler), catchType_(catchType) { }
+
+    /// @return The id of the handler's block.
+    CJBP_INLINE uint32_t handler() const { return this->handler_; }
+
+    /// @return The constant pool index of the caught class, or 0 if the handler catches every exception.
+    CJBP_INLINE uint16_t catchType() const { return this->catchType_; }
+    CJBP_INLINE bool isCatchAll() const { return this->catchType_ == 0; }
 
-    CJBP_INLINE ControlFlowGraph(std::map<uint32_t, BasicBlock> blocks) : blocks_(std::move(blocks)) { }
+private:
+    uint32_t handler_;
+    uint16_t catchType_;
+};
 
-    CJBP_INLINE const BasicBlock &block(uint32_t start) const { return this->blocks_.at(start); }
+/**
+ * ControlFlowGraph is the graph of the basic blocks of a method.
+ *
+ * Blocks are discovered from the bytecode alone: a block starts at the beginning of the code, at every jump target, after
+ * every instruction that transfers control, and at the start and end of every exception handler range and at every handler.
+ * The StackMapTable, when present, only annotates the blocks that its frames begin.
+ *
+ * Normal edges follow jumps and fall-throughs. Exceptional edges, kept apart from them, lead from every block inside a
+ * handler's range to the handler, since any instruction of the block may throw. Analyses that must see every path through
+ * the method follow both.
+ *
+ * The graph is stored flat: blocks are numbered in code order in a single array, and the successors and predecessors of
+ * every block are contiguous runs of block ids in two shared arrays (i.e. compressed sparse rows), so walking the graph
+ * touches a handful of arrays rather than a node per block.
+ */
+class ControlFlowGraph {
+public:
+    /**
+     * @throws CorruptClassFile If the code or its exception table is malformed, if a StackMapTable frame is not at the start
+     *     of an instruction, or if execution can fall off the end of the code.
+     */
+    static std::unique_ptr<ControlFlowGraph> build(CodeAttributeInfo &code);
+
+    ControlFlowGraph(std::vector<BasicBlock> blocks, std::vector<uint32_t> successorOffsets, std::vector<uint32_t> successors,
+                     std::vector<uint32_t> exceptionalOffsets, std::vector<ExceptionalEdge> exceptionalSuccessors,
+                     Span<AbsoluteStackMapFrame> stackMaps, std::vector<JumpTable> jumpTables);
+
+    /// @return The number of blocks.
+    CJBP_INLINE uint32_t size() const { return this->blocks_.size(); }
+
+    CJBP_INLINE const BasicBlock &block(uint32_t id) const { return this->blocks_[id]; }
+
+    /// @return Every block of the method, in code order. The entry block, if any, is the first.
+    CJBP_INLINE Span<BasicBlock> blocks() const { return { this->blocks_.data(), static_cast<uint32_t>(this->blocks_.size()) }; }
+
+    /// @return The ids of the blocks that control may flow to from the given block, without duplicates.
+    CJBP_INLINE Span<uint32_t> successors(uint32_t id) const {
+        return { this->successors_.data() + this->successorOffsets_[id], this->successorOffsets_[id + 1] - this->successorOffsets_[id] };
+    }
+
+    /// @return The ids of the blocks that control may flow from to the given block, without duplicates, in ascending order.
+    CJBP_INLINE Span<uint32_t> predecessors(uint32_t id) const {
+        return { this->predecessors_.data() + this->predecessorOffsets_[id], this->predecessorOffsets_[id + 1] - this->predecessorOffsets_[id] };
+    }
+
+    /**
+     * @return The handlers that may catch an exception thrown in the given block, in the order the JVM tries them. Entries
+     *     that an earlier catch-all handler shadows are left out.
+     */
+    CJBP_INLINE Span<ExceptionalEdge> exceptionalSuccessors(uint32_t id) const {
+        return { this->exceptionalSuccessors_.data() + this->exceptionalOffsets_[id], this->exceptionalOffsets_[id + 1] - this->exceptionalOffsets_[id] };
+    }
+
+    /// @return The ids of the blocks whose exceptions the given handler block may catch, without duplicates, in ascending
+    ///     order. Empty if the block is not a handler.
+    CJBP_INLINE Span<uint32_t> exceptionalPredecessors(uint32_t id) const {
+        return { this->exceptionalPredecessors_.data() + this->exceptionalPredecessorOffsets_[id],
+                 this->exceptionalPredecessorOffsets_[id + 1] - this->exceptionalPredecessorOffsets_[id] };
+    }
+
+    /**
+     * Calls `f(successor)` for every normal and exceptional successor of the given block. A handler reached through several
+     * catch types is visited once per catch type.
+     */
+    template<typename F>
+    CJBP_INLINE void forEachSuccessor(uint32_t id, F &&f) const {
+        for (uint32_t successor : this->successors(id)) f(successor);
+        for (const ExceptionalEdge &edge : this->exceptionalSuccessors(id)) f(edge.handler());
+    }
+
+    /// Calls `f(predecessor)` for every normal and exceptional predecessor of the given block.
+    template<typename F>
+    CJBP_INLINE void forEachPredecessor(uint32_t id, F &&f) const {
+        for (uint32_t predecessor : this->predecessors(id)) f(predecessor);
+        for (uint32_t predecessor : this->exceptionalPredecessors(id)) f(predecessor);
+    }
+
+    /**
+     * @return The StackMapTable frame at the start of the given block, or nullptr if the StackMapTable has none there. It
+     *     is owned by the StackMapTable, so it must not outlive the code that the graph was built from.
+     */
+    CJBP_INLINE const AbsoluteStackMapFrame *stackMap(uint32_t id) const {
+        uint32_t index = this->blocks_[id].stackMap_;
+        return index == BasicBlock::None ? nullptr : &this->stackMaps_[index];
+    }
+
+    /**
+     * @return The jump table of the switch that ends the given block, or nullptr if the block does not end with a switch.
+     *     Its cases refer to the block's successors() by position.
+     */
+    CJBP_INLINE const JumpTable *jumpTable(uint32_t id) const {
+        uint32_t index = this->blocks_[id].jumpTable_;
+        return index == BasicBlock::None ? nullptr : &this->jumpTables_[index];
+    }
+
+    /// @return The id of the block that contains the instruction at the given code index, or BasicBlock::None if the index is
+    ///     outside of the code.
+    uint32_t blockAt(uint32_t index) const;
 
     std::string toString(const CodeAttributeInfo &code) const;
 
 private:
-    std::map<uint32_t, BasicBlock> blocks_;
+    std::vector<BasicBlock> blocks_;
+    std::vector<uint32_t> successorOffsets_;   // successors(id) is [successorOffsets_[id], successorOffsets_[id + 1])
+    std::vector<uint32_t> successors_;
+    std::vector<uint32_t> predecessorOffsets_; // Likewise, derived from the successors
+    std::vector<uint32_t> predecessors_;
+    std::vector<uint32_t> exceptionalOffsets_;
+    std::vector<ExceptionalEdge> exceptionalSuccessors_;
+    std::vector<uint32_t> exceptionalPredecessorOffsets_;
+    std::vector<uint32_t> exceptionalPredecessors_;
+    Span<AbsoluteStackMapFrame> stackMaps_;    // StackMapTableAttributeInfo::frames() of the code
+    std::vector<JumpTable> jumpTables_;
 };
 
 } // namespace cjbp
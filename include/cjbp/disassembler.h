@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "inline.h"
+
+namespace cjbp {
+
+class ClassFile;
+class CodeAttributeInfo;
+class ConstantPool;
+class ControlFlowGraph;
+class Descriptor;
+class FieldInfo;
+class Instruction;
+class MethodDescriptor;
+class MethodInfo;
+
+/**
+ * Disassembler writes javap-style listings of classes, methods and code, with constant pool operands resolved inline.
+ *
+ * Output is appended to a single buffer as it is produced, rather than built from nested temporary strings, so dumping a
+ * whole jar costs one growing buffer instead of a string per line and per indentation level. The buffer is either
+ * supplied by the caller, who may clear and reuse it between classes, or owned by the disassembler and flushed to a FILE*
+ * whenever it grows past FlushThreshold.
+ */
+class Disassembler {
+public:
+    static constexpr size_t FlushThreshold = 64 * 1024;
+
+    /// Creates a disassembler that appends to the given buffer.
+    explicit Disassembler(std::string &buffer);
+
+    /// Creates a disassembler that writes to the given file. Output is buffered until flush() or destruction.
+    explicit Disassembler(FILE *file);
+
+    ~Disassembler();
+
+    Disassembler(const Disassembler &) = delete;
+    Disassembler &operator=(const Disassembler &) = delete;
+
+    void writeClass(const ClassFile &classFile);
+    void writeField(const FieldInfo &field);
+    void writeMethod(const MethodInfo &method);
+    void writeCode(const CodeAttributeInfo &code, const ConstantPool &constantPool);
+    void writeInstruction(const Instruction &instruction, const ConstantPool &constantPool);
+    void writeControlFlowGraph(const ControlFlowGraph &cfg, const CodeAttributeInfo &code, const ConstantPool &constantPool);
+
+    /// Writes any buffered output to the file. Does nothing when writing to a caller-supplied buffer.
+    void flush();
+
+private:
+    class Scope; // Restores the depth, and ends the line, when writing throws
+
+    std::string ownBuffer_;
+    std::string &out_;
+    FILE *file_; // May be nullptr
+    uint32_t depth_;
+
+    CJBP_INLINE void write(char c) { this->out_ += c; }
+    CJBP_INLINE void write(const char *str) { this->out_ += str; }
+    CJBP_INLINE void write(const std::string &str) { this->out_ += str; }
+    void writeNumber(int64_t value, size_t width = 0); // Right-aligned to width
+    void writeHex(uint32_t value, uint32_t digits);
+    void writeFloat(float value);
+    void writeDouble(double value);
+    void writePadding(size_t lineStart, size_t column);
+    void writeType(const Descriptor &descriptor);
+    void writeMethodSignature(const std::string &name, const MethodDescriptor &descriptor);
+    void writePoolComment(uint8_t opcode, uint16_t index, const ConstantPool &constantPool);
+    void beginLine();
+    void endLine();
+};
+
+} // namespace cjbp
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "control_flow_graph.h"
+#include "inline.h"
+#include "span.h"
+
+namespace cjbp {
+
+/**
+ * DominatorTree holds the dominance relation of the blocks of a ControlFlowGraph, along with the reverse postorder it was
+ * computed in and the dominance frontier of every block.
+ *
+ * Both normal and exceptional edges are followed, so handlers are dominated by the blocks that guard them. Blocks that are
+ * unreachable from the entry block have no dominator and are left out of the reverse postorder.
+ *
+ * Immediate dominators are computed with the iterative algorithm of Cooper, Harvey and Kennedy, which is fast in practice
+ * on the small, mostly reducible graphs that javac produces.
+ */
+class DominatorTree {
+public:
+    static std::unique_ptr<DominatorTree> build(const ControlFlowGraph &cfg);
+
+    DominatorTree(std::vector<uint32_t> reversePostorder, std::vector<uint32_t> rpoNumbers, std::vector<uint32_t> idoms,
+                  std::vector<uint32_t> frontierOffsets, std::vector<uint32_t> frontiers);
+
+    /// @return The reachable blocks in reverse postorder, i.e. every block comes before its normal and exceptional
+    ///     successors, except along retreating edges.
+    CJBP_INLINE Span<uint32_t> reversePostorder() const {
+        return { this->reversePostorder_.data(), static_cast<uint32_t>(this->reversePostorder_.size()) };
+    }
+
+    /// @return The position of the block in reversePostorder(), or BasicBlock::None if it is unreachable.
+    CJBP_INLINE uint32_t rpoNumber(uint32_t id) const { return this->rpoNumbers_[id]; }
+    CJBP_INLINE bool isReachable(uint32_t id) const { return this->rpoNumbers_[id] != BasicBlock::None; }
+
+    /// @return The immediate dominator of the block, or BasicBlock::None if it is the entry block or unreachable.
+    CJBP_INLINE uint32_t idom(uint32_t id) const { return this->idoms_[id]; }
+
+    /// @return The blocks immediately dominated by the block, in reverse postorder.
+    CJBP_INLINE Span<uint32_t> children(uint32_t id) const {
+        return { this->children_.data() + this->childOffsets_[id], this->childOffsets_[id + 1] - this->childOffsets_[id] };
+    }
+
+    /// @return The dominance frontier of the block: the blocks where its dominance ends, in ascending order.
+    CJBP_INLINE Span<uint32_t> frontier(uint32_t id) const {
+        return { this->frontiers_.data() + this->frontierOffsets_[id], this->frontierOffsets_[id + 1] - this->frontierOffsets_[id] };
+    }
+
+    /// @return true if every path from the entry block to b goes through a. Every reachable block dominates itself.
+    CJBP_INLINE bool dominates(uint32_t a, uint32_t b) const {
+        if (!this->isReachable(a) || !this->isReachable(b)) return false;
+        return this->preorder_[a] <= this->preorder_[b] && this->preorder_[b] < this->preorder_[a] + this->subtreeSizes_[a];
+    }
+
+    CJBP_INLINE bool strictlyDominates(uint32_t a, uint32_t b) const { return a != b && this->dominates(a, b); }
+
+private:
+    std::vector<uint32_t> reversePostorder_;
+    std::vector<uint32_t> rpoNumbers_; // Indexed by block id
+    std::vector<uint32_t> idoms_;      // Indexed by block id
+    std::vector<uint32_t> childOffsets_;
+    std::vector<uint32_t> children_;
+    std::vector<uint32_t> preorder_;     // Position of each block in a preorder walk of the tree, for dominates()
+    std::vector<uint32_t> subtreeSizes_; // Number of blocks in the subtree of each block, itself included
+    std::vector<uint32_t> frontierOffsets_;
+    std::vector<uint32_t> frontiers_;
+};
+
+/**
+ * Loop is a natural loop: a header block that dominates the tails of one or more back edges leading to it, along with every
+ * block that can reach a tail without going through the header. Exceptional edges count, so a handler that resumes the loop
+ * is part of it.
+ */
+class Loop {
+public:
+    static constexpr uint32_t None = UINT32_MAX;
+
+    CJBP_INLINE Loop(uint32_t header, uint32_t parent, uint32_t depth) : header_(header), parent_(parent), depth_(depth) { }
+
+    CJBP_INLINE uint32_t header() const { return this->header_; }
+
+    /// @return The index of the innermost loop that contains this one, or Loop::None if it is outermost.
+    CJBP_INLINE uint32_t parent() const { return this->parent_; }
+
+    /// @return The nesting depth of the loop. Outermost loops have depth 1.
+    CJBP_INLINE uint32_t depth() const { return this->depth_; }
+
+private:
+    uint32_t header_;
+    uint32_t parent_;
+    uint32_t depth_;
+};
+
+/**
+ * LoopNest is the loop nesting forest of a method: its natural loops, how they nest, and the innermost loop of every block.
+ *
+ * Back edges that share a header are merged into a single loop. Loops are ordered by the reverse postorder of their
+ * headers, so an outer loop always comes before the loops it contains. Cycles that are not entered through a dominating
+ * header (i.e. irreducible control flow, which javac never emits) form no loop, and are reported by isReducible().
+ */
+class LoopNest {
+public:
+    static std::unique_ptr<LoopNest> build(const ControlFlowGraph &cfg, const DominatorTree &dominators);
+
+    LoopNest(std::vector<Loop> loops, std::vector<uint32_t> bodyOffsets, std::vector<uint32_t> bodies, std::vector<uint32_t> backEdgeOffsets,
+             std::vector<uint32_t> backEdges, std::vector<uint32_t> loopOfBlock, bool reducible);
+
+    /// @return The number of loops.
+    CJBP_INLINE uint32_t size() const { return this->loops_.size(); }
+    CJBP_INLINE const Loop &loop(uint32_t index) const { return this->loops_[index]; }
+    CJBP_INLINE Span<Loop> loops() const { return { this->loops_.data(), static_cast<uint32_t>(this->loops_.size()) }; }
+
+    /// @return The blocks of the loop, including those of nested loops, in ascending order.
+    CJBP_INLINE Span<uint32_t> blocks(uint32_t index) const {
+        return { this->bodies_.data() + this->bodyOffsets_[index], this->bodyOffsets_[index + 1] - this->bodyOffsets_[index] };
+    }
+
+    /// @return The tails of the back edges of the loop, i.e. the blocks that jump back to its header, in ascending order.
+    CJBP_INLINE Span<uint32_t> backEdges(uint32_t index) const {
+        return { this->backEdges_.data() + this->backEdgeOffsets_[index], this->backEdgeOffsets_[index + 1] - this->backEdgeOffsets_[index] };
+    }
+
+    /// @return The index of the innermost loop that contains the block, or Loop::None if it is in no loop.
+    CJBP_INLINE uint32_t loopOf(uint32_t id) const { return this->loopOfBlock_[id]; }
+
+    /// @return The loop nesting depth of the block, 0 if it is in no loop.
+    CJBP_INLINE uint32_t depth(uint32_t id) const {
+        uint32_t loop = this->loopOfBlock_[id];
+        return loop == Loop::None ? 0 : this->loops_[loop].depth();
+    }
+
+    /// @return true if the block is the header of a loop.
+    CJBP_INLINE bool isHeader(uint32_t id) const {
+        uint32_t loop = this->loopOfBlock_[id];
+        return loop != Loop::None && this->loops_[loop].header() == id;
+    }
+
+    /// @return false if the method has a cycle with more than one entry, which no natural loop describes.
+    CJBP_INLINE bool isReducible() const { return this->reducible_; }
+
+private:
+    std::vector<Loop> loops_;
+    std::vector<uint32_t> bodyOffsets_;
+    std::vector<uint32_t> bodies_;
+    std::vector<uint32_t> backEdgeOffsets_;
+    std::vector<uint32_t> backEdges_;
+    std::vector<uint32_t> loopOfBlock_; // Indexed by block id
+    bool reducible_;
+};
+
+} // namespace cjbp
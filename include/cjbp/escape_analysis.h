@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "inline.h"
+#include "span.h"
+
+namespace cjbp {
+
+class TypeInference;
+
+/**
+ * AllocationSite is an instruction that allocates an object (new) or an array (newarray, anewarray, multianewarray), and
+ * how far the objects it allocates may escape the method.
+ */
+class AllocationSite {
+public:
+    /// How far an object escapes, from least to most.
+    enum class Escape : uint8_t {
+        None = 0, // Only reachable from the method's own locals and stack: may be scalar replaced or allocated on the stack
+        Argument, // Also passed to a callee, but not stored in the heap, returned or thrown by this method
+        Global,   // Stored in a field or array, returned, thrown, or passed to invokedynamic
+    };
+
+    CJBP_INLINE AllocationSite(uint32_t index, uint8_t opcode, Escape escape) : index_(index), opcode_(opcode), escape_(escape) { }
+
+    /// @return The code index of the allocating instruction.
+    CJBP_INLINE uint32_t index() const { return this->index_; }
+    CJBP_INLINE uint8_t opcode() const { return this->opcode_; }
+    CJBP_INLINE Escape escape() const { return this->escape_; }
+
+private:
+    uint32_t index_;
+    uint8_t opcode_;
+    Escape escape_;
+};
+
+/**
+ * EscapeAnalysis classifies the allocation sites of a method by how far the objects they allocate may escape it. It works
+ * on the RegisterCode of the method, so values flow through registers rather than the operand stack.
+ *
+ * Values are tracked by unification, as in Steensgaard's points-to analysis: wherever values may meet (the registers that
+ * hold a reference on entry to a block, for every path into the block), they are merged into one class, which escapes as
+ * far as any of its members. This takes one pass over the blocks, with no iteration to a fixed point, at the price of
+ * precision where one register holds objects of several sites. Local variables that are dead on entry to a block are not
+ * merged, so that slots that javac reuses for unrelated variables do not tie their objects together.
+ *
+ * Storing a reference into a field (putfield, putstatic) or an array element (aastore), returning it and throwing it
+ * escape globally. Passing it to a method escapes as decided by a CallPolicy; without one, every argument escapes as
+ * Argument, except the receiver of java.lang.Object.<init>, which does nothing. Since the callee may return any of its
+ * arguments, a reference returned by a call is tied to them: if it escapes globally, so do they. References loaded from
+ * fields and arrays are not tracked, as only references that escaped globally can be stored there.
+ *
+ * Results are not cached by CodeAttributeInfo, since they depend on the class and method that the code belongs to.
+ */
+class EscapeAnalysis {
+public:
+    using Escape = AllocationSite::Escape;
+
+    /**
+     * Decides how far an argument of a call escapes, e.g. from an analysis of the callee or knowledge of the library. The
+     * receiver of an instance method is argument 0. The call is named by the class, name and raw descriptor of the method
+     * that its reference names.
+     */
+    using CallPolicy = std::function<Escape(const std::string &owner, const std::string &name, const std::string &type, uint32_t argument)>;
+
+    /**
+     * Analyzes the method whose types are given, translating it to RegisterCode.
+     *
+     * @param policy How far the arguments of calls escape, or nullptr for the default described above.
+     * @throws CorruptClassFile If the code is malformed, or does not type check far enough to be translated.
+     */
+    static std::unique_ptr<EscapeAnalysis> build(TypeInference &types, const CallPolicy &policy = nullptr);
+
+    explicit EscapeAnalysis(std::vector<AllocationSite> sites);
+
+    /// @return The reachable allocation sites of the method, in code order.
+    CJBP_INLINE Span<AllocationSite> sites() const { return { this->sites_.data(), static_cast<uint32_t>(this->sites_.size()) }; }
+
+    /// @return The allocation site at a code index, or nullptr if no reachable allocating instruction starts there.
+    const AllocationSite *siteAt(uint32_t index) const;
+
+    std::string toString() const;
+
+private:
+    std::vector<AllocationSite> sites_; // Sorted by index
+};
+
+} // namespace cjbp
@@ -15,4 +15,17 @@ private:
     std::string message_;
 };
 
+/**
+ * VerifyError is thrown by the Verifier when code is not type safe, including when it is too malformed to tell.
+ */
+class VerifyError : public std::exception {
+public:
+    explicit VerifyError(std::string message) : message_(std::move(message)) { }
+
+    const char *what() const noexcept override { return this->message_.c_str(); }
+
+private:
+    std::string message_;
+};
+
 } // namespace cjbp
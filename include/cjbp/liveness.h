@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bit_set.h"
+#include "inline.h"
+
+namespace cjbp {
+
+class CodeAttributeInfo;
+
+/**
+ * Liveness holds the local variable slots of a method that are live, i.e. may still be read before being overwritten, at
+ * the boundaries of every basic block and around every instruction.
+ *
+ * Sets are BitSets of maxLocals() bits. A long or double occupies both of its slots. Exceptional edges are honored
+ * conservatively: whatever a handler reads is live throughout every block that it guards. A ret is taken to return to
+ * every jsr of the method, since the CFG does not tell which.
+ */
+class Liveness {
+public:
+    /**
+     * Computes liveness by iterating to a fixed point over the blocks of the method's ControlFlowGraph. Pending blocks are
+     * picked in postorder (i.e. reverse postorder of the reversed graph), so that most blocks are final after one visit.
+     *
+     * @throws CorruptClassFile If the code is malformed or accesses a local variable past maxLocals.
+     */
+    static std::unique_ptr<Liveness> build(CodeAttributeInfo &code);
+
+    Liveness(uint32_t maxLocals, std::vector<BitSet> liveIn, std::vector<BitSet> liveOut, std::vector<uint32_t> instructionIndices,
+             std::vector<uint32_t> instructionBlocks, std::vector<BitSet::Word> instructionLiveIn);
+
+    /// @return The number of local variable slots, i.e. the size of every set.
+    CJBP_INLINE uint32_t maxLocals() const { return this->maxLocals_; }
+
+    /// @return The slots live on entry to the given block.
+    CJBP_INLINE const BitSet &liveIn(uint32_t block) const { return this->liveIn_[block]; }
+
+    /// @return The slots live on exit from the given block, along any of its normal or exceptional edges.
+    CJBP_INLINE const BitSet &liveOut(uint32_t block) const { return this->liveOut_[block]; }
+
+    /**
+     * @return true if the slot is live just before the instruction at the given index executes.
+     * @throws std::out_of_range If no instruction starts at the index.
+     */
+    bool isLiveBefore(uint32_t index, uint16_t local) const;
+
+    /**
+     * @return The slots live just before the instruction at the given index executes.
+     * @throws std::out_of_range If no instruction starts at the index.
+     */
+    BitSet liveBefore(uint32_t index) const;
+
+    /**
+     * @return The slots live just after the instruction at the given index executes.
+     * @throws std::out_of_range If no instruction starts at the index.
+     */
+    BitSet liveAfter(uint32_t index) const;
+
+private:
+    uint32_t maxLocals_;
+    uint32_t stride_; // Words per set in instructionLiveIn_
+    std::vector<BitSet> liveIn_;                 // Indexed by block id
+    std::vector<BitSet> liveOut_;                // Indexed by block id
+    std::vector<uint32_t> instructionIndices_;   // Code index of every instruction, ascending
+    std::vector<uint32_t> instructionBlocks_;    // Block of every instruction
+    std::vector<BitSet::Word> instructionLiveIn_; // stride_ words per instruction
+
+    uint32_t ordinal(uint32_t index) const;
+};
+
+} // namespace cjbp
@@ -22,8 +22,11 @@ class MethodInfo {
 public:
     /**
      * Reads a MethodInfo from the given input stream. Intended for internal use only.
+     *
+     * @param thisClass The constant pool index of the class that declares the method, for the implicit initial frame of its
+     *     StackMapTable.
      */
-    static std::unique_ptr<MethodInfo> read(std::istream &s, const ConstantPool &constantPool);
+    static std::unique_ptr<MethodInfo> read(std::istream &s, const ConstantPool &constantPool, uint16_t thisClass);
 
     /**
      * Constructs a MethodInfo object. Intended for internal use only.
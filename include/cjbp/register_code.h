@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "code_iterator.h"
+#include "inline.h"
+#include "span.h"
+
+namespace cjbp {
+
+class TypeInference;
+
+/**
+ * RegisterInstruction is one instruction of a RegisterCode: a bytecode instruction whose operand stack accesses have been
+ * replaced by virtual registers, or a Move between two registers.
+ */
+class RegisterInstruction {
+public:
+    static constexpr uint32_t NoRegister = UINT32_MAX;
+
+    CJBP_INLINE RegisterInstruction(const Instruction &instruction, uint8_t opcode, uint32_t destination, uint32_t firstSource, uint8_t sourceCount) :
+        instruction_(instruction), destination_(destination), firstSource_(firstSource), opcode_(opcode), sourceCount_(sourceCount) { }
+
+    /**
+     * @return The bytecode instruction that this instruction was translated from, for its operands (constant pool index,
+     *     immediate, branch targets...). Moves refer to the instruction at which they were emitted.
+     */
+    CJBP_INLINE const Instruction &instruction() const { return this->instruction_; }
+
+    /// @return The opcode of instruction() (the modified opcode for wide instructions), or RegisterCode::Move.
+    CJBP_INLINE uint8_t opcode() const { return this->opcode_; }
+    CJBP_INLINE bool isMove() const;
+
+    /// @return The register that the result is written to, or NoRegister if the instruction has no result.
+    CJBP_INLINE uint32_t destination() const { return this->destination_; }
+    CJBP_INLINE bool hasDestination() const { return this->destination_ != NoRegister; }
+
+    /// @return The position of the first source register in RegisterCode::sources().
+    CJBP_INLINE uint32_t firstSource() const { return this->firstSource_; }
+
+    /// @return The number of source registers, one per value (not slot) that the bytecode instruction pops.
+    CJBP_INLINE uint8_t sourceCount() const { return this->sourceCount_; }
+
+private:
+    Instruction instruction_;
+    uint32_t destination_;
+    uint32_t firstSource_;
+    uint8_t opcode_;
+    uint8_t sourceCount_;
+};
+
+/**
+ * RegisterCode is a register-based translation of the code of a method, for interpreters and compilers that would rather
+ * not model the operand stack.
+ *
+ * Registers are numbered like the slots of a TypeFrame: local variable n lives in register n, and the operand stack slot
+ * at depth d in register maxLocals + d (see stackRegister()). A register holds a whole value, so a long or double lives in
+ * the register of its first slot, and the register of its second slot is unused. On entry to every block, the stack is in
+ * its registers: the register types there are the types given by TypeInference::entry() for the block, which, for a method
+ * with a StackMapTable, are the types of its frame. In particular, an exception handler finds the exception in
+ * stackRegister(0).
+ *
+ * Within a block, values are not copied around needlessly: loads, dup, dup2, pop and pop2 emit nothing, their consumers
+ * reading the local variable or stack register directly, and a store usually retargets the instruction that computed its
+ * value. What must still be copied, e.g. a loaded value that is still on the stack at the end of the block, is copied by a
+ * Move. Every block is translated on its own, so the instructions of a block are those from blockStart() up to the
+ * blockStart() of the next block, and blocks keep the ids of the ControlFlowGraph. Unreachable blocks are empty.
+ */
+class RegisterCode {
+public:
+    /// The pseudo-opcode of a copy of the source register to the destination register, taken from the opcodes that the
+    /// Java Virtual Machine Specification leaves undefined.
+    static constexpr uint8_t Move = 0xcb;
+
+    /**
+     * Translates the code of a method, using the types inferred for it to tell which stack slots hold longs and doubles.
+     *
+     * @throws CorruptClassFile If the code is malformed, or does not type check far enough to be translated.
+     */
+    static std::unique_ptr<RegisterCode> build(TypeInference &types);
+
+    RegisterCode(uint32_t maxLocals, uint32_t maxStack, std::vector<RegisterInstruction> instructions, std::vector<uint32_t> blockOffsets,
+                 std::vector<uint32_t> sources);
+
+    /// @return The number of registers, which includes a scratch register after the stack registers.
+    CJBP_INLINE uint32_t registerCount() const { return this->maxLocals_ + this->maxStack_ + 1; }
+    CJBP_INLINE uint32_t localRegister(uint16_t local) const { return local; }
+    CJBP_INLINE uint32_t stackRegister(uint32_t depth) const { return this->maxLocals_ + depth; }
+
+    /// @return The register used to break cycles of moves, e.g. to translate swap. It is never live across blocks.
+    CJBP_INLINE uint32_t scratchRegister() const { return this->maxLocals_ + this->maxStack_; }
+
+    CJBP_INLINE uint32_t size() const { return this->instructions_.size(); }
+    CJBP_INLINE const std::vector<RegisterInstruction> &instructions() const { return this->instructions_; }
+
+    /// @return The position in instructions() of the first instruction of the given block.
+    CJBP_INLINE uint32_t blockStart(uint32_t block) const { return this->blockOffsets_[block]; }
+
+    CJBP_INLINE Span<RegisterInstruction> blockInstructions(uint32_t block) const {
+        return { this->instructions_.data() + this->blockOffsets_[block], this->blockOffsets_[block + 1] - this->blockOffsets_[block] };
+    }
+
+    /// @return The source registers of an instruction, in the order the bytecode instruction pushed their values.
+    CJBP_INLINE Span<uint32_t> sources(const RegisterInstruction &instruction) const {
+        return { this->sources_.data() + instruction.firstSource(), instruction.sourceCount() };
+    }
+
+    std::string toString() const;
+
+private:
+    uint32_t maxLocals_;
+    uint32_t maxStack_;
+    std::vector<RegisterInstruction> instructions_;
+    std::vector<uint32_t> blockOffsets_; // Position of the first instruction of every block, then size()
+    std::vector<uint32_t> sources_;
+};
+
+CJBP_INLINE bool RegisterInstruction::isMove() const { return this->opcode_ == RegisterCode::Move; }
+
+} // namespace cjbp
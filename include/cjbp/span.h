@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+#include "inline.h"
+
+namespace cjbp {
+
+/**
+ * Span is a read-only view of a contiguous run of elements owned by someone else, in place of C++20's std::span.
+ */
+template<typename T>
+class Span {
+public:
+    CJBP_INLINE Span() : data_(nullptr), size_(0) { }
+    CJBP_INLINE Span(const T *data, uint32_t size) : data_(data), size_(size) { }
+
+    CJBP_INLINE const T *data() const { return this->data_; }
+    CJBP_INLINE uint32_t size() const { return this->size_; }
+    CJBP_INLINE bool empty() const { return this->size_ == 0; }
+
+    CJBP_INLINE const T &operator[](uint32_t i) const {
+        assert(i < this->size_);
+        return this->data_[i];
+    }
+
+    CJBP_INLINE const T *begin() const { return this->data_; }
+    CJBP_INLINE const T *end() const { return this->data_ + this->size_; }
+
+private:
+    const T *data_;
+    uint32_t size_;
+};
+
+} // namespace cjbp
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bit_set.h"
+#include "code_iterator.h"
+#include "inline.h"
+
+namespace cjbp {
+
+class CodeAttributeInfo;
+
+/**
+ * SuperinstructionSet is a configurable list of short opcode sequences that may be fused into a single synthetic
+ * superinstruction, such as `aload_0; getfield`, `iload; iload; iadd` or `iinc; goto`.
+ *
+ * Each element of a pattern is a set of opcodes, so one pattern can cover every form of e.g. iload. Patterns are tried in
+ * the order they were added and the first match wins, so longer patterns should be added before their prefixes.
+ */
+class SuperinstructionSet {
+public:
+    static constexpr uint32_t MaxLength = 4;
+
+    struct Pattern {
+        std::string name;
+        std::vector<BitSet> elements; // One set of 256 opcodes per fused instruction
+    };
+
+    SuperinstructionSet();
+
+    /**
+     * Adds the fusions that are most common in javac output: `iload; iload; <int op>`, `iload; iload; if_icmp<cond>`,
+     * `aload_0; getfield`, `aload; getfield`, `iload; if<cond>`, `aload; arraylength`, `iinc; goto` and `new; dup`.
+     */
+    void addDefaults();
+
+    /**
+     * Adds a pattern to the set.
+     *
+     * @param elements The opcodes accepted at each position of the sequence. For wide instructions, the modified opcode is
+     *     matched.
+     * @return The id of the new pattern.
+     * @throws std::invalid_argument If the pattern has fewer than 2 or more than MaxLength elements, or if an element is empty.
+     */
+    uint16_t add(std::string name, const std::vector<std::vector<uint8_t>> &elements);
+
+    CJBP_INLINE uint32_t size() const { return this->patterns_.size(); }
+    CJBP_INLINE const Pattern &pattern(uint16_t id) const { return this->patterns_[id]; }
+    CJBP_INLINE const std::vector<Pattern> &patterns() const { return this->patterns_; }
+
+    /// @return The ids of the patterns whose first element accepts the given opcode, in the order they were added.
+    CJBP_INLINE const std::vector<uint16_t> &candidates(uint8_t opcode) const { return this->candidates_[opcode]; }
+
+private:
+    std::vector<Pattern> patterns_;
+    std::vector<std::vector<uint16_t>> candidates_; // Indexed by opcode
+};
+
+/**
+ * FusedInstruction is one dispatch in a FusedInstructionStream: either a single original instruction, or a superinstruction
+ * made of several consecutive ones.
+ */
+class FusedInstruction {
+public:
+    static constexpr uint16_t NoPattern = 0xFFFF;
+
+    CJBP_INLINE FusedInstruction(uint32_t index, uint32_t length, uint32_t first, uint16_t pattern, uint8_t count) :
+        index_(index), length_(length), first_(first), pattern_(pattern), count_(count) { }
+
+    /// @return The index in the code array of the first fused instruction.
+    CJBP_INLINE uint32_t index() const { return this->index_; }
+
+    /// @return The combined length in bytes of the fused instructions.
+    CJBP_INLINE uint32_t length() const { return this->length_; }
+    CJBP_INLINE uint32_t nextIndex() const { return this->index_ + this->length_; }
+
+    /// @return The id of the matched SuperinstructionSet pattern, or NoPattern for a single unfused instruction.
+    CJBP_INLINE uint16_t pattern() const { return this->pattern_; }
+    CJBP_INLINE bool isFused() const { return this->pattern_ != NoPattern; }
+
+    /// @return The position of the first fused instruction in FusedInstructionStream::instructions().
+    CJBP_INLINE uint32_t first() const { return this->first_; }
+
+    /// @return The number of original instructions covered.
+    CJBP_INLINE uint32_t count() const { return this->count_; }
+
+private:
+    uint32_t index_;
+    uint32_t length_;
+    uint32_t first_;
+    uint16_t pattern_;
+    uint8_t count_;
+};
+
+/**
+ * FusedInstructionStream is the decoded code of a method in which every match of a SuperinstructionSet has been fused into
+ * a single FusedInstruction.
+ *
+ * The original decoded instructions are kept alongside, so the operands of every fused instruction remain available. They
+ * point into the method's code array, so the stream must not outlive the CodeAttributeInfo it was built from.
+ */
+class FusedInstructionStream {
+public:
+    /**
+     * Decodes and fuses the code of a method.
+     *
+     * A match never spans the start of a block of the method's ControlFlowGraph, so every block, and thus every jump target
+     * and exception handler, still begins with a dispatch of its own.
+     *
+     * @throws CorruptClassFile If the code is malformed.
+     */
+    static FusedInstructionStream build(CodeAttributeInfo &code, const SuperinstructionSet &set);
+
+    CJBP_INLINE FusedInstructionStream(std::vector<Instruction> instructions, std::vector<FusedInstruction> fused) :
+        instructions_(std::move(instructions)), fused_(std::move(fused)) { }
+
+    /// @return Every original instruction, in code order.
+    CJBP_INLINE const std::vector<Instruction> &instructions() const { return this->instructions_; }
+
+    /// @return The dispatches of the fused stream, in code order.
+    CJBP_INLINE const std::vector<FusedInstruction> &fused() const { return this->fused_; }
+
+    /// @return The original instruction at the given position within a fused instruction.
+    CJBP_INLINE const Instruction &instruction(const FusedInstruction &fused, uint32_t i) const { return this->instructions_[fused.first() + i]; }
+
+    std::string toString(const SuperinstructionSet &set) const;
+
+private:
+    std::vector<Instruction> instructions_;
+    std::vector<FusedInstruction> fused_;
+};
+
+} // namespace cjbp
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "code_attribute.h"
+#include "exception.h"
+#include "inline.h"
+#include "span.h"
+
+namespace cjbp {
+
+class ClassFile;
+class Descriptor;
+class MethodInfo;
+
+/**
+ * ValueType is the inferred type of one local variable or operand stack slot, packed into 32 bits: a tag, and a 24-bit
+ * datum that holds the class name index (see TypeInference::className()) of an object, or the code index of the `new` of an
+ * uninitialized object or of the instruction that a return address returns to.
+ *
+ * Unlike VerificationTypeInfo, a long or double takes two slots, the second of which is Top, on the operand stack as well as
+ * in the local variables. Slot n of the stack is thus the value at depth n.
+ */
+class ValueType {
+public:
+    enum class Tag : uint8_t { Top = 0, Integer, Float, Long, Double, Null, UninitializedThis, Object, Uninitialized, ReturnAddress };
+
+    static constexpr uint32_t MaxData = (1 << 24) - 1;
+
+    CJBP_INLINE ValueType() : bits_(0) { }
+    CJBP_INLINE /* implicit */ ValueType(Tag tag) : bits_(static_cast<uint32_t>(tag) << 24) { } // NOLINT(google-explicit-constructor)
+    CJBP_INLINE ValueType(Tag tag, uint32_t data) : bits_(static_cast<uint32_t>(tag) << 24 | data) {
+        assert(tag == Tag::Object || tag == Tag::Uninitialized || tag == Tag::ReturnAddress);
+        assert(data <= MaxData);
+    }
+
+    CJBP_INLINE Tag tag() const { return static_cast<Tag>(this->bits_ >> 24); }
+
+    // @formatter:off
+    CJBP_INLINE uint32_t nameIndex() const {
+        assert(this->tag() == Tag::Object);
+        return this->bits_ & MaxData;
+    }
+    CJBP_INLINE uint32_t offset() const {
+        assert(this->tag() == Tag::Uninitialized || this->tag() == Tag::ReturnAddress);
+        return this->bits_ & MaxData;
+    }
+    // @formatter:on
+
+    /// @return true for longs and doubles, which take two slots.
+    CJBP_INLINE bool isCategory2() const { return this->tag() == Tag::Long || this->tag() == Tag::Double; }
+    CJBP_INLINE bool isReference() const {
+        Tag tag = this->tag();
+        return tag == Tag::Null || tag == Tag::UninitializedThis || tag == Tag::Object || tag == Tag::Uninitialized;
+    }
+
+    CJBP_INLINE bool operator==(const ValueType &other) const { return this->bits_ == other.bits_; }
+    CJBP_INLINE bool operator!=(const ValueType &other) const { return this->bits_ != other.bits_; }
+
+private:
+    uint32_t bits_;
+};
+
+/**
+ * TypeFrame holds the types of the local variables and operand stack at one point in a method, one ValueType per slot. The
+ * stack is listed from the bottom up.
+ */
+class TypeFrame {
+public:
+    CJBP_INLINE TypeFrame(uint32_t maxLocals, uint32_t maxStack) : types_(maxLocals + maxStack), maxLocals_(maxLocals), depth_(0) { }
+
+    CJBP_INLINE uint32_t maxLocals() const { return this->maxLocals_; }
+    CJBP_INLINE uint32_t maxStack() const { return this->types_.size() - this->maxLocals_; }
+    CJBP_INLINE uint32_t depth() const { return this->depth_; }
+
+    CJBP_INLINE Span<ValueType> locals() const { return { this->types_.data(), this->maxLocals_ }; }
+    CJBP_INLINE Span<ValueType> stack() const { return { this->types_.data() + this->maxLocals_, this->depth_ }; }
+
+    CJBP_INLINE ValueType local(uint32_t index) const {
+        if (index >= this->maxLocals_) throw CorruptClassFile("TypeFrame::local: Local variable index out of range");
+        return this->types_[index];
+    }
+
+    /**
+     * Stores a value in a local variable. A long or double also takes the next slot, and a long or double whose second
+     * slot is overwritten is invalidated, as in the JVM.
+     *
+     * @throws CorruptClassFile If the value does not fit in the local variables.
+     */
+    CJBP_INLINE void setLocal(uint32_t index, ValueType type) {
+        uint32_t width = type.isCategory2() ? 2 : 1;
+        if (index + width > this->maxLocals_) throw CorruptClassFile("TypeFrame::setLocal: Local variable index out of range");
+        if (index > 0 && this->types_[index - 1].isCategory2()) this->types_[index - 1] = ValueType::Tag::Top;
+        this->types_[index] = type;
+        if (width == 2) this->types_[index + 1] = ValueType::Tag::Top;
+    }
+
+    /// @return The type of the i-th slot from the top of the stack, 0 being the top.
+    CJBP_INLINE ValueType peek(uint32_t i) const {
+        if (i >= this->depth_) throw CorruptClassFile("TypeFrame::peek: Operand stack underflow");
+        return this->types_[this->maxLocals_ + this->depth_ - 1 - i];
+    }
+
+    /// Pushes a single slot. See pushValue() for pushing a long or double.
+    CJBP_INLINE void push(ValueType type) {
+        if (this->maxLocals_ + this->depth_ >= this->types_.size()) throw CorruptClassFile("TypeFrame::push: Operand stack overflow");
+        this->types_[this->maxLocals_ + this->depth_++] = type;
+    }
+
+    /// Pushes a value, which takes two slots if it is a long or double.
+    CJBP_INLINE void pushValue(ValueType type) {
+        this->push(type);
+        if (type.isCategory2()) this->push(ValueType::Tag::Top);
+    }
+
+    /// Pops a single slot.
+    CJBP_INLINE ValueType pop() {
+        ValueType type = this->peek(0);
+        this->depth_--;
+        return type;
+    }
+
+    CJBP_INLINE void pop(uint32_t count) {
+        if (count > this->depth_) throw CorruptClassFile("TypeFrame::pop: Operand stack underflow");
+        this->depth_ -= count;
+    }
+
+    CJBP_INLINE void clearStack() { this->depth_ = 0; }
+
+    /// Replaces every occurrence of a type in the locals and on the stack, e.g. once an uninitialized object is initialized.
+    CJBP_INLINE void replace(ValueType from, ValueType to) {
+        for (uint32_t i = 0; i < this->maxLocals_ + this->depth_; i++) {
+            if (this->types_[i] == from) this->types_[i] = to;
+        }
+    }
+
+    CJBP_INLINE bool operator==(const TypeFrame &other) const {
+        return this->maxLocals_ == other.maxLocals_ && this->depth_ == other.depth_ &&
+               std::equal(this->types_.begin(), this->types_.begin() + this->maxLocals_ + this->depth_, other.types_.begin());
+    }
+    CJBP_INLINE bool operator!=(const TypeFrame &other) const { return !(*this == other); }
+
+private:
+    friend class TypeInference;
+
+    std::vector<ValueType> types_; // Locals, then the stack
+    uint32_t maxLocals_;
+    uint32_t depth_;
+};
+
+/**
+ * TypeInference gives the types of the local variables and operand stack at every instruction of a method, by abstract
+ * interpretation of its bytecode. Field and method result types come from the descriptors in the ConstantPool.
+ *
+ * Types are computed lazily, a block at a time. Only the state on entry to each block is stored, packed in one flat array of
+ * maxLocals + maxStack slots per block; the types at any instruction are found by replaying its block up to it.
+ *
+ * If the method has a StackMapTable, every block either begins with one of its frames or is only reached by falling through
+ * from the previous block, so requesting a block replays at most the run of blocks back to the previous frame. Otherwise
+ * (i.e. code compiled for Java 5 or earlier), the first request iterates the whole method to a fixed point. Types that
+ * meet at a merge point are then joined conservatively: two different classes join to java.lang.Object, as the class
+ * hierarchy is not known, and mismatched primitives join to Top. A ret is taken to return to every jsr of the method.
+ *
+ * The types are not checked: see a verifier for that. Results are not cached by CodeAttributeInfo, since they depend on the
+ * class and method that the code belongs to.
+ */
+class TypeInference {
+public:
+    /**
+     * Prepares type inference for a method of a class, decoding its StackMapTable if it has one.
+     *
+     * @throws std::invalid_argument If the method has no code.
+     * @throws CorruptClassFile If the code, the descriptor of the method or its StackMapTable is malformed.
+     */
+    static std::unique_ptr<TypeInference> build(const ClassFile &classFile, const MethodInfo &method);
+
+    CJBP_INLINE const ConstantPool &constantPool() const { return this->constantPool_; }
+    CJBP_INLINE CodeAttributeInfo &code() const { return this->code_; }
+
+    /// @return The name of the class of an object type (e.g. "java.lang.String", or "[Ljava.lang.String;" for arrays).
+    CJBP_INLINE const std::string &className(ValueType type) const { return this->names_[type.nameIndex()]; }
+
+    std::string toString(ValueType type) const;
+
+    /// @return The type of initialized objects of the class whose code this is, e.g. of `this` once constructed.
+    CJBP_INLINE ValueType thisType() const { return this->this_; }
+
+    /// @return The type of objects of the named class, whose name is added to those that className() knows if needed.
+    ValueType object(const std::string &className);
+
+    /// @return The type of the values of a field or parameter descriptor.
+    ValueType value(const Descriptor &descriptor);
+
+    /**
+     * @return The type of the value that an ldc, ldc_w or ldc2_w of the given constant pushes.
+     * @throws CorruptClassFile If the constant cannot be loaded.
+     */
+    ValueType constant(uint16_t index);
+
+    /**
+     * @return The types on entry to the block, or std::nullopt if the block is unreachable.
+     * @throws CorruptClassFile If the code does not type check far enough to tell.
+     */
+    std::optional<TypeFrame> entry(uint32_t block);
+
+    /**
+     * @return The types just before the instruction at the given index executes, or std::nullopt if it is unreachable.
+     * @throws std::out_of_range If no instruction starts at the index.
+     * @throws CorruptClassFile If the code does not type check far enough to tell.
+     */
+    std::optional<TypeFrame> frameAt(uint32_t index);
+
+    /**
+     * Applies an instruction to a frame, giving the types after it completes normally. To visit the types at every
+     * instruction of a block (e.g. at every safepoint or call site), start from entry() and execute each instruction in turn.
+     *
+     * @throws CorruptClassFile If the instruction over- or underflows the stack, or refers to a malformed constant.
+     */
+    void execute(const Instruction &instruction, TypeFrame &frame);
+
+private:
+    enum class State : uint8_t { Pending, Ready, Unreachable };
+
+    const ConstantPool &constantPool_;
+    CodeAttributeInfo &code_;
+    const ControlFlowGraph &cfg_;
+    uint32_t stride_; // Slots per block in entries_
+    bool hasStackMap_;
+    bool solved_; // Whether solve() has run, for methods without a StackMapTable
+    std::vector<ValueType> entries_; // Types on entry to every block
+    std::vector<uint16_t> depths_;   // Stack depth on entry to every block
+    std::vector<State> states_;
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> nameIndices_;
+    ValueType this_;
+    ValueType object_;
+
+    /// Leaves every block pending: build() stores the entry frames that the others are derived from.
+    TypeInference(const ConstantPool &constantPool, CodeAttributeInfo &code, const std::string &className);
+
+    ValueType value(const VerificationTypeInfo &type);
+    ValueType join(ValueType a, ValueType b);
+
+    TypeFrame load(uint32_t block) const;
+    void store(uint32_t block, const TypeFrame &frame);
+    bool merge(uint32_t block, const TypeFrame &frame);
+    void replay(uint32_t block, TypeFrame &frame, uint32_t end);
+    void derive(uint32_t block);
+    void solve();
+};
+
+} // namespace cjbp
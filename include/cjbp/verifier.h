@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "inline.h"
+
+namespace cjbp {
+
+class ClassFile;
+class ClassPath;
+class MethodInfo;
+
+/**
+ * Verifier checks that the code of a class is type safe, like the type checking verifier of the Java Virtual Machine
+ * (JVMS 4.10.1): every instruction must find operands of the right types, and the types must agree with the StackMapTable
+ * wherever control flow merges. Since the StackMapTable gives the types at every merge point, each method is checked in
+ * one linear pass over its code, with no iteration to a fixed point.
+ *
+ * Deciding whether one class is assignable to another takes the class hierarchy, which is read from a ClassPath. As in
+ * the JVM, every reference is assignable to an interface. Classes that the class path cannot find are assumed to be
+ * assignable, leaving the check to whoever loads them, so a verifier without a class path only checks the types that the
+ * class alone decides. java.lang.Object is always known, as the root of every hierarchy, so two unrelated classes of the
+ * class path are not assignable even when it does not hold the JDK. Access to fields and methods, and whether they
+ * exist, is left to linking, as in the JVM.
+ *
+ * Code that has no StackMapTable, i.e. code compiled for Java 5 or earlier, would need the type inference verifier
+ * (JVMS 4.10.2). Such code is checked against the types given by TypeInference instead, whose joins are conservative, so
+ * java.lang.Object is then accepted wherever a class type is expected.
+ *
+ * Results of verify() with a content hash are cached, so that a class that appears several times (e.g. in several jars)
+ * is verified once. A Verifier may be used from several threads at once.
+ */
+class Verifier {
+public:
+    /**
+     * @param classPath Where to read the superclasses of the classes that are verified from, or nullptr to assume that
+     *     classes are assignable when their hierarchy matters. It is only used under a lock, and must outlive the verifier.
+     */
+    explicit Verifier(ClassPath *classPath = nullptr);
+
+    Verifier(const Verifier &) = delete;
+    Verifier &operator=(const Verifier &) = delete;
+
+    /// A SHA-256 digest of the content of a class file.
+    using ContentHash = std::array<uint8_t, 32>;
+
+    /**
+     * Hashes the rest of a stream, e.g. a class file before reading it, then rewinds the stream to where it was. The digest
+     * is cryptographic, so a crafted class file cannot share the cached result of another.
+     *
+     * @throws std::runtime_error If the stream cannot be rewound.
+     */
+    static ContentHash hash(std::istream &s);
+
+    /**
+     * Verifies every method of a class.
+     *
+     * @throws VerifyError If the code of a method is not type safe.
+     */
+    void verify(const ClassFile &classFile);
+
+    /**
+     * Verifies every method of a class, unless a class with the same content hash (see hash()) was verified before, in
+     * which case its result is returned again: nothing, or the same VerifyError.
+     *
+     * @throws VerifyError If the code of a method is not type safe.
+     */
+    void verify(const ClassFile &classFile, const ContentHash &contentHash);
+
+    /**
+     * Verifies one method of a class. Methods without code are trivially type safe.
+     *
+     * @throws VerifyError If the code of the method is not type safe.
+     */
+    void verify(const ClassFile &classFile, const MethodInfo &method);
+
+    /// @return The number of calls to verify() with a content hash that were answered from the cache.
+    uint64_t cacheHits() const;
+
+    /**
+     * @return Whether a value of the class named from may be assigned to a variable of the class named to, both given as
+     *     fully-qualified names or array class names (e.g. "java.lang.String", "[Ljava.lang.String;", "[I").
+     */
+    bool isAssignable(const std::string &from, const std::string &to);
+
+private:
+    struct ClassInfo {
+        std::string superName; // Empty for java.lang.Object
+        bool interface;
+        bool found;
+    };
+
+    struct ContentHashHasher {
+        CJBP_INLINE size_t operator()(const ContentHash &hash) const {
+            size_t result;
+            std::memcpy(&result, hash.data(), sizeof(result)); // Any bytes of a SHA-256 digest are uniformly distributed
+            return result;
+        }
+    };
+
+    ClassPath *classPath_;
+    std::mutex classMutex_; // Guards classPath_ and classes_
+    std::unordered_map<std::string, ClassInfo> classes_;
+    mutable std::mutex cacheMutex_; // Guards results_ and cacheHits_
+    std::unordered_map<ContentHash, std::string, ContentHashHasher> results_; // Error message, empty if the class verified
+    uint64_t cacheHits_;
+
+    ClassInfo classInfo(const std::string &name);
+    void remember(const ClassFile &classFile);
+};
+
+} // namespace cjbp
@@ -0,0 +1,109 @@
+#include "cjbp/analysis_driver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "cjbp/class_file.h"
+#include "cjbp/class_path.h"
+#include "cjbp/code_attribute.h"
+#include "cjbp/control_flow_graph.h"
+#include "cjbp/escape_analysis.h"
+#include "cjbp/method_info.h"
+#include "cjbp/register_code.h"
+#include "cjbp/type_inference.h"
+#include "work_stealing_pool.h"
+
+namespace cjbp {
+
+std::string AnalysisDriver::Statistics::toString() const {
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer), "%llu methods (%llu bytes) of %llu classes in %.3f s: %.0f methods/s, %.2f MB/s, %llu failed classes, %llu failed methods",
+                  static_cast<unsigned long long>(this->methods), static_cast<unsigned long long>(this->bytes),
+                  static_cast<unsigned long long>(this->classes), this->seconds, this->methodsPerSecond(), this->bytesPerSecond() / 1e6,
+                  static_cast<unsigned long long>(this->failedClasses), static_cast<unsigned long long>(this->failedMethods));
+    return buffer;
+}
+
+AnalysisDriver::AnalysisDriver(uint32_t analyses, uint32_t threadCount) :
+    analyses_(analyses), threadCount_(threadCount != 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency())) { }
+
+void AnalysisDriver::analyze(const ClassFile &classFile, const MethodInfo &method) const {
+    CodeAttributeInfo &code = *method.code();
+    code.cfg();
+    if (this->analyses_ & Dominators) code.dominators();
+    if (this->analyses_ & Loops) code.loops();
+    if (this->analyses_ & Liveness) code.liveness();
+    if (this->analyses_ & CacheSlots) code.cacheSlots();
+    if (this->analyses_ & (Types | Registers | Escapes)) {
+        std::unique_ptr<TypeInference> types = TypeInference::build(classFile, method);
+        if (this->analyses_ & Escapes) {
+            EscapeAnalysis::build(*types);
+        } else if (this->analyses_ & Registers) {
+            RegisterCode::build(*types);
+        } else {
+            for (const BasicBlock &block : code.cfg()->blocks()) types->entry(block.id());
+        }
+    }
+}
+
+AnalysisDriver::Statistics AnalysisDriver::run(ClassPath &classPath) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> names = classPath.listClasses();
+
+    std::mutex classPathMutex;
+    std::atomic<uint64_t> classes { 0 }, methods { 0 }, bytes { 0 }, failedClasses { 0 }, failedMethods { 0 };
+    {
+        WorkStealingPool pool(this->threadCount_);
+        for (const std::string &name : names) {
+            pool.submit([&, name] {
+                std::shared_ptr<ClassFile> classFile;
+                try {
+                    std::shared_ptr<std::istream> stream = classPath.findClassSerialized(name, classPathMutex);
+                    if (stream == nullptr) throw std::runtime_error("Class not found");
+                    classFile = ClassFile::read(*stream);
+                } catch (const std::exception &e) {
+                    failedClasses.fetch_add(1, std::memory_order_relaxed);
+                    if (this->errorCallback_) this->errorCallback_(name, nullptr, e);
+                    return;
+                }
+                classes.fetch_add(1, std::memory_order_relaxed);
+
+                // One task per method; the class is freed once its last method is done
+                for (const std::unique_ptr<MethodInfo> &method : classFile->methods()) {
+                    if (method->code() == nullptr) continue;
+                    pool.submit([&, classFile, method = method.get()] {
+                        try {
+                            this->analyze(*classFile, *method);
+                        } catch (const std::exception &e) {
+                            failedMethods.fetch_add(1, std::memory_order_relaxed);
+                            if (this->errorCallback_) this->errorCallback_(classFile->name(), method, e);
+                            return;
+                        }
+                        methods.fetch_add(1, std::memory_order_relaxed);
+                        bytes.fetch_add(method->code()->code().size(), std::memory_order_relaxed);
+                        if (this->methodCallback_) this->methodCallback_(*classFile, *method);
+                    });
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    Statistics statistics;
+    statistics.classes = classes;
+    statistics.methods = methods;
+    statistics.bytes = bytes;
+    statistics.failedClasses = failedClasses;
+    statistics.failedMethods = failedMethods;
+    statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return statistics;
+}
+
+} // namespace cjbp
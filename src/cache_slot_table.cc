@@ -0,0 +1,57 @@
+#include "cjbp/cache_slot_table.h"
+
+#include <unordered_map>
+
+#include "cjbp/code_attribute.h"
+#include "cjbp/code_iterator.h"
+
+namespace cjbp {
+
+namespace {
+
+CJBP_INLINE CacheSlotTable::Kind slotKind(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::Ldc:
+        case Opcode::LdcW:
+        case Opcode::Ldc2W: return CacheSlotTable::Kind::Constant;
+        case Opcode::GetStatic:
+        case Opcode::PutStatic: return CacheSlotTable::Kind::StaticField;
+        case Opcode::GetField:
+        case Opcode::PutField: return CacheSlotTable::Kind::InstanceField;
+        case Opcode::InvokeVirtual: return CacheSlotTable::Kind::VirtualMethod;
+        case Opcode::InvokeSpecial: return CacheSlotTable::Kind::SpecialMethod;
+        case Opcode::InvokeStatic: return CacheSlotTable::Kind::StaticMethod;
+        case Opcode::InvokeInterface: return CacheSlotTable::Kind::InterfaceMethod;
+        case Opcode::InvokeDynamic: return CacheSlotTable::Kind::CallSite;
+        default: return CacheSlotTable::Kind::Class;
+    }
+}
+
+} // namespace
+
+std::unique_ptr<CacheSlotTable> CacheSlotTable::build(const CodeAttributeInfo &code) {
+    std::vector<uint16_t> slotByIndex(code.code().size(), NoSlot);
+    std::vector<Slot> slots;
+    std::unordered_map<uint32_t, uint16_t> slotByKey;
+
+    for (const Instruction &instruction : code.instructions()) {
+        if (!instruction.hasPoolIndex()) continue;
+
+        Kind kind = slotKind(instruction.opcode());
+        uint16_t slot = slots.size();
+        if (kind != Kind::CallSite) {
+            auto [it, inserted] = slotByKey.emplace((static_cast<uint32_t>(instruction.poolIndex()) << 8) | static_cast<uint8_t>(kind), slot);
+            if (!inserted) {
+                slotByIndex[instruction.index()] = it->second;
+                continue;
+            }
+        }
+
+        slots.push_back({ instruction.poolIndex(), kind });
+        slotByIndex[instruction.index()] = slot;
+    }
+
+    return std::make_unique<CacheSlotTable>(std::move(slotByIndex), std::move(slots));
+}
+
+} // namespace cjbp
@@ -0,0 +1,496 @@
+#include "cjbp/call_graph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "cjbp/class_file.h"
+#include "cjbp/class_path.h"
+#include "cjbp/code_attribute.h"
+#include "cjbp/code_iterator.h"
+#include "cjbp/exception.h"
+#include "cjbp/method_info.h"
+#include "work_stealing_pool.h"
+
+namespace cjbp {
+
+namespace {
+
+constexpr uint16_t AccPrivate = 0x0002;
+constexpr uint16_t AccStatic = 0x0008;
+constexpr uint16_t AccFinal = 0x0010;
+constexpr uint16_t AccInterface = 0x0200;
+constexpr uint16_t AccAbstract = 0x0400;
+
+/// References resolved per task, when resolving call sites in parallel.
+constexpr uint32_t ReferencesPerTask = 256;
+
+struct CallSite {
+    bool virtual_; // invokevirtual or invokeinterface, as opposed to invokestatic or invokespecial
+    std::string owner, name, type;
+};
+
+struct MethodData {
+    std::string name, type;
+    uint16_t accessFlags;
+    std::vector<uint32_t> sites; // Indices in ClassData::sites
+};
+
+/// What the call graph needs of a class, so that the ClassFile can be freed as soon as it has been read.
+struct ClassData {
+    bool read = false;
+    uint16_t accessFlags = 0;
+    std::string name, superName;
+    std::vector<std::string> interfaces;
+    std::vector<MethodData> methods;
+    std::vector<CallSite> sites; // Distinct call sites of all methods
+};
+
+ClassData readClass(const ClassFile &classFile, std::atomic<uint32_t> &failedMethods) {
+    const ConstantPool &constantPool = classFile.constantPool();
+    ClassData data;
+    data.read = true;
+    data.accessFlags = classFile.accessFlags();
+    data.name = classFile.name();
+    if (classFile.superName() != nullptr) data.superName = *classFile.superName();
+    for (const std::string *interface : classFile.interfaces()) data.interfaces.push_back(*interface);
+
+    std::unordered_map<std::string, uint32_t> siteIndices;
+    for (const std::unique_ptr<MethodInfo> &method : classFile.methods()) {
+        MethodData &methodData = data.methods.emplace_back(MethodData { method->name(), method->type(), method->accessFlags(), {} });
+        if (method->code() == nullptr) continue;
+        try {
+            for (const Instruction &instruction : method->code()->instructions()) {
+                Opcode opcode = instruction.opcode();
+                if (opcode < Opcode::InvokeVirtual || opcode > Opcode::InvokeInterface) continue;
+
+                uint16_t index = instruction.poolIndex();
+                CallSite site;
+                site.virtual_ = opcode == Opcode::InvokeVirtual || opcode == Opcode::InvokeInterface;
+                if (constantPool.isValid(index, ConstantPool::Tag::MethodRef)) {
+                    site.owner = constantPool.methodRefClass(index);
+                    site.name = constantPool.methodRefName(index);
+                    site.type = constantPool.methodRefType(index);
+                } else if (constantPool.isValid(index, ConstantPool::Tag::InterfaceMethodRef)) {
+                    site.owner = constantPool.interfaceMethodRefClass(index);
+                    site.name = constantPool.interfaceMethodRefName(index);
+                    site.type = constantPool.interfaceMethodRefType(index);
+                } else {
+                    throw CorruptClassFile("CallGraph: Invalid method reference");
+                }
+
+                std::string key = (site.virtual_ ? 'v' : 's') + site.owner + '.' + site.name + site.type;
+                auto [it, inserted] = siteIndices.emplace(std::move(key), data.sites.size());
+                if (inserted) data.sites.push_back(std::move(site));
+                methodData.sites.push_back(it->second);
+            }
+        } catch (const CorruptClassFile &) {
+            failedMethods.fetch_add(1, std::memory_order_relaxed);
+            methodData.sites.clear();
+        }
+    }
+    return data;
+}
+
+} // namespace
+
+/**
+ * CallGraphBuilder does the work of CallGraph::build(): read the classes, intern their names, then resolve every distinct
+ * method reference once and merge the targets of the references of every method.
+ */
+class CallGraphBuilder {
+public:
+    CallGraphBuilder(CallGraph &graph, uint32_t threadCount) : graph_(graph), pool_(threadCount) { }
+
+    void build(ClassPath &classPath);
+
+private:
+    /// A distinct method reference of any call site, with the class and signature interned.
+    struct Reference {
+        bool virtual_;
+        uint32_t owner;
+        uint32_t signature;
+    };
+
+    /// Scratch space of one resolving worker. Classes are marked with the number of the walk that visited them last.
+    struct Walk {
+        std::vector<uint32_t> subtypeMarks, interfaceMarks;
+        uint32_t subtypeWalk = 0, interfaceWalk = 0;
+        std::vector<uint32_t> stack, queue;
+
+        explicit Walk(uint32_t classCount) : subtypeMarks(classCount, 0), interfaceMarks(classCount, 0) { }
+    };
+
+    CallGraph &graph_;
+    WorkStealingPool pool_;
+    std::vector<ClassData> classes_; // In the order of ClassPath::listClasses()
+
+    // The class hierarchy, by class index
+    std::vector<const ClassData *> classData_; // nullptr for classes that are not on the class path
+    std::vector<uint32_t> superclasses_;       // NotFound for java.lang.Object and classes that are not on the class path
+    std::vector<uint32_t> interfaceOffsets_, interfaces_;
+    std::vector<uint32_t> subtypeOffsets_, subtypes_; // Direct subclasses, subinterfaces and implementations
+
+    std::vector<Reference> references_;
+    std::vector<std::vector<uint32_t>> siteReferences_; // Reference of every call site, by position in classes_
+    std::vector<std::vector<uint32_t>> targets_;        // Sorted methods that every reference may call
+
+    std::mutex undeclaredMutex_; // Guards undeclared_ and undeclaredIndices_ while resolving
+    std::vector<uint64_t> undeclared_; // Class and signature of every undeclared method, as in CallGraph::methodIndices_
+    std::unordered_map<uint64_t, uint32_t> undeclaredIndices_;
+
+    uint32_t internClass(const std::string &name);
+    uint32_t internSignature(const std::string &name, const std::string &type);
+
+    void readClasses(ClassPath &classPath);
+    void buildHierarchy();
+    void addDeclaredMethods();
+    void collectReferences();
+    void resolveReferences();
+    void buildEdges();
+
+    uint32_t declared(uint32_t classIndex, uint32_t signature) const;
+    uint32_t undeclared(uint32_t classIndex, uint32_t signature);
+    uint32_t lookup(uint32_t classIndex, uint32_t signature, bool selecting, uint32_t &unknownClass) const;
+    uint32_t lookupDefault(uint32_t classIndex, uint32_t signature, Walk &walk) const;
+    void resolve(const Reference &reference, std::vector<uint32_t> &targets, Walk &walk);
+};
+
+uint32_t CallGraphBuilder::internClass(const std::string &name) {
+    auto [it, inserted] = this->graph_.classIndices_.emplace(name, this->graph_.classNames_.size());
+    if (inserted) this->graph_.classNames_.push_back(name);
+    return it->second;
+}
+
+uint32_t CallGraphBuilder::internSignature(const std::string &name, const std::string &type) {
+    auto [it, inserted] = this->graph_.signatureIndices_.emplace(name + type, this->graph_.signatures_.size());
+    if (inserted) this->graph_.signatures_.emplace_back(name, type);
+    return it->second;
+}
+
+void CallGraphBuilder::build(ClassPath &classPath) {
+    this->readClasses(classPath);
+    this->buildHierarchy();
+    this->addDeclaredMethods();
+    this->collectReferences();
+    this->resolveReferences();
+    this->buildEdges();
+}
+
+void CallGraphBuilder::readClasses(ClassPath &classPath) {
+    std::vector<std::string> names = classPath.listClasses();
+    this->classes_.resize(names.size());
+
+    std::mutex classPathMutex;
+    std::atomic<uint32_t> failedClasses { 0 }, failedMethods { 0 };
+    for (uint32_t i = 0; i < names.size(); i++) {
+        this->pool_.submit([&, i] {
+            try {
+                std::shared_ptr<std::istream> stream = classPath.findClassSerialized(names[i], classPathMutex);
+                if (stream == nullptr) throw std::runtime_error("Class not found");
+                this->classes_[i] = readClass(*ClassFile::read(*stream), failedMethods);
+            } catch (const std::exception &) {
+                failedClasses.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    this->pool_.wait();
+    this->graph_.failedClasses_ = failedClasses;
+    this->graph_.failedMethods_ = failedMethods;
+}
+
+void CallGraphBuilder::buildHierarchy() {
+    // Classes of the class path first, then every other class that they name
+    for (const ClassData &data : this->classes_) {
+        if (!data.read) continue;
+        uint32_t classIndex = this->internClass(data.name);
+        if (classIndex >= this->classData_.size()) this->classData_.resize(classIndex + 1, nullptr);
+        if (this->classData_[classIndex] == nullptr) this->classData_[classIndex] = &data; // The first of duplicates wins
+    }
+    for (const ClassData &data : this->classes_) {
+        if (data.read && !data.superName.empty()) this->internClass(data.superName);
+        for (const std::string &interface : data.interfaces) this->internClass(interface);
+    }
+    uint32_t classCount = this->graph_.classNames_.size();
+    this->classData_.resize(classCount, nullptr);
+
+    this->superclasses_.assign(classCount, CallGraph::NotFound);
+    this->interfaceOffsets_.assign(classCount + 1, 0);
+    std::vector<uint32_t> subtypeCounts(classCount + 1, 0);
+    for (uint32_t i = 0; i < classCount; i++) {
+        const ClassData *data = this->classData_[i];
+        if (data != nullptr) {
+            if (!data->superName.empty()) {
+                this->superclasses_[i] = this->graph_.classIndices_.at(data->superName);
+                subtypeCounts[this->superclasses_[i]]++;
+            }
+            for (const std::string &interface : data->interfaces) {
+                uint32_t interfaceIndex = this->graph_.classIndices_.at(interface);
+                this->interfaces_.push_back(interfaceIndex);
+                subtypeCounts[interfaceIndex]++;
+            }
+        }
+        this->interfaceOffsets_[i + 1] = this->interfaces_.size();
+    }
+
+    this->subtypeOffsets_.assign(classCount + 1, 0);
+    for (uint32_t i = 0; i < classCount; i++) this->subtypeOffsets_[i + 1] = this->subtypeOffsets_[i] + subtypeCounts[i];
+    this->subtypes_.resize(this->subtypeOffsets_[classCount]);
+    std::vector<uint32_t> cursors(this->subtypeOffsets_.begin(), this->subtypeOffsets_.end() - 1);
+    for (uint32_t i = 0; i < classCount; i++) {
+        if (this->superclasses_[i] != CallGraph::NotFound) this->subtypes_[cursors[this->superclasses_[i]]++] = i;
+        for (uint32_t j = this->interfaceOffsets_[i]; j < this->interfaceOffsets_[i + 1]; j++) this->subtypes_[cursors[this->interfaces_[j]]++] = i;
+    }
+}
+
+void CallGraphBuilder::addDeclaredMethods() {
+    for (uint32_t classIndex = 0; classIndex < this->classData_.size(); classIndex++) {
+        const ClassData *data = this->classData_[classIndex];
+        if (data == nullptr) continue;
+        for (const MethodData &method : data->methods) {
+            uint32_t signature = this->internSignature(method.name, method.type);
+            uint64_t key = static_cast<uint64_t>(classIndex) << 32 | signature;
+            if (this->graph_.methodIndices_.emplace(key, this->graph_.methods_.size()).second) {
+                this->graph_.methods_.push_back({ classIndex, signature, method.accessFlags });
+            }
+        }
+    }
+    this->graph_.declaredCount_ = this->graph_.methods_.size();
+}
+
+void CallGraphBuilder::collectReferences() {
+    std::unordered_map<uint64_t, uint32_t> referenceIndices;
+    this->siteReferences_.resize(this->classes_.size());
+    for (uint32_t i = 0; i < this->classes_.size(); i++) {
+        for (const CallSite &site : this->classes_[i].sites) {
+            uint32_t owner = this->internClass(site.owner);
+            uint32_t signature = this->internSignature(site.name, site.type);
+            uint64_t key = static_cast<uint64_t>(owner) << 33 | static_cast<uint64_t>(signature) << 1 | site.virtual_;
+            auto [it, inserted] = referenceIndices.emplace(key, this->references_.size());
+            if (inserted) this->references_.push_back({ site.virtual_, owner, signature });
+            this->siteReferences_[i].push_back(it->second);
+        }
+    }
+
+    // Classes that are only named by call sites are not on the class path, and have no known supertypes or subtypes
+    uint32_t classCount = this->graph_.classNames_.size();
+    this->classData_.resize(classCount, nullptr);
+    this->superclasses_.resize(classCount, CallGraph::NotFound);
+    this->interfaceOffsets_.resize(classCount + 1, this->interfaces_.size());
+    this->subtypeOffsets_.resize(classCount + 1, this->subtypes_.size());
+}
+
+void CallGraphBuilder::resolveReferences() {
+    this->targets_.resize(this->references_.size());
+    // One walk per worker, reused by all of its tasks: the marks never need clearing, as every walk takes a new number
+    std::vector<Walk> walks(this->pool_.threadCount(), Walk(this->graph_.classNames_.size()));
+    for (uint32_t begin = 0; begin < this->references_.size(); begin += ReferencesPerTask) {
+        this->pool_.submit([this, &walks, begin] {
+            Walk &walk = walks[this->pool_.workerIndex()];
+            uint32_t end = std::min<uint32_t>(begin + ReferencesPerTask, this->references_.size());
+            for (uint32_t i = begin; i < end; i++) this->resolve(this->references_[i], this->targets_[i], walk);
+        });
+    }
+    this->pool_.wait();
+
+    // Undeclared methods were numbered in the order that the tasks happened to need them; renumber them by class and
+    // signature, so that the numbering does not depend on scheduling
+    uint32_t declaredCount = this->graph_.declaredCount_;
+    std::vector<uint32_t> order(this->undeclared_.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return this->undeclared_[a] < this->undeclared_[b]; });
+    std::vector<uint32_t> numbers(order.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        uint64_t key = this->undeclared_[order[i]];
+        numbers[order[i]] = declaredCount + i;
+        this->graph_.methodIndices_.emplace(key, declaredCount + i);
+        this->graph_.methods_.push_back({ static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key), 0 });
+    }
+    for (std::vector<uint32_t> &targets : this->targets_) {
+        for (uint32_t &target : targets) {
+            if (target >= declaredCount) target = numbers[target - declaredCount];
+        }
+        std::sort(targets.begin(), targets.end());
+        targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+    }
+}
+
+void CallGraphBuilder::buildEdges() {
+    uint32_t methodCount = this->graph_.methods_.size();
+    std::vector<std::vector<uint32_t>> callees(methodCount);
+    for (uint32_t i = 0; i < this->classes_.size(); i++) {
+        const ClassData &data = this->classes_[i];
+        if (!data.read || this->classData_[this->graph_.classIndices_.at(data.name)] != &data) continue;
+        this->pool_.submit([this, &callees, &data, i] {
+            uint32_t classIndex = this->graph_.classIndices_.at(data.name);
+            for (const MethodData &method : data.methods) {
+                uint32_t number = this->declared(classIndex, this->graph_.signatureIndices_.at(method.name + method.type));
+                std::vector<uint32_t> &list = callees[number];
+                for (uint32_t site : method.sites) {
+                    const std::vector<uint32_t> &targets = this->targets_[this->siteReferences_[i][site]];
+                    list.insert(list.end(), targets.begin(), targets.end());
+                }
+                std::sort(list.begin(), list.end());
+                list.erase(std::unique(list.begin(), list.end()), list.end());
+            }
+        });
+    }
+    this->pool_.wait();
+
+    // Callees row by row; callers by counting, which keeps each row sorted since callers are visited in order
+    this->graph_.calleeOffsets_.assign(methodCount + 1, 0);
+    std::vector<uint32_t> callerCounts(methodCount + 1, 0);
+    for (uint32_t i = 0; i < methodCount; i++) {
+        this->graph_.callees_.insert(this->graph_.callees_.end(), callees[i].begin(), callees[i].end());
+        this->graph_.calleeOffsets_[i + 1] = this->graph_.callees_.size();
+        for (uint32_t callee : callees[i]) callerCounts[callee]++;
+    }
+    this->graph_.callerOffsets_.assign(methodCount + 1, 0);
+    for (uint32_t i = 0; i < methodCount; i++) this->graph_.callerOffsets_[i + 1] = this->graph_.callerOffsets_[i] + callerCounts[i];
+    this->graph_.callers_.resize(this->graph_.callees_.size());
+    std::vector<uint32_t> cursors(this->graph_.callerOffsets_.begin(), this->graph_.callerOffsets_.end() - 1);
+    for (uint32_t i = 0; i < methodCount; i++) {
+        for (uint32_t callee : callees[i]) this->graph_.callers_[cursors[callee]++] = i;
+    }
+}
+
+uint32_t CallGraphBuilder::declared(uint32_t classIndex, uint32_t signature) const {
+    auto it = this->graph_.methodIndices_.find(static_cast<uint64_t>(classIndex) << 32 | signature);
+    return it != this->graph_.methodIndices_.end() ? it->second : CallGraph::NotFound;
+}
+
+uint32_t CallGraphBuilder::undeclared(uint32_t classIndex, uint32_t signature) {
+    uint64_t key = static_cast<uint64_t>(classIndex) << 32 | signature;
+    std::lock_guard<std::mutex> lock(this->undeclaredMutex_);
+    auto [it, inserted] = this->undeclaredIndices_.emplace(key, this->graph_.declaredCount_ + this->undeclared_.size());
+    if (inserted) this->undeclared_.push_back(key);
+    return it->second;
+}
+
+uint32_t CallGraphBuilder::lookup(uint32_t classIndex, uint32_t signature, bool selecting, uint32_t &unknownClass) const {
+    // Walks up the superclasses (JVMS 5.4.3.3 step 2, or 5.4.6 step 2 when selecting, which skips private and static methods)
+    unknownClass = CallGraph::NotFound;
+    for (uint32_t depth = 0; classIndex != CallGraph::NotFound && depth < this->superclasses_.size(); depth++) {
+        if (this->classData_[classIndex] == nullptr) {
+            unknownClass = classIndex;
+            return CallGraph::NotFound;
+        }
+        uint32_t method = this->declared(classIndex, signature);
+        if (method != CallGraph::NotFound && !(selecting && (this->graph_.methods_[method].accessFlags & (AccPrivate | AccStatic)))) return method;
+        classIndex = this->superclasses_[classIndex];
+    }
+    return CallGraph::NotFound;
+}
+
+uint32_t CallGraphBuilder::lookupDefault(uint32_t classIndex, uint32_t signature, Walk &walk) const {
+    // Breadth first over the superinterfaces of the class and its superclasses, so that the nearest default method is
+    // found first: an approximation of the maximally-specific method of JVMS 5.4.3.3
+    uint32_t mark = ++walk.interfaceWalk;
+    std::vector<uint32_t> &queue = walk.queue;
+    queue.clear();
+    for (uint32_t depth = 0; classIndex != CallGraph::NotFound && depth < this->superclasses_.size(); depth++) {
+        queue.insert(queue.end(), this->interfaces_.begin() + this->interfaceOffsets_[classIndex], this->interfaces_.begin() + this->interfaceOffsets_[classIndex + 1]);
+        classIndex = this->superclasses_[classIndex];
+    }
+    for (uint32_t i = 0; i < queue.size(); i++) {
+        uint32_t interface = queue[i];
+        if (walk.interfaceMarks[interface] == mark) continue;
+        walk.interfaceMarks[interface] = mark;
+        uint32_t method = this->declared(interface, signature);
+        if (method != CallGraph::NotFound && !(this->graph_.methods_[method].accessFlags & (AccPrivate | AccStatic | AccAbstract))) return method;
+        queue.insert(queue.end(), this->interfaces_.begin() + this->interfaceOffsets_[interface], this->interfaces_.begin() + this->interfaceOffsets_[interface + 1]);
+    }
+    return CallGraph::NotFound;
+}
+
+void CallGraphBuilder::resolve(const Reference &reference, std::vector<uint32_t> &targets, Walk &walk) {
+    uint32_t unknownClass;
+    // A superclass that is not on the class path (typically java.lang.Object) may declare the method, or not, in which case
+    // a default method would be selected: both are targets then
+    uint32_t resolved = this->lookup(reference.owner, reference.signature, false, unknownClass);
+    if (resolved == CallGraph::NotFound) resolved = this->lookupDefault(reference.owner, reference.signature, walk);
+
+    if (!reference.virtual_) {
+        // A method that cannot be found is called as an undeclared method of the class it should be in
+        if (resolved != CallGraph::NotFound) targets.push_back(resolved);
+        if (unknownClass != CallGraph::NotFound) {
+            targets.push_back(this->undeclared(unknownClass, reference.signature));
+        } else if (resolved == CallGraph::NotFound) {
+            targets.push_back(this->undeclared(reference.owner, reference.signature));
+        }
+        return;
+    }
+
+    // Private and final methods cannot be overridden
+    if (resolved != CallGraph::NotFound && (this->graph_.methods_[resolved].accessFlags & (AccPrivate | AccFinal))) {
+        targets.push_back(resolved);
+        return;
+    }
+    if (this->classData_[reference.owner] == nullptr) targets.push_back(this->undeclared(reference.owner, reference.signature));
+
+    // Every concrete class that is a subtype of the owner may be the receiver
+    uint32_t mark = ++walk.subtypeWalk;
+    std::vector<uint32_t> &stack = walk.stack;
+    stack.assign(1, reference.owner);
+    walk.subtypeMarks[reference.owner] = mark;
+    while (!stack.empty()) {
+        uint32_t classIndex = stack.back();
+        stack.pop_back();
+        for (uint32_t i = this->subtypeOffsets_[classIndex]; i < this->subtypeOffsets_[classIndex + 1]; i++) {
+            uint32_t subtype = this->subtypes_[i];
+            if (walk.subtypeMarks[subtype] == mark) continue;
+            walk.subtypeMarks[subtype] = mark;
+            stack.push_back(subtype);
+        }
+
+        const ClassData *data = this->classData_[classIndex];
+        if (data == nullptr || (data->accessFlags & (AccInterface | AccAbstract))) continue;
+        uint32_t selected = this->lookup(classIndex, reference.signature, true, unknownClass);
+        if (selected == CallGraph::NotFound) {
+            if (unknownClass != CallGraph::NotFound) targets.push_back(this->undeclared(unknownClass, reference.signature));
+            selected = this->lookupDefault(classIndex, reference.signature, walk);
+        }
+        if (selected != CallGraph::NotFound && !(this->graph_.methods_[selected].accessFlags & AccAbstract)) targets.push_back(selected);
+    }
+}
+
+
+
+std::unique_ptr<CallGraph> CallGraph::build(ClassPath &classPath, uint32_t threadCount) {
+    std::unique_ptr<CallGraph> graph(new CallGraph());
+    CallGraphBuilder(*graph, threadCount != 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency())).build(classPath);
+    return graph;
+}
+
+uint32_t CallGraph::find(const std::string &className, const std::string &name, const std::string &type) const {
+    auto classIt = this->classIndices_.find(className);
+    auto signatureIt = this->signatureIndices_.find(name + type);
+    if (classIt == this->classIndices_.end() || signatureIt == this->signatureIndices_.end()) return NotFound;
+    auto it = this->methodIndices_.find(static_cast<uint64_t>(classIt->second) << 32 | signatureIt->second);
+    return it != this->methodIndices_.end() ? it->second : NotFound;
+}
+
+BitSet CallGraph::reachable(Span<uint32_t> roots) const {
+    BitSet result(this->size());
+    std::vector<uint32_t> stack;
+    for (uint32_t root : roots) {
+        if (root >= this->size()) throw std::out_of_range("CallGraph::reachable: Invalid method");
+        if (result.test(root)) continue;
+        result.set(root);
+        stack.push_back(root);
+    }
+    while (!stack.empty()) {
+        uint32_t method = stack.back();
+        stack.pop_back();
+        for (uint32_t callee : this->callees(method)) {
+            if (result.test(callee)) continue;
+            result.set(callee);
+            stack.push_back(callee);
+        }
+    }
+    return result;
+}
+
+} // namespace cjbp
@@ -51,7 +51,7 @@ std::unique_ptr<ClassFile> ClassFile::read(std::istream &s) {
     std::vector<std::unique_ptr<MethodInfo>> methods;
     methods.reserve(methodsCount);
     for (uint16_t i = 0; i < methodsCount; i++) {
-        methods.push_back(MethodInfo::read(s, *constantPool));
+        methods.push_back(MethodInfo::read(s, *constantPool, thisClass));
     }
 
     std::vector<std::unique_ptr<AttributeInfo>> attributes = AttributeInfo::readList(s, *constantPool);
@@ -28,7 +28,7 @@ std::string FieldInfo::toString(const ConstantPool &constantPool) const {
 
 
 
-std::unique_ptr<MethodInfo> MethodInfo::read(std::istream &s, const ConstantPool &constantPool) {
+std::unique_ptr<MethodInfo> MethodInfo::read(std::istream &s, const ConstantPool &constantPool, uint16_t thisClass) {
     uint16_t accessFlags = readBigEndian<uint16_t>(s);
     const std::string &name = constantPool.utf8(readBigEndian<uint16_t>(s));
     const std::string &type = constantPool.utf8(readBigEndian<uint16_t>(s));
@@ -41,7 +41,12 @@ std::unique_ptr<MethodInfo> MethodInfo::read(std::istream &s, const ConstantPool
             break;
         }
     }
-    return std::make_unique<MethodInfo>(constantPool, accessFlags, name, type, MethodDescriptor::read(type), codeAttribute, std::move(attributes));
+    auto method = std::make_unique<MethodInfo>(constantPool, accessFlags, name, type, MethodDescriptor::read(type), codeAttribute, std::move(attributes));
+    if (codeAttribute != nullptr && codeAttribute->stackMapTable_ != nullptr) {
+        bool constructor = name == "<init>" && constantPool.class_(thisClass) != "java.lang.Object";
+        codeAttribute->stackMapTable_->setInitialFrame(thisClass, method->isStatic(), constructor, method->descriptor());
+    }
+    return method;
 }
 
 std::string MethodInfo::toString(const ConstantPool &constantPool) const {
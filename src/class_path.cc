@@ -3,12 +3,31 @@
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
+#include <mutex>
 #include <sstream>
+#include <unordered_set>
 
-#include "zip/zip.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cjbp/inline.h"
+
+#define MINIZ_HEADER_FILE_ONLY
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "zip/miniz.h"
 
 namespace cjbp {
 
+std::shared_ptr<std::istream> ClassPath::findClassSerialized(const std::string &name, std::mutex &mutex) {
+    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+    if (!this->isThreadSafe()) lock.lock();
+    return this->findClass(name);
+}
+
+
+
 std::shared_ptr<std::istream> CompositeClassPath::findClass(const std::string &name) {
     for (auto &classPath : this->classPaths_) {
         std::shared_ptr<std::istream> stream = classPath->findClass(name);
@@ -17,6 +36,42 @@ std::shared_ptr<std::istream> CompositeClassPath::findClass(const std::string &n
     return nullptr;
 }
 
+std::vector<std::string> CompositeClassPath::listClasses() {
+    // Classes found in earlier class paths shadow those in later ones, so only the first occurrence is listed.
+    std::vector<std::string> result;
+    std::unordered_set<std::string> seen;
+    for (auto &classPath : this->classPaths_) {
+        for (std::string &name : classPath->listClasses()) {
+            if (seen.insert(name).second) result.push_back(std::move(name));
+        }
+    }
+    return result;
+}
+
+bool CompositeClassPath::isThreadSafe() const {
+    return std::all_of(this->classPaths_.begin(), this->classPaths_.end(), [](const auto &classPath) { return classPath->isThreadSafe(); });
+}
+
+
+
+namespace {
+
+constexpr const char *ClassSuffix = ".class";
+constexpr size_t ClassSuffixLength = 6;
+
+/// Converts an entry path such as "java/lang/String.class" to a class name such as "java.lang.String", or returns false if
+/// the path does not name a class.
+bool classNameFromPath(std::string path, std::string &name) {
+    if (path.size() <= ClassSuffixLength || path.compare(path.size() - ClassSuffixLength, ClassSuffixLength, ClassSuffix) != 0) return false;
+    path.resize(path.size() - ClassSuffixLength);
+    if (path == "module-info" || path.rfind("META-INF/", 0) == 0) return false;
+    std::replace(path.begin(), path.end(), '/', '.');
+    name = std::move(path);
+    return true;
+}
+
+} // namespace
+
 
 
 FileClassPath::FileClassPath(std::string name, std::string path) : name_(std::move(name)), path_(std::move(path)) {
@@ -29,6 +84,11 @@ std::shared_ptr<std::istream> FileClassPath::findClass(const std::string &name)
     return std::make_shared<std::ifstream>(this->path_, std::ios::binary);
 }
 
+std::vector<std::string> FileClassPath::listClasses() {
+    if (!this->isValid_) return {};
+    return { this->name_ };
+}
+
 
 
 DirectoryClassPath::DirectoryClassPath(std::string path) : path_(std::move(path)) {
@@ -44,15 +104,35 @@ std::shared_ptr<std::istream> DirectoryClassPath::findClass(const std::string &n
     return std::make_shared<std::ifstream>(path, std::ios::binary);
 }
 
+std::vector<std::string> DirectoryClassPath::listClasses() {
+    std::vector<std::string> result;
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(this->path_, error); !error && it != std::filesystem::end(it); it.increment(error)) {
+        if (!it->is_regular_file()) continue;
+
+        std::string name;
+        if (classNameFromPath(std::filesystem::relative(it->path(), this->path_).generic_string(), name)) result.push_back(std::move(name));
+    }
+    return result;
+}
 
 
+
+/**
+ * A read-only stream buffer over bytes in memory, which keeps whatever owns them alive (the mapping of a jar, or a pooled
+ * buffer) for as long as the stream is in use, so no bytes are copied until the parser reads them.
+ */
 class ZipEntryStreamBuf : public std::streambuf {
 public:
-    ZipEntryStreamBuf(void *buf, size_t size);
-    ~ZipEntryStreamBuf() noexcept override;
+    ZipEntryStreamBuf(const char *data, size_t size, std::shared_ptr<const void> owner);
+    ~ZipEntryStreamBuf() noexcept override = default;
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
 
 private:
-    void *buf_;
+    std::shared_ptr<const void> owner_;
     size_t size_;
 };
 
@@ -65,44 +145,214 @@ private:
     std::unique_ptr<ZipEntryStreamBuf> buf_;
 };
 
-ZipEntryStreamBuf::ZipEntryStreamBuf(void *buf, size_t size) : buf_(buf), size_(size) {
-    this->setg(static_cast<char *>(this->buf_), static_cast<char *>(this->buf_), static_cast<char *>(this->buf_) + this->size_);
+ZipEntryStreamBuf::ZipEntryStreamBuf(const char *data, size_t size, std::shared_ptr<const void> owner) : owner_(std::move(owner)), size_(size) {
+    // The get area is never written to, so the bytes may be read-only
+    char *begin = const_cast<char *>(data);
+    this->setg(begin, begin, begin + this->size_);
 }
 
-ZipEntryStreamBuf::~ZipEntryStreamBuf() noexcept {
-    if (this->buf_ != nullptr) {
-        free(this->buf_);
-        this->buf_ = nullptr;
-    }
+ZipEntryStreamBuf::pos_type ZipEntryStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    off_type base = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? this->gptr() - this->eback() : static_cast<off_type>(this->size_);
+    off_type pos = base + off;
+    if (!(which & std::ios_base::in) || pos < 0 || pos > static_cast<off_type>(this->size_)) return pos_type(off_type(-1));
+    this->setg(this->eback(), this->eback() + pos, this->egptr());
+    return pos_type(pos);
+}
+
+ZipEntryStreamBuf::pos_type ZipEntryStreamBuf::seekpos(pos_type pos, std::ios_base::openmode which) {
+    return this->seekoff(off_type(pos), std::ios_base::beg, which);
 }
 
 ZipEntryIStream::ZipEntryIStream(std::unique_ptr<ZipEntryStreamBuf> buf) : std::istream(buf.get()), buf_(std::move(buf)) { }
 
+namespace {
+
+constexpr uint32_t LocalHeaderSignature = 0x04034b50;
+constexpr uint32_t CentralHeaderSignature = 0x02014b50;
+constexpr uint32_t EndSignature = 0x06054b50;
+constexpr uint32_t Zip64EndSignature = 0x06064b50;
+constexpr uint32_t Zip64LocatorSignature = 0x07064b50;
+constexpr uint32_t LocalHeaderSize = 30;
+constexpr uint32_t CentralHeaderSize = 46;
+constexpr uint32_t EndSize = 22;
+constexpr uint32_t Zip64EndSize = 56;
+constexpr uint32_t Zip64LocatorSize = 20;
+constexpr uint32_t MaxCommentSize = 0xffff;
+
+constexpr uint16_t Stored = 0;
+constexpr uint16_t Deflated = 8;
+
+constexpr size_t MaxPooledBuffers = 64;
+
+CJBP_INLINE uint16_t readU16(const uint8_t *p) { return p[0] | p[1] << 8; }
+CJBP_INLINE uint32_t readU32(const uint8_t *p) { return readU16(p) | static_cast<uint32_t>(readU16(p + 2)) << 16; }
+CJBP_INLINE uint64_t readU64(const uint8_t *p) { return readU32(p) | static_cast<uint64_t>(readU32(p + 4)) << 32; }
+
+} // namespace
+
+/**
+ * The jar mapped into memory, shared by the JarClassPath and every stream that it returned, with a pool of the buffers that
+ * deflated entries are inflated into.
+ */
+class JarClassPath::Archive {
+public:
+    /// A buffer taken from the pool, which goes back to it when the last stream reading from it is destroyed.
+    class Buffer {
+    public:
+        Buffer(std::shared_ptr<Archive> archive, std::vector<char> data) : archive_(std::move(archive)), data_(std::move(data)) { }
+        ~Buffer() noexcept { this->archive_->release(std::move(this->data_)); }
+
+        CJBP_INLINE char *data() { return this->data_.data(); }
+
+    private:
+        std::shared_ptr<Archive> archive_;
+        std::vector<char> data_;
+    };
+
+    Archive(const uint8_t *data, size_t size) : data_(data), size_(size) { }
+    ~Archive() noexcept { munmap(const_cast<uint8_t *>(this->data_), this->size_); }
+
+    CJBP_INLINE const uint8_t *data() const { return this->data_; }
+    CJBP_INLINE size_t size() const { return this->size_; }
+
+    /// @return A buffer of at least the given size, reusing a pooled one if any is free.
+    std::vector<char> acquire(size_t size) {
+        std::vector<char> buffer;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex_);
+            if (!this->buffers_.empty()) {
+                buffer = std::move(this->buffers_.back());
+                this->buffers_.pop_back();
+            }
+        }
+        if (buffer.size() < size) buffer.resize(size);
+        return buffer;
+    }
+
+    void release(std::vector<char> buffer) {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+        if (this->buffers_.size() < MaxPooledBuffers) this->buffers_.push_back(std::move(buffer));
+    }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+    std::mutex mutex_;
+    std::vector<std::vector<char>> buffers_;
+};
+
 JarClassPath::JarClassPath(const std::string &path) {
-    this->zip_ = zip_open(path.c_str(), 0, 'r');
-    if (this->zip_ == nullptr) throw std::runtime_error("Failed to open jar file " + path);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Failed to open jar file " + path);
+    struct stat status {};
+    if (fstat(fd, &status) != 0 || status.st_size < EndSize) {
+        close(fd);
+        throw std::runtime_error("Failed to open jar file " + path + ": Not a zip file");
+    }
+
+    // The mapping stays valid after the file is closed
+    void *data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) throw std::runtime_error("Failed to map jar file " + path);
+    this->archive_ = std::make_shared<Archive>(static_cast<const uint8_t *>(data), status.st_size);
+
+    try {
+        this->readCentralDirectory();
+    } catch (const std::runtime_error &e) {
+        throw std::runtime_error("Failed to open jar file " + path + ": " + e.what());
+    }
 }
 
-JarClassPath::~JarClassPath() {
-    if (this->zip_ != nullptr) zip_close(this->zip_);
+JarClassPath::~JarClassPath() noexcept = default;
+
+void JarClassPath::readCentralDirectory() {
+    const uint8_t *data = this->archive_->data();
+    uint64_t fileSize = this->archive_->size();
+
+    // The end of central directory record is last, followed only by a comment of up to 64 KiB
+    uint64_t end = fileSize - EndSize + 1, tailStart = fileSize - std::min<uint64_t>(fileSize, EndSize + MaxCommentSize);
+    do {
+        end--;
+    } while (end > tailStart && readU32(data + end) != EndSignature);
+    if (readU32(data + end) != EndSignature) throw std::runtime_error("No end of central directory record");
+
+    const uint8_t *record = data + end;
+    uint64_t entryCount = readU16(record + 10);
+    uint64_t directorySize = readU32(record + 12);
+    uint64_t directoryOffset = readU32(record + 16);
+    if (entryCount == 0xffff || directorySize == 0xffffffff || directoryOffset == 0xffffffff) {
+        // ZIP64: the locator just before the record points to the ZIP64 end of central directory record
+        const uint8_t *locator = record - Zip64LocatorSize;
+        if (end < Zip64LocatorSize || fileSize < Zip64EndSize || readU32(locator) != Zip64LocatorSignature || readU64(locator + 8) > fileSize - Zip64EndSize ||
+            readU32(data + readU64(locator + 8)) != Zip64EndSignature) {
+            throw std::runtime_error("Invalid ZIP64 end of central directory record");
+        }
+        const uint8_t *zip64End = data + readU64(locator + 8);
+        entryCount = readU64(zip64End + 32);
+        directorySize = readU64(zip64End + 40);
+        directoryOffset = readU64(zip64End + 48);
+    }
+    if (directoryOffset > fileSize || directorySize > fileSize - directoryOffset) throw std::runtime_error("Central directory out of bounds");
+
+    this->entries_.reserve(std::min(entryCount, directorySize / CentralHeaderSize));
+    const uint8_t *p = data + directoryOffset, *limit = p + directorySize;
+    for (uint64_t i = 0; i < entryCount; i++) {
+        if (limit - p < CentralHeaderSize || readU32(p) != CentralHeaderSignature) throw std::runtime_error("Invalid central directory header");
+        uint16_t flags = readU16(p + 8);
+        Entry entry { readU32(p + 42), readU32(p + 20), readU32(p + 24), readU32(p + 16), readU16(p + 10) };
+        uint16_t nameLength = readU16(p + 28), extraLength = readU16(p + 30), commentLength = readU16(p + 32);
+        const uint8_t *name = p + CentralHeaderSize, *extra = name + nameLength;
+        if (static_cast<uint64_t>(limit - name) < static_cast<uint64_t>(nameLength) + extraLength + commentLength) {
+            throw std::runtime_error("Invalid central directory header");
+        }
+
+        // ZIP64 extended information holds the sizes and offset that did not fit, in this order
+        for (const uint8_t *field = extra; field + 4 <= extra + extraLength; field += 4 + readU16(field + 2)) {
+            if (readU16(field) != 0x0001) continue;
+            const uint8_t *value = field + 4, *valueLimit = std::min(value + readU16(field + 2), extra + extraLength);
+            for (uint64_t *size : { &entry.size, &entry.compressedSize, &entry.offset }) {
+                if (*size != 0xffffffff || value + 8 > valueLimit) continue;
+                *size = readU64(value);
+                value += 8;
+            }
+        }
+        p = extra + extraLength + commentLength;
+
+        // Encrypted entries cannot be read. Like the JVM, the first of duplicate entries wins
+        std::string className;
+        if ((flags & 1) != 0 || !classNameFromPath(std::string(reinterpret_cast<const char *>(name), nameLength), className)) continue;
+        if (this->entries_.emplace(className, entry).second) this->classNames_.push_back(std::move(className));
+    }
 }
 
 std::shared_ptr<std::istream> JarClassPath::findClass(const std::string &name) {
-    std::string path = name;
-    std::replace(path.begin(), path.end(), '.', '/');
-    path += ".class";
-    zip_entry_open(this->zip_, path.c_str());
-
-    void *buf = nullptr;
-    size_t size = 0;
-    if (zip_entry_read(this->zip_, &buf, &size) <= 0) {
-        zip_entry_close(this->zip_);
+    auto it = this->entries_.find(name);
+    if (it == this->entries_.end()) return nullptr;
+    const Entry &entry = it->second;
+    if ((entry.method != Stored && entry.method != Deflated) || entry.size == 0 || (entry.method == Stored && entry.compressedSize != entry.size)) {
         return nullptr;
     }
 
-    std::shared_ptr<std::istream> stream = std::make_shared<ZipEntryIStream>(std::make_unique<ZipEntryStreamBuf>(buf, size));
-    zip_entry_close(this->zip_);
-    return stream;
+    // The local header repeats the name, and may have an extra field of its own, so only it tells where the data starts
+    const uint8_t *data = this->archive_->data();
+    uint64_t fileSize = this->archive_->size();
+    if (entry.offset > fileSize - LocalHeaderSize || readU32(data + entry.offset) != LocalHeaderSignature) return nullptr;
+    uint64_t dataOffset = entry.offset + LocalHeaderSize + readU16(data + entry.offset + 26) + readU16(data + entry.offset + 28);
+    if (dataOffset > fileSize || entry.compressedSize > fileSize - dataOffset) return nullptr;
+    const uint8_t *compressed = data + dataOffset;
+
+    if (entry.method == Stored) {
+        // Handed to the parser in place, without even a CRC pass; like the JDK's ZipFile, which does not check the CRC of
+        // stored entries either, malformed data is left for the parser to reject
+        return std::make_shared<ZipEntryIStream>(std::make_unique<ZipEntryStreamBuf>(reinterpret_cast<const char *>(compressed), entry.size, this->archive_));
+    }
+
+    auto buffer = std::make_shared<Archive::Buffer>(this->archive_, this->archive_->acquire(entry.size));
+    if (tinfl_decompress_mem_to_mem(buffer->data(), entry.size, compressed, entry.compressedSize, 0) != entry.size) return nullptr;
+    if (mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const uint8_t *>(buffer->data()), entry.size) != entry.crc32) return nullptr;
+    return std::make_shared<ZipEntryIStream>(std::make_unique<ZipEntryStreamBuf>(buffer->data(), entry.size, std::move(buffer)));
 }
 
+std::vector<std::string> JarClassPath::listClasses() { return this->classNames_; }
+
 } // namespace cjbp
@@ -1,14 +1,50 @@
 #include "cjbp/code_attribute.h"
 
-#include <optional>
+#include <algorithm>
 
+#include "cjbp/cache_slot_table.h"
+#include "cjbp/code_bitmap.h"
 #include "cjbp/code_iterator.h"
 #include "cjbp/control_flow_graph.h"
+#include "cjbp/descriptor.h"
+#include "cjbp/dominator_tree.h"
+#include "cjbp/liveness.h"
 #include "stream_util.h"
 #include "string_util.h"
+#include "type_util.h"
 
 namespace cjbp {
 
+namespace {
+
+/**
+ * Returns a lazily computed analysis, computing and publishing it on first use. Once published, this is a single acquire
+ * load. Threads that find the cache empty at the same time each compute the analysis, and all but the first to publish
+ * discard theirs, so every caller sees the same, fully built object; that duplicate work is rare, and is cheaper than
+ * taking a lock on every call.
+ */
+template<typename T, typename Build>
+CJBP_INLINE T *cached(std::atomic<T *> &cache, Build build) {
+    T *value = cache.load(std::memory_order_acquire);
+    if (value != nullptr) return value;
+
+    auto built = build();
+    if (cache.compare_exchange_strong(value, built.get(), std::memory_order_acq_rel, std::memory_order_acquire)) return built.release();
+    return value; // Published by another thread in the meantime
+}
+
+} // namespace
+
+ExceptionTableEntry ExceptionTableEntry::read(std::istream &s) {
+    uint16_t start = readBigEndian<uint16_t>(s);
+    uint16_t end = readBigEndian<uint16_t>(s);
+    uint16_t handler = readBigEndian<uint16_t>(s);
+    uint16_t catchType = readBigEndian<uint16_t>(s);
+    return { start, end, handler, catchType };
+}
+
+
+
 std::unique_ptr<CodeAttributeInfo> CodeAttributeInfo::read(std::istream &s, const ConstantPool &constantPool) {
     uint16_t maxStack = readBigEndian<uint16_t>(s);
     uint16_t maxLocals = readBigEndian<uint16_t>(s);
@@ -16,7 +52,9 @@ std::unique_ptr<CodeAttributeInfo> CodeAttributeInfo::read(std::istream &s, cons
     std::vector<uint8_t> code(codeLength);
     s.read(reinterpret_cast<char *>(code.data()), codeLength);
     uint16_t exceptionTableLength = readBigEndian<uint16_t>(s);
-    s.ignore(exceptionTableLength * 8);
+    std::vector<ExceptionTableEntry> exceptionTable;
+    exceptionTable.reserve(exceptionTableLength);
+    for (uint16_t i = 0; i < exceptionTableLength; i++) exceptionTable.push_back(ExceptionTableEntry::read(s));
     std::vector<std::unique_ptr<AttributeInfo>> attributes = AttributeInfo::readList(s, constantPool);
 
     StackMapTableAttributeInfo *stackMapTable = nullptr;
@@ -26,18 +64,49 @@ std::unique_ptr<CodeAttributeInfo> CodeAttributeInfo::read(std::istream &s, cons
             break;
         }
     }
-    return std::make_unique<CodeAttributeInfo>(maxStack, maxLocals, std::move(code), stackMapTable, std::move(attributes));
+    return std::make_unique<CodeAttributeInfo>(maxStack, maxLocals, std::move(code), std::move(exceptionTable), stackMapTable,
+                                               std::move(attributes));
 }
 
-CodeAttributeInfo::CodeAttributeInfo(uint16_t maxStack, uint16_t maxLocals, std::vector<uint8_t> code, StackMapTableAttributeInfo *stackMapTable,
-                                     std::vector<std::unique_ptr<AttributeInfo>> attributes) :
-    maxStack_(maxStack), maxLocals_(maxLocals), code_(std::move(code)), stackMapTable_(stackMapTable), attributes_(std::move(attributes)) { }
-CodeAttributeInfo::~CodeAttributeInfo() = default;
+CodeAttributeInfo::CodeAttributeInfo(uint16_t maxStack, uint16_t maxLocals, std::vector<uint8_t> code, std::vector<ExceptionTableEntry> exceptionTable,
+                                     StackMapTableAttributeInfo *stackMapTable, std::vector<std::unique_ptr<AttributeInfo>> attributes) :
+    maxStack_(maxStack), maxLocals_(maxLocals), code_(std::move(code)), exceptionTable_(std::move(exceptionTable)), stackMapTable_(stackMapTable),
+    attributes_(std::move(attributes)), bitmap_(nullptr), cfg_(nullptr), dominators_(nullptr), loops_(nullptr), liveness_(nullptr),
+    cacheSlots_(nullptr) { }
+CodeAttributeInfo::~CodeAttributeInfo() {
+    delete this->bitmap_.load(std::memory_order_relaxed);
+    delete this->cfg_.load(std::memory_order_relaxed);
+    delete this->dominators_.load(std::memory_order_relaxed);
+    delete this->loops_.load(std::memory_order_relaxed);
+    delete this->liveness_.load(std::memory_order_relaxed);
+    delete this->cacheSlots_.load(std::memory_order_relaxed);
+}
 
 CodeIterator CodeAttributeInfo::iterator() const { return CodeIterator(this->code_.data(), this->code_.size()); }
+InstructionRange CodeAttributeInfo::instructions() const { return this->iterator().instructions(); }
+CodeBitmap CodeAttributeInfo::scan() const { return CodeBitmap::scan(this->code_.data(), this->code_.size()); }
+const CodeBitmap &CodeAttributeInfo::bitmap() {
+    return *cached(this->bitmap_, [this] { return std::make_unique<CodeBitmap>(this->scan()); });
+}
+UncheckedCodeIterator CodeAttributeInfo::uncheckedIterator() {
+    this->bitmap();
+    return UncheckedCodeIterator(this->code_.data(), this->code_.size());
+}
+UncheckedInstructionRange CodeAttributeInfo::uncheckedInstructions() { return this->uncheckedIterator().instructions(); }
 ControlFlowGraph *CodeAttributeInfo::cfg() {
-    if (this->cfg_ == nullptr) this->cfg_ = ControlFlowGraph::build(*this);
-    return this->cfg_.get();
+    return cached(this->cfg_, [this] { return ControlFlowGraph::build(*this); });
+}
+const DominatorTree *CodeAttributeInfo::dominators() {
+    return cached(this->dominators_, [this] { return DominatorTree::build(*this->cfg()); });
+}
+const LoopNest *CodeAttributeInfo::loops() {
+    return cached(this->loops_, [this] { return LoopNest::build(*this->cfg(), *this->dominators()); });
+}
+const Liveness *CodeAttributeInfo::liveness() {
+    return cached(this->liveness_, [this] { return Liveness::build(*this); });
+}
+const CacheSlotTable *CodeAttributeInfo::cacheSlots() {
+    return cached(this->cacheSlots_, [this] { return CacheSlotTable::build(*this); });
 }
 
 std::string CodeAttributeInfo::toString(const ConstantPool &constantPool) {
@@ -50,6 +119,14 @@ std::string CodeAttributeInfo::toString(const ConstantPool &constantPool) {
         result += '\n';
         result += indent(std::to_string(index) + ": " + iterator.toString(index), 1);
     }
+    if (!this->exceptionTable_.empty()) {
+        result += "\nException Table:";
+        for (const ExceptionTableEntry &entry : this->exceptionTable_) {
+            result += '\n';
+            result += indent(std::to_string(entry.start()) + '-' + std::to_string(entry.end()) + " -> " + std::to_string(entry.handler()) + ' ' +
+                             (entry.isCatchAll() ? "any" : constantPool.class_(entry.catchType())), 1);
+        }
+    }
     for (const auto &attribute: this->attributes_) {
         result += '\n';
         result += attribute->toString(constantPool);
@@ -84,230 +161,189 @@ std::string VerificationTypeInfo::toString() const {
         case Tag::Double: return "Double";
         case Tag::Null: return "Null";
         case Tag::UninitializedThis: return "UninitializedThis";
-        case Tag::Object: return "Object [" + std::to_string(this->constantPoolIndex()) + ']';
+        case Tag::Object: return this->className_ != nullptr ? "Object " + *this->className_ : "Object [" + std::to_string(this->constantPoolIndex()) + ']';
         case Tag::Uninitialized: return "Uninitialized " + std::to_string(this->offset());
         default: return "Unknown";
     }
 }
 
-class StackMapFrame::Same : public StackMapFrame {
-public:
-    CJBP_INLINE static std::unique_ptr<Same> read(std::istream &s, Type type, uint8_t rawType);
-
-    CJBP_INLINE explicit Same(Type type, uint16_t offsetDelta, std::optional<VerificationTypeInfo> stack) :
-        type_(type), offsetDelta_(offsetDelta), stack_(std::move(stack)) { }
-    ~Same() override = default;
-
-    AbsoluteStackMapFrame apply(const AbsoluteStackMapFrame &previous) const override;
-    std::string toString() const override;
-
-private:
-    Type type_;
-    uint16_t offsetDelta_;
-    std::optional<VerificationTypeInfo> stack_;
-};
-
-class StackMapFrame::Chop : public StackMapFrame {
-public:
-    CJBP_INLINE static std::unique_ptr<Chop> read(std::istream &s, uint8_t rawType);
-
-    CJBP_INLINE Chop(uint16_t offsetDelta, uint8_t chopNum) : offsetDelta_(offsetDelta), chopNum_(chopNum) { }
-    ~Chop() override = default;
-
-    AbsoluteStackMapFrame apply(const AbsoluteStackMapFrame &previous) const override;
-    std::string toString() const override;
-
-private:
-    uint16_t offsetDelta_;
-    uint8_t chopNum_;
-};
-
-class StackMapFrame::Append : public StackMapFrame {
-public:
-    CJBP_INLINE static std::unique_ptr<Append> read(std::istream &s, uint8_t rawType);
-
-    CJBP_INLINE Append(uint16_t offsetDelta, std::vector<VerificationTypeInfo> locals) : offsetDelta_(offsetDelta), locals_(std::move(locals)) { }
-    ~Append() override = default;
-
-    AbsoluteStackMapFrame apply(const AbsoluteStackMapFrame &previous) const override;
-    std::string toString() const override;
-
-private:
-    uint16_t offsetDelta_;
-    std::vector<VerificationTypeInfo> locals_;
-};
-
-class StackMapFrame::Full : public StackMapFrame {
-public:
-    CJBP_INLINE static std::unique_ptr<Full> read(std::istream &s);
-
-    CJBP_INLINE Full(uint16_t offsetDelta, std::vector<VerificationTypeInfo> locals, std::vector<VerificationTypeInfo> stack) :
-        offsetDelta_(offsetDelta), locals_(std::move(locals)), stack_(std::move(stack)) { }
-    ~Full() override = default;
-
-    AbsoluteStackMapFrame apply(const AbsoluteStackMapFrame &previous) const override;
-    std::string toString() const override;
-
-private:
-    uint16_t offsetDelta_;
-    std::vector<VerificationTypeInfo> locals_;
-    std::vector<VerificationTypeInfo> stack_;
-};
-
-CJBP_INLINE std::unique_ptr<StackMapFrame::Same> StackMapFrame::Same::read(std::istream &s, Type type, uint8_t rawType) {
-    uint16_t offsetDelta;
-    std::optional<VerificationTypeInfo> stack;
-    switch (type) {
-        case Type::Same: offsetDelta = rawType; break;
-        case Type::SameExtended: offsetDelta = readBigEndian<uint16_t>(s); break;
-        case Type::SameLocals1StackItem: {
-            offsetDelta = rawType - 64;
-            stack = VerificationTypeInfo::read(s);
-            break;
-        }
-        case Type::SameLocals1StackItemExtended: {
-            offsetDelta = readBigEndian<uint16_t>(s);
-            stack = VerificationTypeInfo::read(s);
-            break;
-        }
-        default: throw std::invalid_argument("StackMapFrame::Same::parse: Invalid type");
+StackMapFrame StackMapFrame::read(std::istream &s, std::vector<VerificationTypeInfo> &types) {
+    uint8_t rawType = readBigEndian<uint8_t>(s);
+    uint32_t firstType = types.size();
+    if (rawType == 255) {
+        uint16_t offsetDelta = readBigEndian<uint16_t>(s);
+        uint16_t localCount = readBigEndian<uint16_t>(s);
+        for (uint16_t i = 0; i < localCount; i++) types.push_back(VerificationTypeInfo::read(s));
+        uint16_t stackCount = readBigEndian<uint16_t>(s);
+        for (uint16_t i = 0; i < stackCount; i++) types.push_back(VerificationTypeInfo::read(s));
+        return { Type::Full, offsetDelta, 0, firstType, localCount, stackCount };
     }
-    return std::make_unique<Same>(type, offsetDelta, std::move(stack));
-}
-
-CJBP_INLINE std::unique_ptr<StackMapFrame::Chop> StackMapFrame::Chop::read(std::istream &s, uint8_t rawType) {
-    return std::make_unique<Chop>(readBigEndian<uint16_t>(s), 251 - rawType);
-}
-
-CJBP_INLINE std::unique_ptr<StackMapFrame::Append> StackMapFrame::Append::read(std::istream &s, uint8_t rawType) {
-    uint16_t offsetDelta = readBigEndian<uint16_t>(s);
-    uint8_t numLocals = rawType - 251;
-    std::vector<VerificationTypeInfo> locals;
-    for (uint8_t i = 0; i < numLocals; i++)
-        locals.push_back(VerificationTypeInfo::read(s));
-    return std::make_unique<Append>(offsetDelta, std::move(locals));
-}
-
-CJBP_INLINE std::unique_ptr<StackMapFrame::Full> StackMapFrame::Full::read(std::istream &s) {
-    uint16_t offsetDelta = readBigEndian<uint16_t>(s);
-    uint16_t numLocals = readBigEndian<uint16_t>(s);
-    std::vector<VerificationTypeInfo> locals;
-    locals.reserve(numLocals);
-    for (uint16_t i = 0; i < numLocals; i++) {
-        locals[i] = VerificationTypeInfo::read(s);
+    if (rawType >= 252) {
+        uint16_t offsetDelta = readBigEndian<uint16_t>(s);
+        uint8_t localCount = rawType - 251;
+        for (uint8_t i = 0; i < localCount; i++) types.push_back(VerificationTypeInfo::read(s));
+        return { Type::Append, offsetDelta, 0, firstType, localCount, 0 };
     }
-    uint16_t numStack = readBigEndian<uint16_t>(s);
-    std::vector<VerificationTypeInfo> stack;
-    stack.reserve(numStack);
-    for (uint16_t i = 0; i < numStack; i++) {
-        stack[i] = VerificationTypeInfo::read(s);
+    if (rawType == 251) return { Type::SameExtended, readBigEndian<uint16_t>(s), 0, firstType, 0, 0 };
+    if (rawType >= 248) return { Type::Chop, readBigEndian<uint16_t>(s), static_cast<uint8_t>(251 - rawType), firstType, 0, 0 };
+    if (rawType == 247) {
+        uint16_t offsetDelta = readBigEndian<uint16_t>(s);
+        types.push_back(VerificationTypeInfo::read(s));
+        return { Type::SameLocals1StackItemExtended, offsetDelta, 0, firstType, 0, 1 };
     }
-    return std::make_unique<Full>(offsetDelta, std::move(locals), std::move(stack));
-}
-
-namespace {
-
-CJBP_INLINE uint32_t applyOffsetDelta(uint32_t start, uint16_t offsetDelta) {
-    // As per https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.7.4, the all but the first frame
-    // use the formula start + offsetDelta + 1 to calculate the start of the frame, the first frame uses start +
-    // offsetDelta.
-    return start + offsetDelta + (start == 0 ? 0 : 1);
-}
-
-} // namespace
-
-AbsoluteStackMapFrame StackMapFrame::Same::apply(const AbsoluteStackMapFrame &previous) const {
-    std::vector<VerificationTypeInfo> stack;
-    if (this->stack_.has_value()) stack.push_back(this->stack_.value());
-    return { applyOffsetDelta(previous.start(), this->offsetDelta_), previous.localsPtr(), stack };
-}
-
-AbsoluteStackMapFrame StackMapFrame::Chop::apply(const AbsoluteStackMapFrame &previous) const {
-    if (this->chopNum_ >= previous.locals().size()) {
-        throw CorruptClassFile("StackMapFrame::Chop::apply: Invalid chopNum");
+    if (rawType >= 128) throw CorruptClassFile("StackMapFrame::read: Reserved frame type");
+    if (rawType >= 64) {
+        types.push_back(VerificationTypeInfo::read(s));
+        return { Type::SameLocals1StackItem, static_cast<uint16_t>(rawType - 64), 0, firstType, 0, 1 };
     }
-    auto locals = std::make_shared<std::vector<VerificationTypeInfo>>();
-    locals->reserve(previous.locals().size() - this->chopNum_);
-    locals->insert(locals->end(), previous.locals().begin(), previous.locals().end() - this->chopNum_);
-    return { applyOffsetDelta(previous.start(), this->offsetDelta_), std::move(locals), previous.stack() };
-}
-
-AbsoluteStackMapFrame StackMapFrame::Append::apply(const AbsoluteStackMapFrame &previous) const {
-    auto locals = std::make_shared<std::vector<VerificationTypeInfo>>();
-    locals->reserve(previous.locals().size() + this->locals_.size());
-    locals->insert(locals->end(), previous.locals().begin(), previous.locals().end());
-    locals->insert(locals->end(), this->locals_.begin(), this->locals_.end());
-    return { applyOffsetDelta(previous.start(), this->offsetDelta_), std::move(locals), previous.stack() };
+    return { Type::Same, rawType, 0, firstType, 0, 0 };
 }
 
-AbsoluteStackMapFrame StackMapFrame::Full::apply(const AbsoluteStackMapFrame &previous) const {
-    auto locals = std::make_shared<std::vector<VerificationTypeInfo>>(this->locals_);
-    return { applyOffsetDelta(previous.start(), this->offsetDelta_), std::move(locals), this->stack_ };
-}
-
-std::string StackMapFrame::Same::toString() const {
+std::string StackMapFrame::toString() const {
+    std::string result;
     switch (this->type_) {
-        case Type::Same: return "Same: offsetDelta=" + std::to_string(this->offsetDelta_);
-        case Type::SameExtended: return "Same Extended: offsetDelta=" + std::to_string(this->offsetDelta_);
-        case Type::SameLocals1StackItem:
-            return "Same Locals 1 Stack Item: offsetDelta=" + std::to_string(this->offsetDelta_) + ", info=" + this->stack_->toString();
-        case Type::SameLocals1StackItemExtended:
-            return "Same Locals 1 Stack Item Extended: offsetDelta=" + std::to_string(this->offsetDelta_) + ", info=" + this->stack_->toString();
-        default: throw std::invalid_argument("StackMapFrame::Same::toString: Invalid type");
+        case Type::Same: result = "Same: offsetDelta="; break;
+        case Type::SameExtended: result = "Same Extended: offsetDelta="; break;
+        case Type::SameLocals1StackItem: result = "Same Locals 1 Stack Item: offsetDelta="; break;
+        case Type::SameLocals1StackItemExtended: result = "Same Locals 1 Stack Item Extended: offsetDelta="; break;
+        case Type::Chop: return "Chop: offsetDelta=" + std::to_string(this->offsetDelta_) + ", chopNum=" + std::to_string(this->chopCount_);
+        case Type::Append: result = "Append: offsetDelta="; break;
+        case Type::Full: result = "Full: offsetDelta="; break;
+        default: throw std::invalid_argument("StackMapFrame::toString: Invalid type");
     }
-}
-
-std::string StackMapFrame::Chop::toString() const {
-    return "Chop: offsetDelta=" + std::to_string(this->offsetDelta_) + ", chopNum=" + std::to_string(this->chopNum_);
-}
-
-std::string StackMapFrame::Append::toString() const {
-    std::string result = "Append: offsetDelta=" + std::to_string(this->offsetDelta_);
-    for (const auto &local: this->locals_) {
-        result += '\n';
-        result += indent(local.toString(), 1);
+    result += std::to_string(this->offsetDelta_);
+    if (this->type_ == Type::SameLocals1StackItem || this->type_ == Type::SameLocals1StackItemExtended) {
+        return result + ", info=" + this->stack()[0].toString();
     }
-    return result;
-}
-
-std::string StackMapFrame::Full::toString() const {
-    std::string result = "Full: offsetDelta=" + std::to_string(this->offsetDelta_);
-    for (const auto &local: this->locals_) {
+    for (const auto &local: this->locals()) {
         result += '\n';
         result += indent(local.toString(), 1);
     }
-    for (const auto &stack: this->stack_) {
+    for (const auto &stack: this->stack()) {
         result += '\n';
         result += indent(stack.toString(), 1);
     }
     return result;
 }
 
-std::unique_ptr<StackMapFrame> StackMapFrame::read(std::istream &s) {
-    uint8_t rawType = readBigEndian<uint8_t>(s);
-    if (rawType == 255) return Full::read(s);
-    if (rawType >= 252) return Append::read(s, rawType);
-    if (rawType == 251) return Same::read(s, Type::SameExtended, rawType);
-    if (rawType >= 248) return Chop::read(s, rawType);
-    if (rawType == 247) return Same::read(s, Type::SameLocals1StackItemExtended, rawType);
-    if (rawType >= 64) return Same::read(s, Type::SameLocals1StackItem, rawType);
-    return Same::read(s, Type::Same, rawType);
-}
-
 std::unique_ptr<StackMapTableAttributeInfo> StackMapTableAttributeInfo::read(std::istream &s) {
     uint16_t entryCount = readBigEndian<uint16_t>(s);
-    std::vector<std::unique_ptr<StackMapFrame>> entries(entryCount);
+    std::vector<StackMapFrame> entries;
+    std::vector<VerificationTypeInfo> types;
+    entries.reserve(entryCount);
     for (uint16_t i = 0; i < entryCount; i++) {
-        entries[i] = StackMapFrame::read(s);
+        entries.push_back(StackMapFrame::read(s, types));
+    }
+    return std::make_unique<StackMapTableAttributeInfo>(std::move(entries), std::move(types));
+}
+
+/**
+ * The frames of a StackMapTable in absolute form. Their types point into the table, or into the locals of the previous
+ * frame, which Same and Chop frames keep or shorten; only Append frames need new locals, which are packed in one array,
+ * sized up front so that it never moves.
+ */
+struct StackMapTableAttributeInfo::Absolute {
+    std::vector<AbsoluteStackMapFrame> frames;
+    std::vector<VerificationTypeInfo> types;
+};
+
+StackMapTableAttributeInfo::StackMapTableAttributeInfo(std::vector<StackMapFrame> entries, std::vector<VerificationTypeInfo> types) :
+    entries_(std::move(entries)), types_(std::move(types)), absolute_(nullptr) {
+    for (StackMapFrame &entry : this->entries_) {
+        if (entry.firstType_ + entry.localCount_ + entry.stackCount_ > this->types_.size()) {
+            throw std::invalid_argument("StackMapTableAttributeInfo: Frame types out of range");
+        }
+        entry.types_ = this->types_.data();
     }
-    return std::make_unique<StackMapTableAttributeInfo>(std::move(entries));
+}
+
+StackMapTableAttributeInfo::~StackMapTableAttributeInfo() { delete this->absolute_.load(std::memory_order_relaxed); }
+
+Span<AbsoluteStackMapFrame> StackMapTableAttributeInfo::frames() const {
+    const Absolute *absolute = cached(this->absolute_, [this] {
+        auto result = std::make_unique<Absolute>();
+        uint32_t localCount = this->initialLocals_.size();
+        uint32_t appendedCount = 0;
+        for (const StackMapFrame &entry : this->entries_) {
+            switch (entry.type()) {
+                case StackMapFrame::Type::Chop: {
+                    if (entry.chopCount() > localCount) throw CorruptClassFile("StackMapTableAttributeInfo::frames: Invalid chop count");
+                    localCount -= entry.chopCount();
+                    break;
+                }
+                case StackMapFrame::Type::Append: {
+                    localCount += entry.locals().size();
+                    appendedCount += localCount;
+                    break;
+                }
+                case StackMapFrame::Type::Full: localCount = entry.locals().size(); break;
+                default: break;
+            }
+        }
+
+        result->frames.reserve(this->entries_.size());
+        result->types.reserve(appendedCount);
+        AbsoluteStackMapFrame frame;
+        for (const StackMapFrame &entry : this->entries_) {
+            // The first frame starts at its offset delta, and every other frame offset delta + 1 after the previous one
+            // (JVMS 4.7.4). The first frame may itself start at 0, so it is told apart by the previous frame being the
+            // implicit initial frame rather than by its start.
+            uint32_t start = frame.isInitial() ? entry.offsetDelta() : frame.start() + entry.offsetDelta() + 1;
+            Span<VerificationTypeInfo> locals = frame.isInitial() ? Span<VerificationTypeInfo>(this->initialLocals_.data(), this->initialLocals_.size())
+                                                                  : frame.locals();
+            switch (entry.type()) {
+                case StackMapFrame::Type::Chop: locals = { locals.data(), locals.size() - entry.chopCount() }; break;
+                case StackMapFrame::Type::Append: {
+                    const VerificationTypeInfo *appended = result->types.data() + result->types.size();
+                    result->types.insert(result->types.end(), locals.begin(), locals.end());
+                    result->types.insert(result->types.end(), entry.locals().begin(), entry.locals().end());
+                    locals = { appended, locals.size() + entry.locals().size() };
+                    break;
+                }
+                case StackMapFrame::Type::Full: locals = entry.locals(); break;
+                default: break;
+            }
+            frame = AbsoluteStackMapFrame(start, locals, entry.stack());
+            result->frames.push_back(frame);
+        }
+        return result;
+    });
+    return { absolute->frames.data(), static_cast<uint32_t>(absolute->frames.size()) };
+}
+
+void StackMapTableAttributeInfo::setInitialFrame(uint16_t thisClass, bool isStatic, bool constructor, const MethodDescriptor &descriptor) {
+    this->initialLocals_.clear();
+    this->initialClassNames_.clear();
+    this->initialClassNames_.reserve(descriptor.params().size()); // Never moves, as the locals point into it
+    if (!isStatic) this->initialLocals_.push_back(constructor ? VerificationTypeInfo(VerificationTypeInfo::Tag::UninitializedThis)
+                                                              : VerificationTypeInfo(VerificationTypeInfo::Tag::Object, thisClass));
+    for (const Descriptor &parameter : descriptor.params()) {
+        switch (parameter.isArray() ? Descriptor::Type::Object : parameter.type()) {
+            case Descriptor::Type::Float: this->initialLocals_.push_back(VerificationTypeInfo::Tag::Float); break;
+            case Descriptor::Type::Long: this->initialLocals_.push_back(VerificationTypeInfo::Tag::Long); break;
+            case Descriptor::Type::Double: this->initialLocals_.push_back(VerificationTypeInfo::Tag::Double); break;
+            case Descriptor::Type::Object: {
+                this->initialClassNames_.push_back(referenceName(parameter));
+                this->initialLocals_.push_back(VerificationTypeInfo(&this->initialClassNames_.back()));
+                break;
+            }
+            default: this->initialLocals_.push_back(VerificationTypeInfo::Tag::Integer); break;
+        }
+    }
+}
+
+const AbsoluteStackMapFrame *StackMapTableAttributeInfo::frameAt(uint32_t index) const {
+    Span<AbsoluteStackMapFrame> frames = this->frames();
+    auto next = std::upper_bound(frames.begin(), frames.end(), index,
+                                 [](uint32_t index, const AbsoluteStackMapFrame &frame) { return index < frame.start(); });
+    return next == frames.begin() ? nullptr : next - 1;
 }
 
 std::string StackMapTableAttributeInfo::toString(const ConstantPool &constantPool) {
     std::string result;
     for (const auto &entry: this->entries_) {
         result += '\n';
-        result += indent(entry->toString(), 1);
+        result += indent(entry.toString(), 1);
     }
     return "Stack Map Table Attribute:" + result;
 }
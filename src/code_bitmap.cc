@@ -0,0 +1,96 @@
+#include "cjbp/code_bitmap.h"
+
+#include "cjbp/code_iterator.h"
+#include "cjbp/exception.h"
+#include "opcode_util.h"
+
+namespace cjbp {
+
+namespace {
+
+CJBP_INLINE void addTarget(BitSet &targets, uint32_t size, uint32_t index, int32_t offset) {
+    int64_t target = static_cast<int64_t>(index) + offset;
+    if (target < 0 || target >= size) throw CorruptClassFile("CodeBitmap::scan: Jump target out of bounds");
+    targets.set(static_cast<uint32_t>(target));
+}
+
+} // namespace
+
+CodeBitmap CodeBitmap::scan(const uint8_t *code, uint32_t size) {
+    // Every read below is bounds-checked by hand before it happens, so the iterator does not need to check again.
+    UncheckedCodeIterator iterator(code, size);
+    BitSet starts(size);
+    BitSet targets(size);
+    uint32_t count = 0;
+
+    uint32_t index = 0;
+    while (index < size) {
+        starts.set(index);
+        count++;
+
+        uint8_t opcode = code[index];
+        uint64_t width = OpcodeWidth[opcode];
+        switch (OpcodeBranchKind[opcode]) {
+            case BranchKind::None: {
+                if (width != 0) break;
+                if (opcode != Opcode::Wide) throw CorruptClassFile("CodeBitmap::scan: Invalid opcode");
+                if (index + 1 >= size || !isWideModifiable(code[index + 1])) throw CorruptClassFile("CodeBitmap::scan: Invalid wide instruction");
+                width = wideWidth(code[index + 1]);
+                break;
+            }
+            case BranchKind::Branch16: {
+                if (index + width > size) break;
+                addTarget(targets, size, index, iterator.read<int16_t>(index + 1));
+                break;
+            }
+            case BranchKind::Branch32: {
+                if (index + width > size) break;
+                addTarget(targets, size, index, iterator.read<int32_t>(index + 1));
+                break;
+            }
+            case BranchKind::Switch: {
+                uint64_t operands = switchOperandsIndex(index);
+                if (operands + 8 > size) throw CorruptClassFile("CodeBitmap::scan: Truncated switch");
+
+                // tableswitch: default, low, high, then one 32-bit jump offset per entry.
+                // lookupswitch: default, npairs, then a 32-bit match followed by a 32-bit jump offset per entry.
+                uint64_t header;
+                uint64_t entries;
+                uint64_t entryStride;
+                if (opcode == Opcode::TableSwitch) {
+                    if (operands + 12 > size) throw CorruptClassFile("CodeBitmap::scan: Truncated switch");
+                    int32_t low = iterator.read<int32_t>(operands + 4);
+                    int32_t high = iterator.read<int32_t>(operands + 8);
+                    if (high < low) throw CorruptClassFile("CodeBitmap::scan: Invalid tableswitch bounds");
+                    header = 12;
+                    entries = static_cast<int64_t>(high) - low + 1;
+                    entryStride = 4;
+                } else {
+                    int32_t npairs = iterator.read<int32_t>(operands + 4);
+                    if (npairs < 0) throw CorruptClassFile("CodeBitmap::scan: Invalid lookupswitch pair count");
+                    header = 8;
+                    entries = npairs;
+                    entryStride = 8;
+                }
+                uint64_t end = operands + header + entries * entryStride;
+                if (end > size) throw CorruptClassFile("CodeBitmap::scan: Truncated switch");
+                width = end - index;
+
+                addTarget(targets, size, index, iterator.read<int32_t>(operands));
+                for (uint64_t jump = operands + header + entryStride - 4; jump < end; jump += entryStride) {
+                    addTarget(targets, size, index, iterator.read<int32_t>(jump));
+                }
+                break;
+            }
+        }
+
+        if (index + width > size) throw CorruptClassFile("CodeBitmap::scan: Instruction extends past end of code");
+        index += width;
+    }
+
+    // Checked a word at a time once the walk is done, rather than per jump, since targets may point forwards.
+    if (targets.hasBitsOutside(starts)) throw CorruptClassFile("CodeBitmap::scan: Jump target is not the start of an instruction");
+    return { std::move(starts), std::move(targets), count };
+}
+
+} // namespace cjbp
@@ -4,37 +4,67 @@
 #include <stdexcept>
 
 #include "cjbp/descriptor.h"
+#include "cjbp/exception.h"
+#include "opcode_util.h"
 #include "string_util.h"
 
 namespace cjbp {
 
 namespace {
 
-constexpr uint8_t OpcodeWidth[] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1,
-                                    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-                                    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-                                    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 1, 1, 1,
-                                    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 2,
-                                    0, 0, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3, 5, 5, 3, 2, 3, 1, 1, 3, 3, 1, 1, 0, 4, 3, 3, 5, 5 };
+constexpr const char *OpcodeNames[256] = {
+    "nop", "aconst_null", "iconst_m1", "iconst_0", "iconst_1", "iconst_2", "iconst_3", "iconst_4", "iconst_5", "lconst_0", "lconst_1", "fconst_0",
+    "fconst_1", "fconst_2", "dconst_0", "dconst_1", "bipush", "sipush", "ldc", "ldc_w", "ldc2_w", "iload", "lload", "fload", "dload", "aload",
+    "iload_0", "iload_1", "iload_2", "iload_3", "lload_0", "lload_1", "lload_2", "lload_3", "fload_0", "fload_1", "fload_2", "fload_3", "dload_0",
+    "dload_1", "dload_2", "dload_3", "aload_0", "aload_1", "aload_2", "aload_3", "iaload", "laload", "faload", "daload", "aaload", "baload", "caload",
+    "saload", "istore", "lstore", "fstore", "dstore", "astore", "istore_0", "istore_1", "istore_2", "istore_3", "lstore_0", "lstore_1", "lstore_2",
+    "lstore_3", "fstore_0", "fstore_1", "fstore_2", "fstore_3", "dstore_0", "dstore_1", "dstore_2", "dstore_3", "astore_0", "astore_1", "astore_2",
+    "astore_3", "iastore", "lastore", "fastore", "dastore", "aastore", "bastore", "castore", "sastore", "pop", "pop2", "dup", "dup_x1", "dup_x2",
+    "dup2", "dup2_x1", "dup2_x2", "swap", "iadd", "ladd", "fadd", "dadd", "isub", "lsub", "fsub", "dsub", "imul", "lmul", "fmul", "dmul", "idiv",
+    "ldiv", "fdiv", "ddiv", "irem", "lrem", "frem", "drem", "ineg", "lneg", "fneg", "dneg", "ishl", "lshl", "ishr", "lshr", "iushr", "lushr", "iand",
+    "land", "ior", "lor", "ixor", "lxor", "iinc", "i2l", "i2f", "i2d", "l2i", "l2f", "l2d", "f2i", "f2l", "f2d", "d2i", "d2l", "d2f", "i2b", "i2c",
+    "i2s", "lcmp", "fcmpl", "fcmpg", "dcmpl", "dcmpg", "ifeq", "ifne", "iflt", "ifge", "ifgt", "ifle", "if_icmpeq", "if_icmpne", "if_icmplt",
+    "if_icmpge", "if_icmpgt", "if_icmple", "if_acmpeq", "if_acmpne", "goto", "jsr", "ret", "tableswitch", "lookupswitch", "ireturn", "lreturn",
+    "freturn", "dreturn", "areturn", "return", "getstatic", "putstatic", "getfield", "putfield", "invokevirtual", "invokespecial", "invokestatic",
+    "invokeinterface", "invokedynamic", "new", "newarray", "anewarray", "arraylength", "athrow", "checkcast", "instanceof", "monitorenter",
+    "monitorexit", "wide", "multianewarray", "ifnull", "ifnonnull", "goto_w", "jsr_w", "breakpoint", nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "impdep1",
+    "impdep2",
+};
+
+/// Reads an operand that has already been bounds-checked.
+template<typename T>
+CJBP_INLINE T load(const uint8_t *code, uint32_t index) {
+    return toBigEndian(*reinterpret_cast<const T *>(code + index));
+}
 
 } // namespace
 
-uint32_t CodeIterator::next() {
-    if (this->position_ >= this->size_) throw std::out_of_range("CodeIterator::next: End of code");
+const char *opcodeName(uint8_t opcode) { return OpcodeNames[opcode]; }
+
+template<typename Access>
+uint32_t BasicCodeIterator<Access>::next() {
+    if constexpr (Access::Checked) {
+        if (this->position_ >= this->size_) throw std::out_of_range("CodeIterator::next: End of code");
+    }
 
     uint32_t result = this->position_;
     uint8_t opcode = this->code_[result];
-    uint8_t width = opcode < sizeof(OpcodeWidth) ? OpcodeWidth[opcode] : 0;
+    uint8_t width = OpcodeWidth[opcode];
     if (width == 0) {
         if (opcode == Opcode::TableSwitch) {
-            uint32_t paddedIndex = (result + 4) & ~0x3;
+            uint32_t paddedIndex = switchOperandsIndex(result);
             uint32_t low = this->read<uint32_t>(paddedIndex + 4);
             uint32_t high = this->read<uint32_t>(paddedIndex + 8);
             this->position_ = paddedIndex + 12 + (high - low + 1) * 4;
         } else if (opcode == Opcode::LookupSwitch) {
-            uint32_t paddedIndex = (result + 4) & ~0x3;
+            uint32_t paddedIndex = switchOperandsIndex(result);
             uint32_t npairs = this->read<uint32_t>(paddedIndex + 4);
             this->position_ = paddedIndex + 8 + npairs * 8;
+        } else if (opcode == Opcode::Wide) {
+            this->position_ += wideWidth((*this)[result + 1]);
         } else {
             throw std::runtime_error("CodeIterator::next: Unimplemented opcode");
         }
@@ -45,246 +75,126 @@ uint32_t CodeIterator::next() {
     return result;
 }
 
-std::string CodeIterator::toString(uint32_t index) const {
-    uint8_t opcode = this->code_[index];
-    switch (opcode) {
-        case Opcode::Nop: return "nop";
-        case Opcode::AConstNull: return "aconst_null";
-        case Opcode::IConstM1: return "iconst_m1";
-        case Opcode::IConst0: return "iconst_0";
-        case Opcode::IConst1: return "iconst_1";
-        case Opcode::IConst2: return "iconst_2";
-        case Opcode::IConst3: return "iconst_3";
-        case Opcode::IConst4: return "iconst_4";
-        case Opcode::IConst5: return "iconst_5";
-        case Opcode::LConst0: return "lconst_0";
-        case Opcode::LConst1: return "lconst_1";
-        case Opcode::FConst0: return "fconst_0";
-        case Opcode::FConst1: return "fconst_1";
-        case Opcode::FConst2: return "fconst_2";
-        case Opcode::DConst0: return "dconst_0";
-        case Opcode::DConst1: return "dconst_1";
-        case Opcode::BiPush: return "bipush " + std::to_string(this->code_[index + 1]);
-        case Opcode::SiPush: return "sipush " + std::to_string(this->read<uint16_t>(index + 1));
-        case Opcode::Ldc: return "ldc [" + std::to_string(this->code_[index + 1]) + ']';
-        case Opcode::LdcW: return "ldc_w [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::Ldc2W: return "ldc2_w [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::ILoad: return "iload " + std::to_string(this->code_[index + 1]);
-        case Opcode::LLoad: return "lload " + std::to_string(this->code_[index + 1]);
-        case Opcode::FLoad: return "fload " + std::to_string(this->code_[index + 1]);
-        case Opcode::DLoad: return "dload " + std::to_string(this->code_[index + 1]);
-        case Opcode::ALoad: return "aload " + std::to_string(this->code_[index + 1]);
-        case Opcode::ILoad0: return "iload_0";
-        case Opcode::ILoad1: return "iload_1";
-        case Opcode::ILoad2: return "iload_2";
-        case Opcode::ILoad3: return "iload_3";
-        case Opcode::LLoad0: return "lload_0";
-        case Opcode::LLoad1: return "lload_1";
-        case Opcode::LLoad2: return "lload_2";
-        case Opcode::LLoad3: return "lload_3";
-        case Opcode::FLoad0: return "fload_0";
-        case Opcode::FLoad1: return "fload_1";
-        case Opcode::FLoad2: return "fload_2";
-        case Opcode::FLoad3: return "fload_3";
-        case Opcode::DLoad0: return "dload_0";
-        case Opcode::DLoad1: return "dload_1";
-        case Opcode::DLoad2: return "dload_2";
-        case Opcode::DLoad3: return "dload_3";
-        case Opcode::ALoad0: return "aload_0";
-        case Opcode::ALoad1: return "aload_1";
-        case Opcode::ALoad2: return "aload_2";
-        case Opcode::ALoad3: return "aload_3";
-        case Opcode::IALoad: return "iaload";
-        case Opcode::LALoad: return "laload";
-        case Opcode::FALoad: return "faload";
-        case Opcode::DALoad: return "daload";
-        case Opcode::AALoad: return "aaload";
-        case Opcode::BALoad: return "baload";
-        case Opcode::CALoad: return "caload";
-        case Opcode::SALoad: return "saload";
-        case Opcode::IStore: return "istore " + std::to_string(this->code_[index + 1]);
-        case Opcode::LStore: return "lstore " + std::to_string(this->code_[index + 1]);
-        case Opcode::FStore: return "fstore " + std::to_string(this->code_[index + 1]);
-        case Opcode::DStore: return "dstore " + std::to_string(this->code_[index + 1]);
-        case Opcode::AStore: return "astore " + std::to_string(this->code_[index + 1]);
-        case Opcode::IStore0: return "istore_0";
-        case Opcode::IStore1: return "istore_1";
-        case Opcode::IStore2: return "istore_2";
-        case Opcode::IStore3: return "istore_3";
-        case Opcode::LStore0: return "lstore_0";
-        case Opcode::LStore1: return "lstore_1";
-        case Opcode::LStore2: return "lstore_2";
-        case Opcode::LStore3: return "lstore_3";
-        case Opcode::FStore0: return "fstore_0";
-        case Opcode::FStore1: return "fstore_1";
-        case Opcode::FStore2: return "fstore_2";
-        case Opcode::FStore3: return "fstore_3";
-        case Opcode::DStore0: return "dstore_0";
-        case Opcode::DStore1: return "dstore_1";
-        case Opcode::DStore2: return "dstore_2";
-        case Opcode::DStore3: return "dstore_3";
-        case Opcode::AStore0: return "astore_0";
-        case Opcode::AStore1: return "astore_1";
-        case Opcode::AStore2: return "astore_2";
-        case Opcode::AStore3: return "astore_3";
-        case Opcode::IAStore: return "iastore";
-        case Opcode::LAStore: return "lastore";
-        case Opcode::FAStore: return "fastore";
-        case Opcode::DAStore: return "dastore";
-        case Opcode::AAStore: return "aastore";
-        case Opcode::BAStore: return "bastore";
-        case Opcode::CAStore: return "castore";
-        case Opcode::SAStore: return "sastore";
-        case Opcode::Pop: return "pop";
-        case Opcode::Pop2: return "pop2";
-        case Opcode::Dup: return "dup";
-        case Opcode::DupX1: return "dup_x1";
-        case Opcode::DupX2: return "dup_x2";
-        case Opcode::Dup2: return "dup2";
-        case Opcode::Dup2X1: return "dup2_x1";
-        case Opcode::Dup2X2: return "dup2_x2";
-        case Opcode::Swap: return "swap";
-        case Opcode::IAdd: return "iadd";
-        case Opcode::LAdd: return "ladd";
-        case Opcode::FAdd: return "fadd";
-        case Opcode::DAdd: return "dadd";
-        case Opcode::ISub: return "isub";
-        case Opcode::LSub: return "lsub";
-        case Opcode::FSub: return "fsub";
-        case Opcode::DSub: return "dsub";
-        case Opcode::IMul: return "imul";
-        case Opcode::LMul: return "lmul";
-        case Opcode::FMul: return "fmul";
-        case Opcode::DMul: return "dmul";
-        case Opcode::IDiv: return "idiv";
-        case Opcode::LDiv: return "ldiv";
-        case Opcode::FDiv: return "fdiv";
-        case Opcode::DDiv: return "ddiv";
-        case Opcode::IRem: return "irem";
-        case Opcode::LRem: return "lrem";
-        case Opcode::FRem: return "frem";
-        case Opcode::DRem: return "drem";
-        case Opcode::INeg: return "ineg";
-        case Opcode::LNeg: return "lneg";
-        case Opcode::FNeg: return "fneg";
-        case Opcode::DNeg: return "dneg";
-        case Opcode::IShl: return "ishl";
-        case Opcode::LShl: return "lshl";
-        case Opcode::IShr: return "ishr";
-        case Opcode::LShr: return "lshr";
-        case Opcode::IUShr: return "iushr";
-        case Opcode::LUShr: return "lushr";
-        case Opcode::IAnd: return "iand";
-        case Opcode::LAnd: return "land";
-        case Opcode::IOr: return "ior";
-        case Opcode::LOr: return "lor";
-        case Opcode::IXor: return "ixor";
-        case Opcode::LXor: return "lxor";
-        case Opcode::IInc: return "iinc " + std::to_string(this->code_[index + 1]) + ' ' + std::to_string(this->code_[index + 2]);
-        case Opcode::I2L: return "i2l";
-        case Opcode::I2F: return "i2f";
-        case Opcode::I2D: return "i2d";
-        case Opcode::L2I: return "l2i";
-        case Opcode::L2F: return "l2f";
-        case Opcode::L2D: return "l2d";
-        case Opcode::F2I: return "f2i";
-        case Opcode::F2L: return "f2l";
-        case Opcode::F2D: return "f2d";
-        case Opcode::D2I: return "d2i";
-        case Opcode::D2L: return "d2l";
-        case Opcode::D2F: return "d2f";
-        case Opcode::I2B: return "i2b";
-        case Opcode::I2C: return "i2c";
-        case Opcode::I2S: return "i2s";
-        case Opcode::LCmp: return "lcmp";
-        case Opcode::FCmpL: return "fcmpl";
-        case Opcode::FCmpG: return "fcmpg";
-        case Opcode::DCmpL: return "dcmpl";
-        case Opcode::DCmpG: return "dcmpg";
-        case Opcode::IfEq: return "ifeq @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfNe: return "ifne @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfLt: return "iflt @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfGe: return "ifge @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfGt: return "ifgt @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfLe: return "ifle @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfICmpEq: return "if_icmpeq @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfICmpNe: return "if_icmpne @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfICmpLt: return "if_icmplt @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfICmpGe: return "if_icmpge @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfICmpGt: return "if_icmpgt @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfICmpLe: return "if_icmple @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfACmpEq: return "if_acmpeq @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfACmpNe: return "if_acmpne @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::Goto: return "goto @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::Jsr: return "jsr @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::Ret: return "ret " + std::to_string(this->code_[index + 1]);
-        case Opcode::TableSwitch: {
-            uint32_t paddedIndex = (index + 4) & ~3;
-            uint32_t defaultAddress = index + this->read<int32_t>(paddedIndex);
-            uint32_t low = this->read<int32_t>(paddedIndex + 4);
-            uint32_t high = this->read<int32_t>(paddedIndex + 8);
-            std::string result = "tableswitch " + std::to_string(low) + " to " + std::to_string(high) + " default @" + std::to_string(defaultAddress);
-            for (uint32_t i = 0; i < high - low + 1; i++) {
-                uint32_t address = index + this->read<int32_t>(paddedIndex + 12 + i * 4);
-                result += '\n';
-                result += indent(std::to_string(low + i) + ": @" + std::to_string(address), 1);
+template<typename Access>
+Instruction BasicCodeIterator<Access>::decode(uint32_t index) const {
+    uint8_t opcode = (*this)[index];
+    uint32_t length = OpcodeWidth[opcode];
+    // Checking the extent of the whole instruction up front covers every operand read below. Switches and wide
+    // instructions, whose length depends on their operands, are checked once their length is known.
+    if (length != 0) Access::check(index, length, this->size_);
+    switch (OpcodeEncoding[opcode]) {
+        case OperandEncoding::None: return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::None, false, 0, 0 };
+        case OperandEncoding::Local8:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Local, false, this->code_[index + 1], 0 };
+        case OperandEncoding::ImplicitLocal:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Local, false, implicitLocal(opcode), 0 };
+        case OperandEncoding::Byte:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Immediate, false, 0, load<int8_t>(this->code_, index + 1) };
+        case OperandEncoding::Short:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Immediate, false, 0, load<int16_t>(this->code_, index + 1) };
+        case OperandEncoding::ArrayType:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Immediate, false, 0, this->code_[index + 1] };
+        case OperandEncoding::Pool8:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Pool, false, this->code_[index + 1], 0 };
+        case OperandEncoding::Pool16:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Pool, false, load<uint16_t>(this->code_, index + 1), 0 };
+        case OperandEncoding::Pool16Byte:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::PoolImmediate, false,
+                     load<uint16_t>(this->code_, index + 1), this->code_[index + 3] };
+        case OperandEncoding::IInc:
+            return { this->code_, index, length, Opcode::IInc, Instruction::Format::LocalImmediate, false, this->code_[index + 1],
+                     load<int8_t>(this->code_, index + 2) };
+        case OperandEncoding::Branch16:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Branch, false, 0, load<int16_t>(this->code_, index + 1) };
+        case OperandEncoding::Branch32:
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Branch, false, 0, load<int32_t>(this->code_, index + 1) };
+        case OperandEncoding::Switch: {
+            uint32_t paddedIndex = switchOperandsIndex(index);
+            uint64_t end;
+            if (opcode == Opcode::TableSwitch) {
+                int32_t low = this->read<int32_t>(paddedIndex + 4);
+                int32_t high = this->read<int32_t>(paddedIndex + 8);
+                if (high < low) throw CorruptClassFile("CodeIterator::decode: Invalid tableswitch bounds");
+                end = paddedIndex + 12 + static_cast<uint64_t>(static_cast<int64_t>(high) - low + 1) * 4;
+            } else {
+                uint32_t npairs = this->read<uint32_t>(paddedIndex + 4);
+                end = paddedIndex + 8 + static_cast<uint64_t>(npairs) * 8;
             }
-            return result;
+            Access::check(index, end - index, this->size_);
+            length = end - index;
+            return { this->code_, index, length, static_cast<Opcode>(opcode), Instruction::Format::Switch, false, 0, 0 };
         }
-        case Opcode::LookupSwitch: {
-            uint32_t paddedIndex = (index + 4) & ~3;
-            uint32_t defaultAddress = index + this->read<int32_t>(paddedIndex);
-            uint32_t npairs = this->read<int32_t>(paddedIndex + 4);
-            std::string result = "lookupswitch default @" + std::to_string(defaultAddress);
-            for (uint32_t i = 0; i < npairs; i++) {
-                result += '\n';
-                int32_t match = this->read<int32_t>(paddedIndex + 8 + i * 8);
-                uint32_t address = index + this->read<int32_t>(paddedIndex + 12 + i * 8);
-                result += indent(std::to_string(match) + ": @" + std::to_string(address), 1);
+        case OperandEncoding::Wide: {
+            uint8_t modified = (*this)[index + 1];
+            Access::check(index, wideWidth(modified), this->size_);
+            if (modified == Opcode::IInc) {
+                return { this->code_, index, 6, Opcode::IInc, Instruction::Format::LocalImmediate, true, load<uint16_t>(this->code_, index + 2),
+                         load<int16_t>(this->code_, index + 4) };
             }
-            return result;
+            if (!isWideModifiable(modified)) throw CorruptClassFile("CodeIterator::decode: Invalid wide instruction");
+            return { this->code_, index, 4, static_cast<Opcode>(modified), Instruction::Format::Local, true, load<uint16_t>(this->code_, index + 2), 0 };
         }
-        case Opcode::IReturn: return "ireturn";
-        case Opcode::LReturn: return "lreturn";
-        case Opcode::FReturn: return "freturn";
-        case Opcode::DReturn: return "dreturn";
-        case Opcode::AReturn: return "areturn";
-        case Opcode::Return: return "return";
-        case Opcode::GetStatic: return "getstatic [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::PutStatic: return "putstatic [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::GetField: return "getfield [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::PutField: return "putfield [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::InvokeVirtual: return "invokevirtual [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::InvokeSpecial: return "invokespecial [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::InvokeStatic: return "invokestatic [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::InvokeInterface: return "invokeinterface [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::InvokeDynamic: return "invokedynamic [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::New: return "new [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::NewArray:
-            return "newarray " + Descriptor(Descriptor::fromNewArray(static_cast<NewArrayType>(this->read<uint8_t>(index + 1)))).toString() + "[]";
-        case Opcode::ANewArray: return "anewarray [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::ArrayLength: return "arraylength";
-        case Opcode::AThrow: return "athrow";
-        case Opcode::CheckCast: return "checkcast [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::InstanceOf: return "instanceof [" + std::to_string(this->read<uint16_t>(index + 1)) + ']';
-        case Opcode::MonitorEnter: return "monitorenter";
-        case Opcode::MonitorExit: return "monitorexit";
-        case Opcode::Wide: return "wide";
-        case Opcode::MultiANewArray:
-            return "multianewarray [" + std::to_string(this->read<uint16_t>(index + 1)) + "] " + std::to_string(this->code_[index + 3]);
-        case Opcode::IfNull: return "ifnull @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::IfNonNull: return "ifnonnull @" + std::to_string(index + this->read<int16_t>(index + 1));
-        case Opcode::GotoW: return "gotow @" + std::to_string(index + this->read<int32_t>(index + 1));
-        case Opcode::JsrW: return "jsw @" + std::to_string(index + this->read<int32_t>(index + 1));
-        case Opcode::Breakpoint: return "breakpoint";
-        case Opcode::ImpDep1: return "impdep1";
-        case Opcode::ImpDep2: return "impdep2";
-        default: {
-            std::stringstream result;
-            result << "Unknown opcode: 0x" << std::uppercase << std::setfill('0') << std::setw(2) << std::hex << static_cast<uint32_t>(opcode);
-            return result.str();
+        case OperandEncoding::Invalid:
+        default: throw CorruptClassFile("CodeIterator::decode: Invalid opcode");
+    }
+}
+
+template<typename Access>
+std::string BasicCodeIterator<Access>::toString(uint32_t index) const {
+    uint8_t opcode = (*this)[index];
+    if (OpcodeEncoding[opcode] == OperandEncoding::Invalid) {
+        std::stringstream result;
+        result << "Unknown opcode: 0x" << std::uppercase << std::setfill('0') << std::setw(2) << std::hex << static_cast<uint32_t>(opcode);
+        return result.str();
+    }
+    return this->decode(index).toString();
+}
+
+template class BasicCodeIterator<CheckedAccess>;
+template class BasicCodeIterator<UncheckedAccess>;
+
+std::string Instruction::toString() const {
+    std::string result = this->wide_ ? "wide " : "";
+    result += opcodeName(this->opcode_);
+    switch (this->format_) {
+        case Format::None: break;
+        case Format::Local: {
+            if (OpcodeEncoding[this->opcode_] != OperandEncoding::ImplicitLocal) result += ' ' + std::to_string(this->operand_);
+            break;
+        }
+        case Format::Immediate: {
+            if (this->opcode_ == Opcode::NewArray) {
+                result += ' ' + Descriptor(Descriptor::fromNewArray(static_cast<NewArrayType>(this->immediate_))).toString() + "[]";
+            } else {
+                result += ' ' + std::to_string(this->immediate_);
+            }
+            break;
+        }
+        case Format::Pool: result += " [" + std::to_string(this->operand_) + ']'; break;
+        case Format::PoolImmediate: {
+            result += " [" + std::to_string(this->operand_) + ']';
+            if (this->opcode_ == Opcode::MultiANewArray) result += ' ' + std::to_string(this->immediate_);
+            break;
+        }
+        case Format::LocalImmediate: result += ' ' + std::to_string(this->operand_) + ' ' + std::to_string(this->immediate_); break;
+        case Format::Branch: result += " @" + std::to_string(this->branchTarget()); break;
+        case Format::Switch: {
+            SwitchTable table = this->switchTable();
+            if (table.isLookup()) {
+                result += " default @" + std::to_string(table.defaultTarget());
+            } else {
+                result += ' ' + std::to_string(table.key(0)) + " to " + std::to_string(table.key(table.size() - 1)) + " default @" +
+                          std::to_string(table.defaultTarget());
+            }
+            for (uint32_t i = 0; i < table.size(); i++) {
+                result += '\n';
+                result += Indent;
+                result += std::to_string(table.key(i)) + ": @" + std::to_string(table.target(i));
+            }
+            break;
         }
     }
+    return result;
 }
 
 } // namespace cjbp
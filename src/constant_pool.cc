@@ -381,7 +381,7 @@ std::string ConstantPool::MethodHandleEntry::toString(const ConstantPool &consta
 }
 
 std::string ConstantPool::MethodTypeEntry::toString(const ConstantPool &constantPool) const {
-    return "MethodType: " + constantPool.type(this->descriptorIndex_);
+    return "MethodType: " + constantPool.utf8(this->descriptorIndex_);
 }
 
 std::string ConstantPool::InvokeDynamicEntry::toString(const ConstantPool &constantPool) const {
@@ -517,6 +517,8 @@ ConstantPool::Tag ConstantPool::tag(uint16_t index) const {
     return this->entries_[index - 1]->tag();
 }
 
+bool ConstantPool::isValid(uint16_t index, Tag tag) const { return this->isValidEntry(index, tag); }
+
 const std::string &ConstantPool::utf8(uint16_t index) const {
     if (!this->isValidEntry(index, Tag::Utf8)) throw std::invalid_argument("Invalid UTF-8 index");
     return static_cast<const Utf8Entry &>(this->operator[](index)).value();
@@ -617,6 +619,21 @@ const MethodDescriptor &ConstantPool::interfaceMethodRefDesc(uint16_t index) con
     return static_cast<const InterfaceMethodRefEntry &>(this->operator[](index)).descriptor();
 }
 
+const std::string &ConstantPool::methodType(uint16_t index) const {
+    if (!this->isValidEntry(index, Tag::MethodType)) throw std::invalid_argument("Invalid method type index");
+    return this->utf8(static_cast<const MethodTypeEntry &>(this->operator[](index)).descriptorIndex());
+}
+
+const std::string &ConstantPool::invokeDynamicName(uint16_t index) const {
+    if (!this->isValidEntry(index, Tag::InvokeDynamic)) throw std::invalid_argument("Invalid invoke dynamic index");
+    return this->name(static_cast<const InvokeDynamicEntry &>(this->operator[](index)).nameAndTypeIndex());
+}
+
+const std::string &ConstantPool::invokeDynamicType(uint16_t index) const {
+    if (!this->isValidEntry(index, Tag::InvokeDynamic)) throw std::invalid_argument("Invalid invoke dynamic index");
+    return this->type(static_cast<const InvokeDynamicEntry &>(this->operator[](index)).nameAndTypeIndex());
+}
+
 const std::string &ConstantPool::name(uint16_t index) const {
     if (!this->isValidEntry(index, Tag::NameAndType)) throw std::invalid_argument("Invalid name and type index");
     return this->utf8(static_cast<const NameAndTypeEntry &>(this->operator[](index)).nameIndex());
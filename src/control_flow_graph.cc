@@ -1,41 +1,85 @@
 #include "cjbp/control_flow_graph.h"
 
-#include <queue>
+#include <algorithm>
+#include <cassert>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 
+#include "cjbp/bit_set.h"
 #include "cjbp/code_attribute.h"
+#include "cjbp/code_bitmap.h"
 #include "cjbp/code_iterator.h"
+#include "cjbp/exception.h"
 #include "string_util.h"
 
 namespace cjbp {
 
-AbsoluteStackMapFrame::AbsoluteStackMapFrame() : start_(0) { this->locals_ = std::make_shared<std::vector<VerificationTypeInfo>>(); }
+JumpTable::JumpTable(const SwitchTable &table, std::vector<uint32_t> &successors) :
+    low_(table.isLookup() ? 0 : table.key(0)), lookup_(table.isLookup()) {
+    // Positions of the successors by code index, so that large switches dedup their targets in linear time
+    std::unordered_map<uint32_t, uint16_t> positions;
+    for (uint32_t i = 0; i < successors.size(); i++) positions.emplace(successors[i], i);
+    auto successor = [&](uint32_t target) -> uint16_t {
+        auto [it, inserted] = positions.emplace(target, successors.size());
+        if (inserted) successors.push_back(target);
+        return it->second;
+    };
 
-AbsoluteStackMapFrame::AbsoluteStackMapFrame(uint32_t start, std::shared_ptr<std::vector<VerificationTypeInfo>> locals,
-                                             std::vector<VerificationTypeInfo> stack) :
-    start_(start), locals_(std::move(locals)), stack_(std::move(stack)) { }
+    this->defaultSuccessor_ = successor(table.defaultTarget());
+    this->successors_.reserve(table.size());
+    if (this->lookup_) this->keys_.reserve(table.size());
+    for (uint32_t i = 0; i < table.size(); i++) {
+        if (this->lookup_) {
+            int32_t key = table.key(i);
+            if (!this->keys_.empty() && key <= this->keys_.back()) throw CorruptClassFile("JumpTable::JumpTable: Unsorted lookupswitch keys");
+            this->keys_.push_back(key);
+        }
+        this->successors_.push_back(successor(table.target(i)));
+    }
+}
 
-AbsoluteStackMapFrame::~AbsoluteStackMapFrame() noexcept = default;
+uint16_t JumpTable::dispatch(int32_t value) const {
+    if (!this->lookup_) {
+        uint32_t i = static_cast<uint32_t>(value) - static_cast<uint32_t>(this->low_);
+        return i < this->successors_.size() ? this->successors_[i] : this->defaultSuccessor_;
+    }
 
-BasicBlock::BasicBlock(AbsoluteStackMapFrame stackMap, uint32_t end, std::vector<uint32_t> successors, std::vector<uint32_t> predecessors) :
-    stackMap_(std::move(stackMap)), end_(end), successors_(std::move(successors)), predecessors_(std::move(predecessors)) { }
+    auto it = std::lower_bound(this->keys_.begin(), this->keys_.end(), value);
+    if (it == this->keys_.end() || *it != value) return this->defaultSuccessor_;
+    return this->successors_[it - this->keys_.begin()];
+}
 
 
 
 namespace {
 
-CJBP_INLINE bool isBranchInsn(uint8_t opcode) {
-    return (Opcode::IfEq <= opcode && opcode <= Opcode::Ret) || opcode == Opcode::IfNull || opcode == Opcode::IfNonNull;
+/// @return true if the opcode transfers control somewhere other than the next instruction, so that it ends a basic block.
+CJBP_INLINE bool isControlTransferInsn(uint8_t opcode) {
+    return (Opcode::IfEq <= opcode && opcode <= Opcode::Return) || opcode == Opcode::AThrow || opcode == Opcode::IfNull ||
+           opcode == Opcode::IfNonNull || opcode == Opcode::GotoW || opcode == Opcode::JsrW;
 }
 
-CJBP_INLINE std::vector<uint32_t> successors(CodeIterator iterator, uint32_t index) {
-    uint8_t opcode = iterator[index];
-    switch (opcode) {
-        case Opcode::Goto: return { index + iterator.read<int16_t>(index + 1) };
-        case Opcode::Jsr: return { index + iterator.read<int16_t>(index + 1), index + 3 };
-        case Opcode::TableSwitch: throw std::runtime_error("TableSwitch not supported");
-        case Opcode::LookupSwitch: throw std::runtime_error("LookupSwitch not supported");
+/**
+ * @return The code indices of the successors of a block that ends with the given instruction. If it is a switch, its jump
+ *     table is decoded into jumpTable as well.
+ *
+ * A jsr is given both its subroutine and its return address as successors, and a ret none, since the subroutine returns to
+ * whichever jsr called it. An athrow has no normal successors either; it reaches the handlers that catch it through the
+ * exceptional edges of its block (see ControlFlowGraph::exceptionalSuccessors()).
+ */
+std::vector<uint32_t> targets(const Instruction &instruction, std::unique_ptr<JumpTable> &jumpTable) {
+    switch (instruction.opcode()) {
+        case Opcode::Goto:
+        case Opcode::GotoW: return { instruction.branchTarget() };
+        case Opcode::Jsr:
+        case Opcode::JsrW: return { instruction.branchTarget(), instruction.nextIndex() };
+        case Opcode::TableSwitch:
+        case Opcode::LookupSwitch: {
+            std::vector<uint32_t> result;
+            jumpTable = std::make_unique<JumpTable>(instruction.switchTable(), result);
+            return result;
+        }
         case Opcode::IfEq:
         case Opcode::IfNe:
         case Opcode::IfLt:
@@ -51,89 +95,197 @@ CJBP_INLINE std::vector<uint32_t> successors(CodeIterator iterator, uint32_t ind
         case Opcode::IfACmpEq:
         case Opcode::IfACmpNe:
         case Opcode::IfNull:
-        case Opcode::IfNonNull: return { index + iterator.read<int16_t>(index + 1), index + 3 };
+        case Opcode::IfNonNull: {
+            // A conditional branch to the next instruction has a single successor
+            if (instruction.branchTarget() == instruction.nextIndex()) return { instruction.nextIndex() };
+            return { instruction.branchTarget(), instruction.nextIndex() };
+        }
+        case Opcode::Ret:
         case Opcode::Return:
         case Opcode::AReturn:
         case Opcode::DReturn:
         case Opcode::FReturn:
         case Opcode::IReturn:
-        case Opcode::LReturn: return {};
-        default: return { iterator.peek() };
+        case Opcode::LReturn:
+        case Opcode::AThrow: return {};
+        default: return { instruction.nextIndex() };
+    }
+}
+
+/// @return The id of the block that contains the given code index, or BasicBlock::None if there is none.
+uint32_t findBlock(const std::vector<BasicBlock> &blocks, uint32_t index) {
+    if (blocks.empty() || index >= blocks.back().end()) return BasicBlock::None;
+
+    // The last block whose start is at or before the index
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), index, [](uint32_t index, const BasicBlock &block) { return index < block.start(); });
+    return (it - 1)->id();
+}
+
+/**
+ * Inverts edges stored in CSR form: computes, for every block, the blocks that have an edge to it. Sources are visited in
+ * ascending order, so every row comes out sorted, and a repeated edge can only repeat the last source added to its row.
+ */
+template<typename Edge, typename Target>
+void invertEdges(const std::vector<uint32_t> &offsets, const std::vector<Edge> &edges, Target target, std::vector<uint32_t> &invertedOffsets,
+                 std::vector<uint32_t> &inverted) {
+    uint32_t size = offsets.size() - 1;
+    std::vector<uint32_t> lastSource(size, BasicBlock::None);
+    invertedOffsets.assign(size + 1, 0);
+    for (uint32_t id = 0; id < size; id++) {
+        for (uint32_t i = offsets[id]; i < offsets[id + 1]; i++) {
+            uint32_t to = target(edges[i]);
+            if (lastSource[to] == id) continue;
+            lastSource[to] = id;
+            invertedOffsets[to + 1]++;
+        }
+    }
+    for (uint32_t id = 0; id < size; id++) invertedOffsets[id + 1] += invertedOffsets[id];
+
+    inverted.resize(invertedOffsets[size]);
+    std::vector<uint32_t> next(invertedOffsets.begin(), invertedOffsets.end() - 1);
+    lastSource.assign(size, BasicBlock::None);
+    for (uint32_t id = 0; id < size; id++) {
+        for (uint32_t i = offsets[id]; i < offsets[id + 1]; i++) {
+            uint32_t to = target(edges[i]);
+            if (lastSource[to] == id) continue;
+            lastSource[to] = id;
+            inverted[next[to]++] = id;
+        }
     }
 }
 
 } // namespace
 
-std::unique_ptr<ControlFlowGraph> ControlFlowGraph::build(const CodeAttributeInfo &code) {
-    const StackMapTableAttributeInfo *stackMap = code.stackMap();
-    AbsoluteStackMapFrame frame;
-    std::map<uint32_t, BasicBlock> blocks;
-    if (stackMap == nullptr) {
-        // Implicit stack map table (i.e. single basic block)
-        blocks.emplace(0, BasicBlock(std::move(frame), code.code().size(), {}, {}));
-    } else {
-        // Explicit stack map table
-        for (const auto &entry : stackMap->entries()) {
-            AbsoluteStackMapFrame nextFrame = entry->apply(frame);
-            blocks.emplace(frame.start(), BasicBlock(std::move(frame), nextFrame.start(), {}, {}));
-            frame = std::move(nextFrame);
+std::unique_ptr<ControlFlowGraph> ControlFlowGraph::build(CodeAttributeInfo &code) {
+    const CodeBitmap &bitmap = code.bitmap();
+    uint32_t size = code.code().size();
+    auto isBoundary = [&](uint32_t index) { return index == size || (index < size && bitmap.isInstructionStart(index)); };
+
+    // Jump targets are leaders
+    BitSet leaders = bitmap.branchTargets();
+    if (size > 0) leaders.set(0);
+
+    // Handlers and the bounds of the ranges they cover are leaders, so that every block is either wholly inside or wholly
+    // outside each range
+    BitSet handlers(size);
+    for (const ExceptionTableEntry &entry : code.exceptionTable()) {
+        if (entry.start() >= entry.end() || !isBoundary(entry.start()) || !isBoundary(entry.end()) || entry.handler() >= size ||
+            !bitmap.isInstructionStart(entry.handler())) {
+            throw CorruptClassFile("ControlFlowGraph::build: Invalid exception table entry");
         }
+        leaders.set(entry.start());
+        if (entry.end() < size) leaders.set(entry.end());
+        leaders.set(entry.handler());
+        handlers.set(entry.handler());
+    }
 
-        // Add the last frame
-        blocks.emplace(frame.start(), BasicBlock(std::move(frame), code.code().size(), {}, {}));
-
-        // For some reason, StackMapTable basic blocks do not terminate at branch instructions, so we need to split them
-        // manually (we also add successors for the branch instructions).
-        CodeIterator iterator = code.iterator();
-        std::queue<uint32_t> unanalyzedBlocks;
-        for (auto &[start, block] : blocks)
-            unanalyzedBlocks.push(start);
-        while (!unanalyzedBlocks.empty()) {
-            uint32_t start = unanalyzedBlocks.front();
-            unanalyzedBlocks.pop();
-
-            BasicBlock &block = blocks.at(start);
-            iterator.moveTo(start);
-            uint32_t index;
-            while (!iterator.eof() && iterator.peek() < block.end()) {
-                index = iterator.next();
-                if (!isBranchInsn(iterator[index])) continue;
-
-                uint32_t nextIndex = iterator.peek();
-                if (nextIndex < block.end()) {
-                    // Split the block
-                    AbsoluteStackMapFrame newFrame = block.stackMap();
-                    newFrame.start(nextIndex);
-                    blocks.emplace(newFrame.start(), BasicBlock(std::move(newFrame), block.end(), {}, {}));
-
-                    block.end(nextIndex);
-                    unanalyzedBlocks.push(nextIndex);
-                    break;
-                }
+    // StackMapTable frames are kept as annotations of the blocks they begin
+    Span<AbsoluteStackMapFrame> stackMaps;
+    if (const StackMapTableAttributeInfo *stackMap = code.stackMap(); stackMap != nullptr) {
+        stackMaps = stackMap->frames();
+        for (const AbsoluteStackMapFrame &frame : stackMaps) {
+            if (frame.start() >= size || !bitmap.isInstructionStart(frame.start())) {
+                throw CorruptClassFile("ControlFlowGraph::build: Stack map frame is not at the start of an instruction");
             }
+            leaders.set(frame.start());
+        }
+    }
 
-            // Add successors
-            block.successors(successors(iterator, index));
+    // Instructions that transfer control end their block. Their successors are collected as code indices and mapped to
+    // block ids once every block is known. The code was validated by bitmap(), so it is safe to decode without bounds checks.
+    std::vector<BasicBlock> blocks;
+    std::vector<uint32_t> successorOffsets { 0 };
+    std::vector<uint32_t> successorIndices;
+    std::vector<JumpTable> jumpTables;
+    uint32_t nextStackMap = 0;
+    auto addBlock = [&](uint32_t start, uint32_t end, const Instruction &last) {
+        uint32_t stackMap = BasicBlock::None;
+        if (nextStackMap < stackMaps.size() && stackMaps[nextStackMap].start() == start) stackMap = nextStackMap++;
+
+        std::unique_ptr<JumpTable> jumpTable;
+        std::vector<uint32_t> successors = targets(last, jumpTable);
+        uint32_t jumpTableIndex = BasicBlock::None;
+        if (jumpTable != nullptr) {
+            jumpTableIndex = jumpTables.size();
+            jumpTables.push_back(std::move(*jumpTable));
         }
 
-        // Add predecessors
-        for (auto &[start, block] : blocks) {
-            for (uint32_t successor : block.successors())
-                blocks.at(successor).addPredecessor(start);
+        blocks.emplace_back(blocks.size(), start, end, stackMap, jumpTableIndex, handlers.test(start));
+        successorIndices.insert(successorIndices.end(), successors.begin(), successors.end());
+        successorOffsets.push_back(successorIndices.size());
+    };
+    uint32_t start = 0;
+    Instruction last;
+    for (const Instruction &instruction : code.uncheckedInstructions()) {
+        if (instruction.index() != start && (leaders.test(instruction.index()) || isControlTransferInsn(last.opcode()))) {
+            addBlock(start, instruction.index(), last);
+            start = instruction.index();
         }
+        last = instruction;
+    }
+    if (size > 0) addBlock(start, size, last);
+
+    // Every successor is a leader, so it maps to the start of a block
+    for (uint32_t &successor : successorIndices) {
+        uint32_t id = findBlock(blocks, successor);
+        if (id == BasicBlock::None) throw CorruptClassFile("ControlFlowGraph::build: Execution falls off the end of the code");
+        successor = id;
     }
 
-    return std::make_unique<ControlFlowGraph>(std::move(blocks));
+    // Every block is wholly inside or wholly outside each handler range, so testing its start is enough. The JVM tries
+    // handlers in table order, so nothing after a catch-all can be reached, and a repeated entry adds nothing.
+    std::vector<uint32_t> exceptionalOffsets { 0 };
+    std::vector<ExceptionalEdge> exceptionalSuccessors;
+    if (!code.exceptionTable().empty()) {
+        std::vector<uint32_t> handlerBlocks;
+        handlerBlocks.reserve(code.exceptionTable().size());
+        for (const ExceptionTableEntry &entry : code.exceptionTable()) handlerBlocks.push_back(findBlock(blocks, entry.handler()));
+
+        for (const BasicBlock &block : blocks) {
+            uint32_t first = exceptionalSuccessors.size();
+            for (uint32_t i = 0; i < code.exceptionTable().size(); i++) {
+                const ExceptionTableEntry &entry = code.exceptionTable()[i];
+                if (!entry.covers(block.start())) continue;
+
+                auto isRepeat = [&](const ExceptionalEdge &edge) { return edge.handler() == handlerBlocks[i] && edge.catchType() == entry.catchType(); };
+                if (std::none_of(exceptionalSuccessors.begin() + first, exceptionalSuccessors.end(), isRepeat)) {
+                    exceptionalSuccessors.emplace_back(handlerBlocks[i], entry.catchType());
+                }
+                if (entry.isCatchAll()) break;
+            }
+            exceptionalOffsets.push_back(exceptionalSuccessors.size());
+        }
+    } else {
+        exceptionalOffsets.resize(blocks.size() + 1, 0);
+    }
+
+    return std::make_unique<ControlFlowGraph>(std::move(blocks), std::move(successorOffsets), std::move(successorIndices), std::move(exceptionalOffsets),
+                                              std::move(exceptionalSuccessors), stackMaps, std::move(jumpTables));
+}
+
+ControlFlowGraph::ControlFlowGraph(std::vector<BasicBlock> blocks, std::vector<uint32_t> successorOffsets, std::vector<uint32_t> successors,
+                                   std::vector<uint32_t> exceptionalOffsets, std::vector<ExceptionalEdge> exceptionalSuccessors,
+                                   Span<AbsoluteStackMapFrame> stackMaps, std::vector<JumpTable> jumpTables) :
+    blocks_(std::move(blocks)), successorOffsets_(std::move(successorOffsets)), successors_(std::move(successors)),
+    exceptionalOffsets_(std::move(exceptionalOffsets)), exceptionalSuccessors_(std::move(exceptionalSuccessors)), stackMaps_(stackMaps),
+    jumpTables_(std::move(jumpTables)) {
+    assert(this->successorOffsets_.size() == this->blocks_.size() + 1 && this->exceptionalOffsets_.size() == this->blocks_.size() + 1);
+    invertEdges(this->successorOffsets_, this->successors_, [](uint32_t successor) { return successor; }, this->predecessorOffsets_,
+                this->predecessors_);
+    invertEdges(this->exceptionalOffsets_, this->exceptionalSuccessors_, [](const ExceptionalEdge &edge) { return edge.handler(); },
+                this->exceptionalPredecessorOffsets_, this->exceptionalPredecessors_);
 }
 
+uint32_t ControlFlowGraph::blockAt(uint32_t index) const { return findBlock(this->blocks_, index); }
+
 std::string ControlFlowGraph::toString(const CodeAttributeInfo &code) const {
     CodeIterator iterator = code.iterator();
     std::string result = "Control Flow Graph:";
-    for (const auto &[start, block] : this->blocks_) {
+    for (const BasicBlock &block : this->blocks()) {
         result += '\n';
-        result += indent("Block " + std::to_string(start) + ':', 1);
+        result += indent("Block " + std::to_string(block.start()) + ':', 1);
 
-        iterator.moveTo(start);
+        iterator.moveTo(block.start());
         uint32_t index;
         while (!iterator.eof() && (index = iterator.next()) < block.end()) {
             result += '\n';
@@ -0,0 +1,582 @@
+#include "cjbp/disassembler.h"
+
+#include <charconv>
+#include <exception>
+
+#include "cjbp/class_file.h"
+#include "cjbp/code_attribute.h"
+#include "cjbp/code_iterator.h"
+#include "cjbp/constant_pool.h"
+#include "cjbp/control_flow_graph.h"
+#include "cjbp/descriptor.h"
+#include "cjbp/field_info.h"
+#include "cjbp/method_info.h"
+#include "opcode_util.h"
+#include "string_util.h"
+
+namespace cjbp {
+
+namespace {
+
+struct AccessFlag {
+    uint16_t flag;
+    const char *name;
+    const char *keyword; // nullptr if the flag is not written as a modifier
+};
+
+constexpr AccessFlag ClassFlags[] = {
+    { 0x0001, "ACC_PUBLIC", "public" },       { 0x0010, "ACC_FINAL", "final" },     { 0x0020, "ACC_SUPER", nullptr },
+    { 0x0200, "ACC_INTERFACE", nullptr },     { 0x0400, "ACC_ABSTRACT", nullptr },  { 0x1000, "ACC_SYNTHETIC", nullptr },
+    { 0x2000, "ACC_ANNOTATION", nullptr },    { 0x4000, "ACC_ENUM", nullptr },      { 0x8000, "ACC_MODULE", nullptr },
+};
+
+constexpr AccessFlag FieldFlags[] = {
+    { 0x0001, "ACC_PUBLIC", "public" },       { 0x0002, "ACC_PRIVATE", "private" }, { 0x0004, "ACC_PROTECTED", "protected" },
+    { 0x0008, "ACC_STATIC", "static" },       { 0x0010, "ACC_FINAL", "final" },     { 0x0040, "ACC_VOLATILE", "volatile" },
+    { 0x0080, "ACC_TRANSIENT", "transient" }, { 0x1000, "ACC_SYNTHETIC", nullptr }, { 0x4000, "ACC_ENUM", nullptr },
+};
+
+constexpr AccessFlag MethodFlags[] = {
+    { 0x0001, "ACC_PUBLIC", "public" },       { 0x0002, "ACC_PRIVATE", "private" },           { 0x0004, "ACC_PROTECTED", "protected" },
+    { 0x0008, "ACC_STATIC", "static" },       { 0x0010, "ACC_FINAL", "final" },               { 0x0020, "ACC_SYNCHRONIZED", "synchronized" },
+    { 0x0040, "ACC_BRIDGE", nullptr },        { 0x0080, "ACC_VARARGS", nullptr },             { 0x0100, "ACC_NATIVE", "native" },
+    { 0x0400, "ACC_ABSTRACT", "abstract" },   { 0x0800, "ACC_STRICT", "strictfp" },           { 0x1000, "ACC_SYNTHETIC", nullptr },
+};
+
+constexpr size_t IndexWidth = 5;       // Instruction indices are right-aligned to this width
+constexpr size_t SwitchKeyColumn = 19; // Switch keys are right-aligned to this column, so they end past the mnemonic
+constexpr size_t OperandColumn = 14; // Column of the operands, relative to the start of the mnemonic
+constexpr size_t CommentColumn = 34; // Column of constant pool comments, relative to the start of the mnemonic
+
+} // namespace
+
+/**
+ * Scope guards a public write method: if the method throws, the listing is left as it was before, apart from the lines
+ * already written, so the caller can report the error and go on with the next class. The line being written is ended
+ * and the depth is restored.
+ */
+class Disassembler::Scope {
+public:
+    explicit Scope(Disassembler &disassembler)
+        : disassembler_(disassembler), depth_(disassembler.depth_), exceptions_(std::uncaught_exceptions()) { }
+
+    ~Scope() {
+        if (std::uncaught_exceptions() == this->exceptions_) return;
+        this->disassembler_.depth_ = this->depth_;
+        std::string &out = this->disassembler_.out_;
+        if (!out.empty() && out.back() != '\n') out += '\n';
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    Disassembler &disassembler_;
+    uint32_t depth_;
+    int exceptions_;
+};
+
+Disassembler::Disassembler(std::string &buffer) : out_(buffer), file_(nullptr), depth_(0) { }
+
+Disassembler::Disassembler(FILE *file) : out_(this->ownBuffer_), file_(file), depth_(0) { this->ownBuffer_.reserve(FlushThreshold * 2); }
+
+Disassembler::~Disassembler() { this->flush(); }
+
+void Disassembler::flush() {
+    if (this->file_ == nullptr || this->out_.empty()) return;
+    std::fwrite(this->out_.data(), 1, this->out_.size(), this->file_);
+    this->out_.clear();
+}
+
+void Disassembler::beginLine() {
+    for (uint32_t i = 0; i < this->depth_; i++) this->write(Indent);
+}
+
+void Disassembler::endLine() {
+    this->write('\n');
+    if (this->file_ != nullptr && this->out_.size() >= FlushThreshold) this->flush();
+}
+
+void Disassembler::writeNumber(int64_t value, size_t width) {
+    char buffer[24];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    size_t length = end - buffer;
+    if (length < width) this->out_.append(width - length, ' ');
+    this->out_.append(buffer, end);
+}
+
+void Disassembler::writeHex(uint32_t value, uint32_t digits) {
+    char buffer[8];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value, 16);
+    for (size_t i = end - buffer; i < digits; i++) this->write('0');
+    this->out_.append(buffer, end);
+}
+
+void Disassembler::writeFloat(float value) {
+    char buffer[32];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    this->out_.append(buffer, end);
+}
+
+void Disassembler::writeDouble(double value) {
+    char buffer[32];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    this->out_.append(buffer, end);
+}
+
+void Disassembler::writePadding(size_t lineStart, size_t column) {
+    size_t length = this->out_.size() - lineStart;
+    this->out_.append(length < column ? column - length : 1, ' ');
+}
+
+void Disassembler::writeType(const Descriptor &descriptor) {
+    switch (descriptor.type()) {
+        case Descriptor::Type::Byte: this->write("byte"); break;
+        case Descriptor::Type::Char: this->write("char"); break;
+        case Descriptor::Type::Double: this->write("double"); break;
+        case Descriptor::Type::Float: this->write("float"); break;
+        case Descriptor::Type::Int: this->write("int"); break;
+        case Descriptor::Type::Long: this->write("long"); break;
+        case Descriptor::Type::Short: this->write("short"); break;
+        case Descriptor::Type::Boolean: this->write("boolean"); break;
+        case Descriptor::Type::Void: this->write("void"); break;
+        case Descriptor::Type::Object: this->write(descriptor.className()); break;
+    }
+    for (uint8_t i = 0; i < descriptor.arrayDimensions(); i++) this->write("[]");
+}
+
+void Disassembler::writeMethodSignature(const std::string &name, const MethodDescriptor &descriptor) {
+    this->writeType(descriptor.returnType());
+    this->write(' ');
+    this->write(name);
+    this->write('(');
+    for (size_t i = 0; i < descriptor.params().size(); i++) {
+        if (i != 0) this->write(", ");
+        this->writeType(descriptor.params()[i]);
+    }
+    this->write(')');
+}
+
+
+
+namespace {
+
+template<size_t N>
+void writeModifiers(std::string &out, uint16_t accessFlags, const AccessFlag (&flags)[N]) {
+    for (const AccessFlag &flag : flags) {
+        if ((accessFlags & flag.flag) == 0 || flag.keyword == nullptr) continue;
+        out += flag.keyword;
+        out += ' ';
+    }
+}
+
+template<size_t N>
+void writeFlagNames(std::string &out, uint16_t accessFlags, const AccessFlag (&flags)[N]) {
+    bool first = true;
+    for (const AccessFlag &flag : flags) {
+        if ((accessFlags & flag.flag) == 0) continue;
+        out += first ? " " : ", ";
+        out += flag.name;
+        first = false;
+    }
+}
+
+} // namespace
+
+void Disassembler::writeClass(const ClassFile &classFile) {
+    Scope scope(*this);
+    uint16_t accessFlags = classFile.accessFlags();
+    this->beginLine();
+    writeModifiers(this->out_, accessFlags, ClassFlags);
+    if (accessFlags & 0x2000) {
+        this->write("@interface ");
+    } else if (accessFlags & 0x0200) {
+        this->write("interface ");
+    } else {
+        if (accessFlags & 0x0400) this->write("abstract ");
+        this->write(accessFlags & 0x4000 ? "enum " : "class ");
+    }
+    this->write(classFile.name());
+    if (classFile.superName() != nullptr) {
+        this->write(" extends ");
+        this->write(*classFile.superName());
+    }
+    for (size_t i = 0; i < classFile.interfaces().size(); i++) {
+        this->write(i == 0 ? " implements " : ", ");
+        this->write(*classFile.interfaces()[i]);
+    }
+    this->endLine();
+
+    this->depth_++;
+    this->beginLine();
+    this->write("minor version: ");
+    this->writeNumber(classFile.minorVersion());
+    this->endLine();
+    this->beginLine();
+    this->write("major version: ");
+    this->writeNumber(classFile.majorVersion());
+    this->endLine();
+    this->beginLine();
+    this->write("flags: (0x");
+    this->writeHex(accessFlags, 4);
+    this->write(')');
+    writeFlagNames(this->out_, accessFlags, ClassFlags);
+    this->endLine();
+    this->depth_--;
+
+    this->beginLine();
+    this->write('{');
+    this->endLine();
+    this->depth_++;
+    bool first = true;
+    for (const auto &field : classFile.fields()) {
+        if (!first) this->endLine();
+        this->writeField(*field);
+        first = false;
+    }
+    for (const auto &method : classFile.methods()) {
+        if (!first) this->endLine();
+        this->writeMethod(*method);
+        first = false;
+    }
+    this->depth_--;
+    this->beginLine();
+    this->write('}');
+    this->endLine();
+}
+
+void Disassembler::writeField(const FieldInfo &field) {
+    this->beginLine();
+    writeModifiers(this->out_, field.accessFlags(), FieldFlags);
+    this->writeType(field.descriptor());
+    this->write(' ');
+    this->write(field.name());
+    this->write(';');
+    this->endLine();
+
+    this->depth_++;
+    this->beginLine();
+    this->write("descriptor: ");
+    this->write(field.type());
+    this->endLine();
+    this->beginLine();
+    this->write("flags: (0x");
+    this->writeHex(field.accessFlags(), 4);
+    this->write(')');
+    writeFlagNames(this->out_, field.accessFlags(), FieldFlags);
+    this->endLine();
+    this->depth_--;
+}
+
+void Disassembler::writeMethod(const MethodInfo &method) {
+    Scope scope(*this);
+    this->beginLine();
+    writeModifiers(this->out_, method.accessFlags(), MethodFlags);
+    this->writeMethodSignature(method.name(), method.descriptor());
+    this->write(';');
+    this->endLine();
+
+    this->depth_++;
+    this->beginLine();
+    this->write("descriptor: ");
+    this->write(method.type());
+    this->endLine();
+    this->beginLine();
+    this->write("flags: (0x");
+    this->writeHex(method.accessFlags(), 4);
+    this->write(')');
+    writeFlagNames(this->out_, method.accessFlags(), MethodFlags);
+    this->endLine();
+    if (method.code() != nullptr) {
+        this->beginLine();
+        this->write("Code:");
+        this->endLine();
+        this->depth_++;
+        this->writeCode(*method.code(), method.constantPool());
+        this->depth_--;
+    }
+    this->depth_--;
+}
+
+void Disassembler::writeCode(const CodeAttributeInfo &code, const ConstantPool &constantPool) {
+    Scope scope(*this);
+    this->beginLine();
+    this->write("stack=");
+    this->writeNumber(code.maxStack());
+    this->write(", locals=");
+    this->writeNumber(code.maxLocals());
+    this->endLine();
+
+    CodeIterator iterator = code.iterator();
+    while (!iterator.eof()) {
+        uint32_t index = iterator.peek();
+        if (OpcodeEncoding[iterator[index]] == OperandEncoding::Invalid) {
+            this->beginLine();
+            this->write("Unknown opcode: 0x");
+            this->writeHex(iterator[index], 2);
+            this->endLine();
+            return;
+        }
+        this->writeInstruction(iterator.nextInstruction(), constantPool);
+    }
+
+    if (code.exceptionTable().empty()) return;
+    this->beginLine();
+    this->write("Exception table:");
+    this->endLine();
+    this->depth_++;
+    this->beginLine();
+    this->write("  from    to target type");
+    this->endLine();
+    for (const ExceptionTableEntry &entry : code.exceptionTable()) {
+        this->beginLine();
+        this->writeNumber(entry.start(), 6);
+        this->writeNumber(entry.end(), 6);
+        this->writeNumber(entry.handler(), 6);
+        this->write("   ");
+        if (entry.isCatchAll()) {
+            this->write("any");
+        } else {
+            this->write("Class ");
+            this->write(constantPool.classRaw(entry.catchType()));
+        }
+        this->endLine();
+    }
+    this->depth_--;
+}
+
+
+
+void Disassembler::writePoolComment(uint8_t opcode, uint16_t index, const ConstantPool &constantPool) {
+    using Tag = ConstantPool::Tag;
+
+    this->write("// ");
+    switch (opcode) {
+        case Opcode::Ldc:
+        case Opcode::LdcW:
+        case Opcode::Ldc2W: {
+            if (constantPool.isValid(index, Tag::Integer)) {
+                this->write("int ");
+                this->writeNumber(constantPool.integer(index));
+            } else if (constantPool.isValid(index, Tag::Float)) {
+                this->write("float ");
+                this->writeFloat(constantPool.float_(index));
+                this->write('f');
+            } else if (constantPool.isValid(index, Tag::Long)) {
+                this->write("long ");
+                this->writeNumber(constantPool.long_(index));
+                this->write('l');
+            } else if (constantPool.isValid(index, Tag::Double)) {
+                this->write("double ");
+                this->writeDouble(constantPool.double_(index));
+                this->write('d');
+            } else if (constantPool.isValid(index, Tag::String)) {
+                this->write("String \"");
+                for (char c : constantPool.string(index)) {
+                    switch (c) {
+                        case '\n': this->write("\\n"); break;
+                        case '\r': this->write("\\r"); break;
+                        case '\t': this->write("\\t"); break;
+                        case '\\': this->write("\\\\"); break;
+                        case '"': this->write("\\\""); break;
+                        default: this->write(c); break;
+                    }
+                }
+                this->write('"');
+            } else if (constantPool.isValid(index, Tag::Class)) {
+                this->write("class ");
+                this->write(constantPool.class_(index));
+            } else if (constantPool.isValid(index, Tag::MethodType)) {
+                this->write("MethodType ");
+                this->write(constantPool.methodType(index));
+            } else if (constantPool.isValid(index, Tag::MethodHandle)) {
+                this->write("MethodHandle");
+            } else {
+                this->write("<invalid>");
+            }
+            return;
+        }
+        case Opcode::GetStatic:
+        case Opcode::PutStatic:
+        case Opcode::GetField:
+        case Opcode::PutField: {
+            if (!constantPool.isValid(index, Tag::FieldRef)) break;
+            this->write("Field ");
+            this->write(constantPool.fieldRefClass(index));
+            this->write('.');
+            this->write(constantPool.fieldRefName(index));
+            this->write(':');
+            this->write(constantPool.fieldRefType(index));
+            return;
+        }
+        case Opcode::InvokeVirtual:
+        case Opcode::InvokeSpecial:
+        case Opcode::InvokeStatic:
+        case Opcode::InvokeInterface: {
+            if (constantPool.isValid(index, Tag::MethodRef)) {
+                this->write("Method ");
+                this->write(constantPool.methodRefClass(index));
+                this->write('.');
+                this->write(constantPool.methodRefName(index));
+                this->write(':');
+                this->write(constantPool.methodRefType(index));
+            } else if (constantPool.isValid(index, Tag::InterfaceMethodRef)) {
+                this->write("InterfaceMethod ");
+                this->write(constantPool.interfaceMethodRefClass(index));
+                this->write('.');
+                this->write(constantPool.interfaceMethodRefName(index));
+                this->write(':');
+                this->write(constantPool.interfaceMethodRefType(index));
+            } else {
+                break;
+            }
+            return;
+        }
+        case Opcode::InvokeDynamic: {
+            if (!constantPool.isValid(index, Tag::InvokeDynamic)) break;
+            this->write("InvokeDynamic ");
+            this->write(constantPool.invokeDynamicName(index));
+            this->write(':');
+            this->write(constantPool.invokeDynamicType(index));
+            return;
+        }
+        default: {
+            if (!constantPool.isValid(index, Tag::Class)) break;
+            this->write("class ");
+            this->write(constantPool.class_(index));
+            return;
+        }
+    }
+    this->write("<invalid>");
+}
+
+void Disassembler::writeInstruction(const Instruction &instruction, const ConstantPool &constantPool) {
+    this->beginLine();
+    this->writeNumber(instruction.index(), IndexWidth);
+    this->write(": ");
+
+    size_t lineStart = this->out_.size();
+    this->write(opcodeName(instruction.opcode()));
+    if (instruction.isWide()) this->write("_w");
+
+    switch (instruction.format()) {
+        case Instruction::Format::None: break;
+        case Instruction::Format::Local: {
+            if (OpcodeEncoding[instruction.opcode()] == OperandEncoding::ImplicitLocal) break;
+            this->writePadding(lineStart, OperandColumn);
+            this->writeNumber(instruction.localIndex());
+            break;
+        }
+        case Instruction::Format::Immediate: {
+            this->writePadding(lineStart, OperandColumn);
+            if (instruction.opcode() == Opcode::NewArray) {
+                this->writeType(Descriptor::fromNewArray(static_cast<NewArrayType>(instruction.immediate())));
+            } else {
+                this->writeNumber(instruction.immediate());
+            }
+            break;
+        }
+        case Instruction::Format::Pool:
+        case Instruction::Format::PoolImmediate: {
+            this->writePadding(lineStart, OperandColumn);
+            this->write('#');
+            this->writeNumber(instruction.poolIndex());
+            if (instruction.format() == Instruction::Format::PoolImmediate) {
+                this->write(",  ");
+                this->writeNumber(instruction.immediate());
+            }
+            this->writePadding(lineStart, CommentColumn);
+            this->writePoolComment(instruction.opcode(), instruction.poolIndex(), constantPool);
+            break;
+        }
+        case Instruction::Format::LocalImmediate: {
+            this->writePadding(lineStart, OperandColumn);
+            this->writeNumber(instruction.localIndex());
+            this->write(", ");
+            this->writeNumber(instruction.immediate());
+            break;
+        }
+        case Instruction::Format::Branch: {
+            this->writePadding(lineStart, OperandColumn);
+            this->writeNumber(instruction.branchTarget());
+            break;
+        }
+        case Instruction::Format::Switch: {
+            SwitchTable table = instruction.switchTable();
+            this->writePadding(lineStart, OperandColumn);
+            this->write("{ // ");
+            if (table.isLookup()) {
+                this->writeNumber(table.size());
+            } else {
+                this->writeNumber(table.key(0));
+                this->write(" to ");
+                this->writeNumber(table.key(table.size() - 1));
+            }
+            this->endLine();
+
+            // Keys are right-aligned so that the colons line up past the end of the mnemonic, as javap does.
+            for (uint32_t i = 0; i < table.size(); i++) {
+                this->beginLine();
+                this->writeNumber(table.key(i), SwitchKeyColumn);
+                this->write(": ");
+                this->writeNumber(table.target(i));
+                this->endLine();
+            }
+            this->beginLine();
+            this->out_.append(SwitchKeyColumn - 7, ' ');
+            this->write("default: ");
+            this->writeNumber(table.defaultTarget());
+            this->endLine();
+
+            this->beginLine();
+            this->out_.append(IndexWidth + 2, ' ');
+            this->write('}');
+            break;
+        }
+    }
+    this->endLine();
+}
+
+void Disassembler::writeControlFlowGraph(const ControlFlowGraph &cfg, const CodeAttributeInfo &code, const ConstantPool &constantPool) {
+    Scope scope(*this);
+    this->beginLine();
+    this->write("Control Flow Graph:");
+    this->endLine();
+
+    this->depth_++;
+    CodeIterator iterator = code.iterator();
+    for (const BasicBlock &block : cfg.blocks()) {
+        this->beginLine();
+        this->write("Block ");
+        this->writeNumber(block.start());
+        Span<uint32_t> successors = cfg.successors(block.id());
+        if (!successors.empty()) {
+            this->write(" -> ");
+            for (uint32_t i = 0; i < successors.size(); i++) {
+                if (i != 0) this->write(", ");
+                this->writeNumber(cfg.block(successors[i]).start());
+            }
+        }
+        Span<ExceptionalEdge> exceptionalSuccessors = cfg.exceptionalSuccessors(block.id());
+        if (!exceptionalSuccessors.empty()) {
+            this->write(" throws to ");
+            for (uint32_t i = 0; i < exceptionalSuccessors.size(); i++) {
+                if (i != 0) this->write(", ");
+                this->writeNumber(cfg.block(exceptionalSuccessors[i].handler()).start());
+                this->write(" (");
+                this->write(exceptionalSuccessors[i].isCatchAll() ? "any" : constantPool.classRaw(exceptionalSuccessors[i].catchType()));
+                this->write(')');
+            }
+        }
+        this->write(':');
+        this->endLine();
+
+        this->depth_++;
+        iterator.moveTo(block.start());
+        while (!iterator.eof() && iterator.peek() < block.end()) this->writeInstruction(iterator.nextInstruction(), constantPool);
+        this->depth_--;
+    }
+    this->depth_--;
+}
+
+} // namespace cjbp
@@ -0,0 +1,211 @@
+#include "cjbp/dominator_tree.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace cjbp {
+
+std::unique_ptr<DominatorTree> DominatorTree::build(const ControlFlowGraph &cfg) {
+    constexpr uint32_t None = BasicBlock::None;
+    uint32_t size = cfg.size();
+
+    // Postorder, by an iterative depth-first search from the entry block
+    std::vector<uint32_t> postorder;
+    postorder.reserve(size);
+    std::vector<bool> visited(size, false);
+    std::vector<std::pair<uint32_t, uint32_t>> stack; // Block and position of its next successor to visit
+    if (size > 0) {
+        visited[0] = true;
+        stack.emplace_back(0, 0);
+    }
+    while (!stack.empty()) {
+        auto &[id, next] = stack.back();
+        Span<uint32_t> successors = cfg.successors(id);
+        Span<ExceptionalEdge> exceptionalSuccessors = cfg.exceptionalSuccessors(id);
+        if (next < successors.size() + exceptionalSuccessors.size()) {
+            uint32_t successor = next < successors.size() ? successors[next] : exceptionalSuccessors[next - successors.size()].handler();
+            next++;
+            if (!visited[successor]) {
+                visited[successor] = true;
+                stack.emplace_back(successor, 0);
+            }
+            continue;
+        }
+        postorder.push_back(id);
+        stack.pop_back();
+    }
+
+    std::vector<uint32_t> reversePostorder(postorder.rbegin(), postorder.rend());
+    std::vector<uint32_t> rpoNumbers(size, None);
+    for (uint32_t i = 0; i < reversePostorder.size(); i++) rpoNumbers[reversePostorder[i]] = i;
+
+    // Cooper, Harvey and Kennedy: refine the immediate dominators in reverse postorder until they stop changing. The entry
+    // block is its own dominator until the end.
+    std::vector<uint32_t> idoms(size, None);
+    if (size > 0) idoms[0] = 0;
+    auto intersect = [&](uint32_t a, uint32_t b) {
+        while (a != b) {
+            while (rpoNumbers[a] > rpoNumbers[b]) a = idoms[a];
+            while (rpoNumbers[b] > rpoNumbers[a]) b = idoms[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (uint32_t i = 1; i < reversePostorder.size(); i++) {
+            uint32_t id = reversePostorder[i];
+            uint32_t idom = None;
+            cfg.forEachPredecessor(id, [&](uint32_t predecessor) {
+                if (idoms[predecessor] == None) return; // Unreachable, or not processed yet
+                idom = idom == None ? predecessor : intersect(predecessor, idom);
+            });
+            if (idoms[id] != idom) {
+                idoms[id] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    // Dominance frontiers: walk up from every predecessor of a block until reaching the block's immediate dominator. Blocks
+    // are visited in ascending order, so every frontier comes out sorted, and a repeat can only be the last element added.
+    std::vector<uint32_t> lastAdded(size, None);
+    std::vector<std::pair<uint32_t, uint32_t>> frontierPairs; // Block and a block in its frontier
+    for (uint32_t id = 0; id < size; id++) {
+        if (rpoNumbers[id] == None) continue;
+        cfg.forEachPredecessor(id, [&](uint32_t predecessor) {
+            if (rpoNumbers[predecessor] == None) return;
+            // The walk from a predecessor of the entry block ends at the entry block, which is its own dominator for now
+            for (uint32_t runner = predecessor; runner != idoms[id] || id == 0; runner = idoms[runner]) {
+                if (lastAdded[runner] != id) {
+                    lastAdded[runner] = id;
+                    frontierPairs.emplace_back(runner, id);
+                }
+                if (runner == 0) break;
+            }
+        });
+    }
+
+    std::vector<uint32_t> frontierOffsets(size + 1, 0);
+    for (const auto &[id, frontier] : frontierPairs) frontierOffsets[id + 1]++;
+    for (uint32_t id = 0; id < size; id++) frontierOffsets[id + 1] += frontierOffsets[id];
+    std::vector<uint32_t> frontiers(frontierPairs.size());
+    std::vector<uint32_t> next(frontierOffsets.begin(), frontierOffsets.end() - 1);
+    for (const auto &[id, frontier] : frontierPairs) frontiers[next[id]++] = frontier;
+
+    if (size > 0) idoms[0] = None;
+    return std::make_unique<DominatorTree>(std::move(reversePostorder), std::move(rpoNumbers), std::move(idoms), std::move(frontierOffsets),
+                                           std::move(frontiers));
+}
+
+DominatorTree::DominatorTree(std::vector<uint32_t> reversePostorder, std::vector<uint32_t> rpoNumbers, std::vector<uint32_t> idoms,
+                             std::vector<uint32_t> frontierOffsets, std::vector<uint32_t> frontiers) :
+    reversePostorder_(std::move(reversePostorder)), rpoNumbers_(std::move(rpoNumbers)), idoms_(std::move(idoms)),
+    frontierOffsets_(std::move(frontierOffsets)), frontiers_(std::move(frontiers)) {
+    uint32_t size = this->idoms_.size();
+    assert(this->rpoNumbers_.size() == size && this->frontierOffsets_.size() == size + 1);
+
+    // Children, in reverse postorder
+    this->childOffsets_.assign(size + 1, 0);
+    for (uint32_t id : this->reversePostorder_) {
+        if (this->idoms_[id] != BasicBlock::None) this->childOffsets_[this->idoms_[id] + 1]++;
+    }
+    for (uint32_t id = 0; id < size; id++) this->childOffsets_[id + 1] += this->childOffsets_[id];
+    this->children_.resize(this->childOffsets_[size]);
+    std::vector<uint32_t> next(this->childOffsets_.begin(), this->childOffsets_.end() - 1);
+    for (uint32_t id : this->reversePostorder_) {
+        if (this->idoms_[id] != BasicBlock::None) this->children_[next[this->idoms_[id]]++] = id;
+    }
+
+    // Preorder numbers and subtree sizes, so that dominates() is a range check. A parent comes before its children in
+    // reverse postorder, so visiting it backwards completes every subtree before its parent.
+    this->preorder_.assign(size, BasicBlock::None);
+    this->subtreeSizes_.assign(size, 1);
+    std::vector<uint32_t> stack;
+    uint32_t counter = 0;
+    for (uint32_t root : this->reversePostorder_) {
+        if (this->idoms_[root] != BasicBlock::None) continue;
+        stack.push_back(root);
+        while (!stack.empty()) {
+            uint32_t id = stack.back();
+            stack.pop_back();
+            this->preorder_[id] = counter++;
+            Span<uint32_t> children = this->children(id);
+            for (uint32_t i = children.size(); i > 0; i--) stack.push_back(children[i - 1]);
+        }
+    }
+    for (auto it = this->reversePostorder_.rbegin(); it != this->reversePostorder_.rend(); ++it) {
+        if (this->idoms_[*it] != BasicBlock::None) this->subtreeSizes_[this->idoms_[*it]] += this->subtreeSizes_[*it];
+    }
+}
+
+
+
+std::unique_ptr<LoopNest> LoopNest::build(const ControlFlowGraph &cfg, const DominatorTree &dominators) {
+    uint32_t size = cfg.size();
+    std::vector<Loop> loops;
+    std::vector<uint32_t> bodyOffsets { 0 };
+    std::vector<uint32_t> bodies;
+    std::vector<uint32_t> backEdgeOffsets { 0 };
+    std::vector<uint32_t> backEdges;
+    std::vector<uint32_t> loopOfBlock(size, Loop::None);
+    bool reducible = true;
+
+    // Headers are visited in reverse postorder, so every loop is found after the loops that contain it, and the loop that
+    // last claimed a header is the innermost loop around it
+    std::vector<uint32_t> mark(size, Loop::None);
+    std::vector<uint32_t> worklist;
+    for (uint32_t header : dominators.reversePostorder()) {
+        // An edge that goes back in reverse postorder is a back edge if its target dominates its source; otherwise, the
+        // cycle it closes has more than one entry
+        uint32_t firstBackEdge = backEdges.size();
+        cfg.forEachPredecessor(header, [&](uint32_t predecessor) {
+            if (!dominators.isReachable(predecessor) || dominators.rpoNumber(predecessor) < dominators.rpoNumber(header)) return;
+            if (dominators.dominates(header, predecessor)) {
+                backEdges.push_back(predecessor);
+            } else {
+                reducible = false;
+            }
+        });
+        std::sort(backEdges.begin() + firstBackEdge, backEdges.end());
+        backEdges.erase(std::unique(backEdges.begin() + firstBackEdge, backEdges.end()), backEdges.end());
+        if (backEdges.size() == firstBackEdge) continue;
+
+        // The body is every block that reaches a back edge without going through the header
+        uint32_t index = loops.size();
+        uint32_t firstBlock = bodies.size();
+        mark[header] = index;
+        bodies.push_back(header);
+        for (uint32_t i = firstBackEdge; i < backEdges.size(); i++) {
+            if (mark[backEdges[i]] == index) continue;
+            mark[backEdges[i]] = index;
+            worklist.push_back(backEdges[i]);
+        }
+        while (!worklist.empty()) {
+            uint32_t id = worklist.back();
+            worklist.pop_back();
+            bodies.push_back(id);
+            cfg.forEachPredecessor(id, [&](uint32_t predecessor) {
+                if (mark[predecessor] == index || !dominators.isReachable(predecessor)) return;
+                mark[predecessor] = index;
+                worklist.push_back(predecessor);
+            });
+        }
+        std::sort(bodies.begin() + firstBlock, bodies.end());
+
+        uint32_t parent = loopOfBlock[header];
+        loops.emplace_back(header, parent, parent == Loop::None ? 1 : loops[parent].depth() + 1);
+        for (uint32_t i = firstBlock; i < bodies.size(); i++) loopOfBlock[bodies[i]] = index;
+        bodyOffsets.push_back(bodies.size());
+        backEdgeOffsets.push_back(backEdges.size());
+    }
+
+    return std::make_unique<LoopNest>(std::move(loops), std::move(bodyOffsets), std::move(bodies), std::move(backEdgeOffsets), std::move(backEdges),
+                                      std::move(loopOfBlock), reducible);
+}
+
+LoopNest::LoopNest(std::vector<Loop> loops, std::vector<uint32_t> bodyOffsets, std::vector<uint32_t> bodies, std::vector<uint32_t> backEdgeOffsets,
+                   std::vector<uint32_t> backEdges, std::vector<uint32_t> loopOfBlock, bool reducible) :
+    loops_(std::move(loops)), bodyOffsets_(std::move(bodyOffsets)), bodies_(std::move(bodies)), backEdgeOffsets_(std::move(backEdgeOffsets)),
+    backEdges_(std::move(backEdges)), loopOfBlock_(std::move(loopOfBlock)), reducible_(reducible) { }
+
+} // namespace cjbp
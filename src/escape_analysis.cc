@@ -0,0 +1,213 @@
+#include "cjbp/escape_analysis.h"
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+
+#include "cjbp/code_attribute.h"
+#include "cjbp/constant_pool.h"
+#include "cjbp/control_flow_graph.h"
+#include "cjbp/descriptor.h"
+#include "cjbp/liveness.h"
+#include "cjbp/register_code.h"
+#include "cjbp/type_inference.h"
+#include "string_util.h"
+
+namespace cjbp {
+
+namespace {
+
+using Escape = AllocationSite::Escape;
+
+constexpr uint32_t NoNode = UINT32_MAX;
+
+CJBP_INLINE bool allocates(uint8_t opcode) {
+    return opcode == Opcode::New || opcode == Opcode::NewArray || opcode == Opcode::ANewArray || opcode == Opcode::MultiANewArray;
+}
+
+CJBP_INLINE const char *escapeName(Escape escape) {
+    switch (escape) {
+        case Escape::None: return "none";
+        case Escape::Argument: return "argument";
+        default: return "global";
+    }
+}
+
+/**
+ * Nodes stand for the values of registers, in classes of values that may be the same object, kept in a union-find forest.
+ * Every class records how far its values escape.
+ */
+class EscapeGraph {
+public:
+    uint32_t add() {
+        this->parents_.push_back(this->parents_.size());
+        this->escapes_.push_back(Escape::None);
+        return this->parents_.size() - 1;
+    }
+
+    uint32_t find(uint32_t node) {
+        while (this->parents_[node] != node) {
+            this->parents_[node] = this->parents_[this->parents_[node]]; // Path halving
+            node = this->parents_[node];
+        }
+        return node;
+    }
+
+    void unite(uint32_t a, uint32_t b) {
+        a = this->find(a);
+        b = this->find(b);
+        if (a == b) return;
+        if (a > b) std::swap(a, b);
+        this->parents_[b] = a;
+        this->escapes_[a] = std::max(this->escapes_[a], this->escapes_[b]);
+    }
+
+    void escape(uint32_t node, Escape escape) {
+        if (node == NoNode) return;
+        Escape &current = this->escapes_[this->find(node)];
+        current = std::max(current, escape);
+    }
+
+    /// Records that whatever escapes from a node escapes from another, e.g. from the result of a call to its arguments.
+    void flow(uint32_t from, uint32_t to) { this->flows_.emplace_back(from, to); }
+
+    Escape escapeOf(uint32_t node) { return this->escapes_[this->find(node)]; }
+
+    /// Propagates escapes along the flows, which may form cycles through the classes.
+    void propagate() {
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (auto [from, to] : this->flows_) {
+                Escape escape = this->escapeOf(from);
+                if (escape <= this->escapeOf(to)) continue;
+                this->escape(to, escape);
+                changed = true;
+            }
+        }
+    }
+
+private:
+    std::vector<uint32_t> parents_;
+    std::vector<Escape> escapes_;
+    std::vector<std::pair<uint32_t, uint32_t>> flows_;
+};
+
+Escape defaultPolicy(const std::string &owner, const std::string &name, const std::string &, uint32_t argument) {
+    return argument == 0 && name == "<init>" && owner == "java.lang.Object" ? Escape::None : Escape::Argument;
+}
+
+} // namespace
+
+std::unique_ptr<EscapeAnalysis> EscapeAnalysis::build(TypeInference &types, const CallPolicy &policy) {
+    CodeAttributeInfo &code = types.code();
+    const ConstantPool &constantPool = types.constantPool();
+    const ControlFlowGraph &cfg = *code.cfg();
+    const Liveness &liveness = *code.liveness();
+    std::unique_ptr<RegisterCode> registerCode = RegisterCode::build(types);
+    uint32_t maxLocals = code.maxLocals();
+    uint32_t stride = maxLocals + code.maxStack();
+
+    // A node for every register that holds a reference on entry to a block, to merge the values of every path into it
+    EscapeGraph graph;
+    std::vector<uint32_t> entries(static_cast<size_t>(cfg.size()) * stride, NoNode);
+    for (uint32_t block = 0; block < cfg.size(); block++) {
+        std::optional<TypeFrame> frame = types.entry(block);
+        if (!frame.has_value()) continue;
+        uint32_t *nodes = entries.data() + static_cast<size_t>(block) * stride;
+        for (uint32_t local = 0; local < maxLocals; local++) {
+            if (frame->locals()[local].isReference() && liveness.liveIn(block).test(local)) nodes[local] = graph.add();
+        }
+        for (uint32_t slot = 0; slot < frame->depth(); slot++) {
+            if (frame->stack()[slot].isReference()) nodes[maxLocals + slot] = graph.add();
+        }
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> sites; // Code index and node
+    std::vector<uint32_t> current(registerCode->registerCount());
+    for (uint32_t block = 0; block < cfg.size(); block++) {
+        std::copy(entries.begin() + static_cast<size_t>(block) * stride, entries.begin() + static_cast<size_t>(block + 1) * stride, current.begin());
+        current.back() = NoNode; // Scratch register
+
+        // An exception may be thrown with any value in the locals that the block had in them
+        auto toHandlers = [&](uint32_t local) {
+            if (current[local] == NoNode) return;
+            for (const ExceptionalEdge &edge : cfg.exceptionalSuccessors(block)) {
+                uint32_t node = entries[static_cast<size_t>(edge.handler()) * stride + local];
+                if (node != NoNode) graph.unite(current[local], node);
+            }
+        };
+        for (uint32_t local = 0; local < maxLocals; local++) toHandlers(local);
+
+        for (const RegisterInstruction &instruction : registerCode->blockInstructions(block)) {
+            Span<uint32_t> sources = registerCode->sources(instruction);
+            uint8_t opcode = instruction.opcode();
+            uint32_t value = NoNode;
+            if (instruction.isMove() || opcode == Opcode::CheckCast) {
+                value = current[sources[0]];
+            } else if (allocates(opcode)) {
+                value = graph.add();
+                sites.emplace_back(instruction.instruction().index(), value);
+            } else if (opcode == Opcode::PutStatic || opcode == Opcode::AReturn || opcode == Opcode::AThrow) {
+                graph.escape(current[sources[0]], Escape::Global);
+            } else if (opcode == Opcode::PutField) {
+                graph.escape(current[sources[1]], Escape::Global);
+            } else if (opcode == Opcode::AAStore) {
+                graph.escape(current[sources[2]], Escape::Global);
+            } else if (opcode == Opcode::InvokeDynamic) {
+                for (uint32_t source : sources) graph.escape(current[source], Escape::Global);
+            } else if (Opcode::InvokeVirtual <= opcode && opcode <= Opcode::InvokeInterface) {
+                uint16_t index = instruction.instruction().poolIndex();
+                bool interface = constantPool.isValid(index, ConstantPool::Tag::InterfaceMethodRef);
+                const std::string &owner = interface ? constantPool.interfaceMethodRefClass(index) : constantPool.methodRefClass(index);
+                const std::string &name = interface ? constantPool.interfaceMethodRefName(index) : constantPool.methodRefName(index);
+                const std::string &type = interface ? constantPool.interfaceMethodRefType(index) : constantPool.methodRefType(index);
+                const Descriptor &returnType = (interface ? constantPool.interfaceMethodRefDesc(index) : constantPool.methodRefDesc(index)).returnType();
+                bool returnsReference = returnType.type() == Descriptor::Type::Object || returnType.isArray();
+                if (returnsReference) value = graph.add();
+                for (uint32_t i = 0; i < sources.size(); i++) {
+                    uint32_t argument = current[sources[i]];
+                    if (argument == NoNode) continue;
+                    graph.escape(argument, policy ? policy(owner, name, type, i) : defaultPolicy(owner, name, type, i));
+                    if (returnsReference) graph.flow(value, argument);
+                }
+            }
+
+            if (instruction.hasDestination()) {
+                current[instruction.destination()] = value;
+                if (instruction.destination() < maxLocals) toHandlers(instruction.destination());
+            }
+        }
+
+        for (uint32_t successor : cfg.successors(block)) {
+            const uint32_t *nodes = entries.data() + static_cast<size_t>(successor) * stride;
+            for (uint32_t reg = 0; reg < stride; reg++) {
+                if (nodes[reg] != NoNode && current[reg] != NoNode) graph.unite(current[reg], nodes[reg]);
+            }
+        }
+    }
+    graph.propagate();
+
+    std::sort(sites.begin(), sites.end());
+    std::vector<AllocationSite> result;
+    result.reserve(sites.size());
+    for (auto [index, node] : sites) result.emplace_back(index, code.code()[index], graph.escapeOf(node));
+    return std::make_unique<EscapeAnalysis>(std::move(result));
+}
+
+EscapeAnalysis::EscapeAnalysis(std::vector<AllocationSite> sites) : sites_(std::move(sites)) { }
+
+const AllocationSite *EscapeAnalysis::siteAt(uint32_t index) const {
+    auto it = std::lower_bound(this->sites_.begin(), this->sites_.end(), index, [](const AllocationSite &site, uint32_t index) { return site.index() < index; });
+    return it != this->sites_.end() && it->index() == index ? &*it : nullptr;
+}
+
+std::string EscapeAnalysis::toString() const {
+    std::string result = "Escape analysis:";
+    for (const AllocationSite &site : this->sites_) {
+        result += "\n";
+        result += indent(std::to_string(site.index()) + ": " + escapeName(site.escape()), 1);
+    }
+    return result;
+}
+
+} // namespace cjbp
@@ -0,0 +1,211 @@
+#include "cjbp/liveness.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "cjbp/code_attribute.h"
+#include "cjbp/code_bitmap.h"
+#include "cjbp/code_iterator.h"
+#include "cjbp/control_flow_graph.h"
+#include "cjbp/dominator_tree.h"
+#include "cjbp/exception.h"
+#include "type_util.h"
+
+namespace cjbp {
+
+namespace {
+
+/**
+ * How an instruction accesses the local variables.
+ */
+struct LocalAccess {
+    uint16_t local;
+    uint8_t width; // Number of slots accessed, 0 if the instruction does not access the local variables
+    bool use;
+    bool def;
+};
+
+CJBP_INLINE LocalAccess localAccess(const Instruction &instruction) {
+    uint8_t opcode = instruction.opcode();
+    if ((Opcode::ILoad <= opcode && opcode <= Opcode::ALoad) || (Opcode::ILoad0 <= opcode && opcode <= Opcode::ALoad3)) {
+        uint8_t slots = width(KindTypes[localKind(opcode, Opcode::ILoad, Opcode::ILoad0)]);
+        return { instruction.localIndex(), slots, true, false };
+    }
+    if ((Opcode::IStore <= opcode && opcode <= Opcode::AStore) || (Opcode::IStore0 <= opcode && opcode <= Opcode::AStore3)) {
+        uint8_t slots = width(KindTypes[localKind(opcode, Opcode::IStore, Opcode::IStore0)]);
+        return { instruction.localIndex(), slots, false, true };
+    }
+    if (opcode == Opcode::IInc) return { instruction.localIndex(), 1, true, true };
+    if (opcode == Opcode::Ret) return { instruction.localIndex(), 1, true, false };
+    return { 0, 0, false, false };
+}
+
+/// Applies an instruction to the set of slots live after it, giving the set of slots live before it.
+CJBP_INLINE void transfer(BitSet::Word *live, const LocalAccess &access) {
+    for (uint32_t slot = access.local; slot < access.local + access.width; slot++) {
+        BitSet::Word bit = BitSet::Word(1) << (slot % BitSet::WordBits);
+        if (access.def) live[slot / BitSet::WordBits] &= ~bit;
+        if (access.use) live[slot / BitSet::WordBits] |= bit;
+    }
+}
+
+} // namespace
+
+std::unique_ptr<Liveness> Liveness::build(CodeAttributeInfo &code) {
+    const ControlFlowGraph &cfg = *code.cfg();
+    const DominatorTree &dominators = *code.dominators();
+    uint32_t size = cfg.size();
+    uint32_t maxLocals = code.maxLocals();
+    uint32_t stride = BitSet::wordCount(maxLocals);
+
+    // Decode the local variable accesses of every instruction, and summarize them per block: the slots read before any
+    // write (use) and the slots written (def)
+    std::vector<uint32_t> instructionIndices;
+    std::vector<uint32_t> instructionBlocks;
+    std::vector<LocalAccess> accesses;
+    std::vector<uint32_t> firstInstructions(size + 1, 0);
+    std::vector<BitSet> uses(size, BitSet(maxLocals));
+    std::vector<BitSet> defs(size, BitSet(maxLocals));
+    std::vector<bool> endsWithRet(size, false);
+    instructionIndices.reserve(code.bitmap().instructionCount());
+    instructionBlocks.reserve(code.bitmap().instructionCount());
+    accesses.reserve(code.bitmap().instructionCount());
+    uint32_t block = 0;
+    for (const Instruction &instruction : code.uncheckedInstructions()) {
+        while (instruction.index() >= cfg.block(block).end()) firstInstructions[++block] = instructionIndices.size();
+
+        LocalAccess access = localAccess(instruction);
+        if (access.local + access.width > maxLocals) throw CorruptClassFile("Liveness::build: Local variable index out of range");
+        for (uint32_t slot = access.local; slot < access.local + access.width; slot++) {
+            if (access.use && !defs[block].test(slot)) uses[block].set(slot);
+            if (access.def) defs[block].set(slot);
+        }
+        endsWithRet[block] = instruction.opcode() == Opcode::Ret;
+
+        instructionIndices.push_back(instruction.index());
+        instructionBlocks.push_back(block);
+        accesses.push_back(access);
+    }
+    while (block < size) firstInstructions[++block] = instructionIndices.size();
+
+    // Blocks that a jsr returns to, and the blocks that return there
+    std::vector<uint32_t> returnSites;
+    std::vector<uint32_t> retBlocks;
+    for (const BasicBlock &basicBlock : cfg.blocks()) {
+        if (endsWithRet[basicBlock.id()]) retBlocks.push_back(basicBlock.id());
+
+        uint32_t last = firstInstructions[basicBlock.id() + 1] - 1;
+        uint8_t opcode = code.code()[instructionIndices[last]];
+        if (opcode != Opcode::Jsr && opcode != Opcode::JsrW) continue;
+        for (uint32_t successor : cfg.successors(basicBlock.id())) {
+            if (cfg.block(successor).start() == basicBlock.end()) returnSites.push_back(successor);
+        }
+    }
+    std::vector<bool> isReturnSite(size, false);
+    for (uint32_t returnSite : returnSites) isReturnSite[returnSite] = true;
+
+    // Reachable blocks in postorder, then the unreachable ones
+    std::vector<uint32_t> order(dominators.reversePostorder().begin(), dominators.reversePostorder().end());
+    std::reverse(order.begin(), order.end());
+    for (uint32_t id = 0; id < size; id++) {
+        if (!dominators.isReachable(id)) order.push_back(id);
+    }
+    std::vector<uint32_t> positions(size);
+    for (uint32_t i = 0; i < size; i++) positions[order[i]] = i;
+
+    // Iterate to a fixed point. Pending blocks are kept by position, and always picked at or after the last one visited,
+    // so every sweep goes through the blocks in order.
+    std::vector<BitSet> liveIn(size, BitSet(maxLocals));
+    std::vector<BitSet> liveOut(size, BitSet(maxLocals));
+    std::vector<BitSet> handlersIn(size, BitSet(maxLocals));
+    BitSet in(maxLocals);
+    BitSet pending(size);
+    for (uint32_t i = 0; i < size; i++) pending.set(i);
+    for (uint32_t position = pending.nextSetBit(0); position < size;) {
+        pending.reset(position);
+        uint32_t id = order[position];
+
+        BitSet &out = liveOut[id];
+        BitSet &handlers = handlersIn[id];
+        out.clear();
+        handlers.clear();
+        for (uint32_t successor : cfg.successors(id)) out.unionWith(liveIn[successor]);
+        for (const ExceptionalEdge &edge : cfg.exceptionalSuccessors(id)) handlers.unionWith(liveIn[edge.handler()]);
+        if (endsWithRet[id]) {
+            for (uint32_t returnSite : returnSites) out.unionWith(liveIn[returnSite]);
+        }
+        out.unionWith(handlers);
+
+        in = out;
+        in.subtract(defs[id]);
+        in.unionWith(uses[id]);
+        in.unionWith(handlers);
+        if (in != liveIn[id]) {
+            liveIn[id] = in;
+            cfg.forEachPredecessor(id, [&](uint32_t predecessor) { pending.set(positions[predecessor]); });
+            if (isReturnSite[id]) {
+                for (uint32_t retBlock : retBlocks) pending.set(positions[retBlock]);
+            }
+        }
+
+        position = pending.nextSetBit(position + 1);
+        if (position >= size) position = pending.nextSetBit(0);
+    }
+
+    // Walk every block backwards from its live-out set to find what is live before each instruction
+    std::vector<BitSet::Word> instructionLiveIn(instructionIndices.size() * stride);
+    for (uint32_t id = 0; id < size; id++) {
+        const BitSet::Word *after = liveOut[id].words().data();
+        const std::vector<BitSet::Word> &handlers = handlersIn[id].words();
+        for (uint32_t i = firstInstructions[id + 1]; i > firstInstructions[id]; i--) {
+            BitSet::Word *before = instructionLiveIn.data() + (i - 1) * stride;
+            std::copy(after, after + stride, before);
+            transfer(before, accesses[i - 1]);
+            for (uint32_t word = 0; word < stride; word++) before[word] |= handlers[word];
+            after = before;
+        }
+    }
+
+    return std::make_unique<Liveness>(maxLocals, std::move(liveIn), std::move(liveOut), std::move(instructionIndices), std::move(instructionBlocks),
+                                      std::move(instructionLiveIn));
+}
+
+Liveness::Liveness(uint32_t maxLocals, std::vector<BitSet> liveIn, std::vector<BitSet> liveOut, std::vector<uint32_t> instructionIndices,
+                   std::vector<uint32_t> instructionBlocks, std::vector<BitSet::Word> instructionLiveIn) :
+    maxLocals_(maxLocals), stride_(BitSet::wordCount(maxLocals)), liveIn_(std::move(liveIn)), liveOut_(std::move(liveOut)),
+    instructionIndices_(std::move(instructionIndices)), instructionBlocks_(std::move(instructionBlocks)),
+    instructionLiveIn_(std::move(instructionLiveIn)) { }
+
+uint32_t Liveness::ordinal(uint32_t index) const {
+    auto it = std::lower_bound(this->instructionIndices_.begin(), this->instructionIndices_.end(), index);
+    if (it == this->instructionIndices_.end() || *it != index) throw std::out_of_range("Liveness: No instruction starts at the index");
+    return it - this->instructionIndices_.begin();
+}
+
+bool Liveness::isLiveBefore(uint32_t index, uint16_t local) const {
+    if (local >= this->maxLocals_) return false;
+    const BitSet::Word *words = this->instructionLiveIn_.data() + this->ordinal(index) * this->stride_;
+    return (words[local / BitSet::WordBits] >> (local % BitSet::WordBits)) & 1;
+}
+
+BitSet Liveness::liveBefore(uint32_t index) const {
+    BitSet result(this->maxLocals_);
+    const BitSet::Word *words = this->instructionLiveIn_.data() + this->ordinal(index) * this->stride_;
+    std::copy(words, words + this->stride_, result.words().begin());
+    return result;
+}
+
+BitSet Liveness::liveAfter(uint32_t index) const {
+    uint32_t ordinal = this->ordinal(index);
+    uint32_t next = ordinal + 1;
+    if (next == this->instructionIndices_.size() || this->instructionBlocks_[next] != this->instructionBlocks_[ordinal]) {
+        return this->liveOut_[this->instructionBlocks_[ordinal]];
+    }
+
+    BitSet result(this->maxLocals_);
+    const BitSet::Word *words = this->instructionLiveIn_.data() + next * this->stride_;
+    std::copy(words, words + this->stride_, result.words().begin());
+    return result;
+}
+
+} // namespace cjbp
@@ -0,0 +1,130 @@
+// Tables describing how each opcode is encoded in a code array.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "cjbp/code_iterator.h"
+#include "cjbp/inline.h"
+
+namespace cjbp {
+
+/**
+ * The width of each opcode in bytes, including its operands.
+ *
+ * A width of 0 marks opcodes whose width depends on their operands (tableswitch, lookupswitch and wide), as well as opcodes
+ * that may not appear in a class file.
+ */
+constexpr uint8_t OpcodeWidth[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x00
+    2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, // 0x10
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x20
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, // 0x30
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+    1, 1, 1, 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3, // 0x90
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 0, 0, 1, 1, 1, 1, // 0xa0
+    1, 1, 3, 3, 3, 3, 3, 3, 3, 5, 5, 3, 2, 3, 1, 1, // 0xb0
+    3, 3, 1, 1, 0, 4, 3, 3, 5, 5, 0, 0, 0, 0, 0, 0, // 0xc0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xd0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xe0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xf0
+};
+
+/**
+ * How an opcode encodes the targets of its jumps.
+ */
+enum class BranchKind : uint8_t {
+    None = 0,
+    Branch16, // Signed 16-bit offset at index + 1 (if<cond>, goto, jsr, ifnull, ifnonnull)
+    Branch32, // Signed 32-bit offset at index + 1 (goto_w, jsr_w)
+    Switch,   // tableswitch or lookupswitch
+};
+
+constexpr std::array<BranchKind, 256> OpcodeBranchKind = [] {
+    std::array<BranchKind, 256> result {};
+    for (uint32_t opcode = Opcode::IfEq; opcode <= Opcode::Jsr; opcode++) result[opcode] = BranchKind::Branch16;
+    result[Opcode::IfNull] = BranchKind::Branch16;
+    result[Opcode::IfNonNull] = BranchKind::Branch16;
+    result[Opcode::GotoW] = BranchKind::Branch32;
+    result[Opcode::JsrW] = BranchKind::Branch32;
+    result[Opcode::TableSwitch] = BranchKind::Switch;
+    result[Opcode::LookupSwitch] = BranchKind::Switch;
+    return result;
+}();
+
+/**
+ * How an opcode encodes its operands, at a finer grain than Instruction::Format.
+ */
+enum class OperandEncoding : uint8_t {
+    Invalid = 0,
+    None,
+    Local8,        // u1 local index
+    ImplicitLocal, // Local index encoded in the opcode (iload_<n>, istore_<n>, ...)
+    Byte,          // s1 immediate (bipush)
+    Short,         // s2 immediate (sipush)
+    ArrayType,     // u1 array type (newarray)
+    Pool8,         // u1 constant pool index (ldc)
+    Pool16,        // u2 constant pool index
+    Pool16Byte,    // u2 constant pool index followed by a u1 (invokeinterface, multianewarray)
+    IInc,          // u1 local index followed by an s1 increment
+    Branch16,
+    Branch32,
+    Switch,
+    Wide,
+};
+
+constexpr std::array<OperandEncoding, 256> OpcodeEncoding = [] {
+    std::array<OperandEncoding, 256> result {};
+    for (uint32_t opcode = Opcode::Nop; opcode <= Opcode::JsrW; opcode++) result[opcode] = OperandEncoding::None;
+    result[Opcode::BiPush] = OperandEncoding::Byte;
+    result[Opcode::SiPush] = OperandEncoding::Short;
+    result[Opcode::Ldc] = OperandEncoding::Pool8;
+    result[Opcode::LdcW] = OperandEncoding::Pool16;
+    result[Opcode::Ldc2W] = OperandEncoding::Pool16;
+    for (uint32_t opcode = Opcode::ILoad; opcode <= Opcode::ALoad; opcode++) result[opcode] = OperandEncoding::Local8;
+    for (uint32_t opcode = Opcode::ILoad0; opcode <= Opcode::ALoad3; opcode++) result[opcode] = OperandEncoding::ImplicitLocal;
+    for (uint32_t opcode = Opcode::IStore; opcode <= Opcode::AStore; opcode++) result[opcode] = OperandEncoding::Local8;
+    for (uint32_t opcode = Opcode::IStore0; opcode <= Opcode::AStore3; opcode++) result[opcode] = OperandEncoding::ImplicitLocal;
+    result[Opcode::IInc] = OperandEncoding::IInc;
+    for (uint32_t opcode = Opcode::IfEq; opcode <= Opcode::Jsr; opcode++) result[opcode] = OperandEncoding::Branch16;
+    result[Opcode::Ret] = OperandEncoding::Local8;
+    result[Opcode::TableSwitch] = OperandEncoding::Switch;
+    result[Opcode::LookupSwitch] = OperandEncoding::Switch;
+    for (uint32_t opcode = Opcode::GetStatic; opcode <= Opcode::InvokeStatic; opcode++) result[opcode] = OperandEncoding::Pool16;
+    result[Opcode::InvokeInterface] = OperandEncoding::Pool16Byte;
+    result[Opcode::InvokeDynamic] = OperandEncoding::Pool16;
+    result[Opcode::New] = OperandEncoding::Pool16;
+    result[Opcode::NewArray] = OperandEncoding::ArrayType;
+    result[Opcode::ANewArray] = OperandEncoding::Pool16;
+    result[Opcode::CheckCast] = OperandEncoding::Pool16;
+    result[Opcode::InstanceOf] = OperandEncoding::Pool16;
+    result[Opcode::Wide] = OperandEncoding::Wide;
+    result[Opcode::MultiANewArray] = OperandEncoding::Pool16Byte;
+    result[Opcode::IfNull] = OperandEncoding::Branch16;
+    result[Opcode::IfNonNull] = OperandEncoding::Branch16;
+    result[Opcode::GotoW] = OperandEncoding::Branch32;
+    result[Opcode::JsrW] = OperandEncoding::Branch32;
+    return result;
+}();
+
+/// @return The local variable index implied by an iload_<n>, istore_<n>, etc. opcode.
+CJBP_INLINE uint16_t implicitLocal(uint8_t opcode) { return (opcode < Opcode::IStore ? opcode - Opcode::ILoad0 : opcode - Opcode::IStore0) & 3; }
+
+/// @return The index of the 4-byte aligned operands of a tableswitch or lookupswitch at the given index.
+CJBP_INLINE uint32_t switchOperandsIndex(uint32_t index) { return (index + 4) & ~3; }
+
+/// @return The width of a wide instruction, given the opcode it modifies.
+CJBP_INLINE uint32_t wideWidth(uint8_t modifiedOpcode) { return modifiedOpcode == Opcode::IInc ? 6 : 4; }
+
+/// @return true if the opcode may follow a wide prefix.
+CJBP_INLINE bool isWideModifiable(uint8_t opcode) {
+    return (Opcode::ILoad <= opcode && opcode <= Opcode::ALoad) || (Opcode::IStore <= opcode && opcode <= Opcode::AStore) || opcode == Opcode::IInc ||
+           opcode == Opcode::Ret;
+}
+
+} // namespace cjbp
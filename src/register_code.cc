@@ -0,0 +1,336 @@
+#include "cjbp/register_code.h"
+
+#include <cassert>
+#include <utility>
+
+#include "cjbp/code_attribute.h"
+#include "cjbp/code_bitmap.h"
+#include "cjbp/constant_pool.h"
+#include "cjbp/control_flow_graph.h"
+#include "cjbp/descriptor.h"
+#include "cjbp/type_inference.h"
+#include "string_util.h"
+#include "type_util.h"
+
+namespace cjbp {
+
+namespace {
+
+/**
+ * How a stack shuffling opcode (dup through swap) rearranges the top of the stack: it takes the top `in` slots, and
+ * leaves `out` slots, each a copy of the taken slot at position `from[i]`, counted from the deepest one taken.
+ */
+struct Shuffle {
+    uint8_t in;
+    uint8_t out;
+    uint8_t from[6];
+};
+
+constexpr Shuffle Shuffles[] = {
+    { 1, 2, { 0, 0 } },             // dup
+    { 2, 3, { 1, 0, 1 } },          // dup_x1
+    { 3, 4, { 2, 0, 1, 2 } },       // dup_x2
+    { 2, 4, { 0, 1, 0, 1 } },       // dup2
+    { 3, 5, { 1, 2, 0, 1, 2 } },    // dup2_x1
+    { 4, 6, { 2, 3, 0, 1, 2, 3 } }, // dup2_x2
+    { 2, 2, { 1, 0 } },             // swap
+};
+
+CJBP_INLINE bool isLoad(uint8_t opcode) {
+    return (Opcode::ILoad <= opcode && opcode <= Opcode::ALoad) || (Opcode::ILoad0 <= opcode && opcode <= Opcode::ALoad3);
+}
+
+CJBP_INLINE bool isStore(uint8_t opcode) {
+    return (Opcode::IStore <= opcode && opcode <= Opcode::AStore) || (Opcode::IStore0 <= opcode && opcode <= Opcode::AStore3);
+}
+
+/// @return true if the slot holds the second half of a long or double.
+CJBP_INLINE bool isSecondHalf(const TypeFrame &frame, uint32_t slot) {
+    Span<ValueType> stack = frame.stack();
+    return slot > 0 && stack[slot] == ValueType::Tag::Top && stack[slot - 1].isCategory2();
+}
+
+/// @return The number of slots of the value that starts at a slot.
+CJBP_INLINE uint32_t valueWidth(const TypeFrame &frame, uint32_t slot) {
+    return slot + 1 < frame.depth() && isSecondHalf(frame, slot + 1) ? 2 : 1;
+}
+
+/**
+ * Translates the instructions of one block at a time, keeping for every stack slot the register that currently holds its
+ * value: its own stack register, a local variable register that it was loaded from, or the stack register of a deeper slot
+ * that it was duplicated from. The register that a slot refers to is never overwritten while the slot is live: a store to
+ * a local variable first copies the slots that refer to it, and every shuffle that moves deeper slots copies all the slots
+ * that it takes. On entry to and exit from a block, every slot refers to its own stack register.
+ */
+class Translator {
+public:
+    std::vector<RegisterInstruction> instructions;
+    std::vector<uint32_t> sources;
+
+    Translator(const ConstantPool &constantPool, uint32_t maxLocals, uint32_t maxStack) :
+        constantPool_(constantPool), maxLocals_(maxLocals), scratch_(maxLocals + maxStack), aliases_(maxStack), blockStart_(0) { }
+
+    CJBP_INLINE void begin() {
+        for (uint32_t slot = 0; slot < this->aliases_.size(); slot++) this->aliases_[slot] = this->maxLocals_ + slot;
+        this->blockStart_ = this->instructions.size();
+    }
+
+    /**
+     * Translates an instruction, given the types before and after it.
+     *
+     * @param last Whether the instruction ends its block, after which the stack must be in its own registers.
+     */
+    void translate(const Instruction &instruction, const TypeFrame &before, const TypeFrame &after, bool last) {
+        uint8_t opcode = instruction.opcode();
+        uint32_t depth = before.depth();
+        if (isLoad(opcode)) {
+            uint16_t local = instruction.localIndex();
+            this->alias(depth, local, width(KindTypes[localKind(opcode, Opcode::ILoad, Opcode::ILoad0)]));
+        } else if (isStore(opcode)) {
+            uint32_t slots = width(KindTypes[localKind(opcode, Opcode::IStore, Opcode::IStore0)]);
+            this->store(instruction, before, depth - slots, instruction.localIndex());
+        } else if (opcode == Opcode::IInc) {
+            uint32_t local = instruction.localIndex();
+            this->evict(instruction, before, depth, local);
+            this->emit(instruction, opcode, local, &local, 1);
+        } else if (Opcode::Dup <= opcode && opcode <= Opcode::Swap) {
+            this->shuffle(instruction, after, depth, Shuffles[opcode - Opcode::Dup]);
+        } else if (opcode != Opcode::Nop && opcode != Opcode::Pop && opcode != Opcode::Pop2) {
+            this->compute(instruction, before, after, last);
+            return;
+        }
+        if (last) this->flush(instruction, after, after.depth());
+    }
+
+private:
+    const ConstantPool &constantPool_;
+    uint32_t maxLocals_;
+    uint32_t scratch_;
+    std::vector<uint32_t> aliases_; // Register holding the value of every stack slot
+    uint32_t blockStart_;           // Position of the first instruction of the current block
+
+    CJBP_INLINE uint32_t stackRegister(uint32_t slot) const { return this->maxLocals_ + slot; }
+
+    CJBP_INLINE void alias(uint32_t slot, uint32_t reg, uint32_t width) {
+        this->aliases_[slot] = reg;
+        if (width == 2) this->aliases_[slot + 1] = reg + 1;
+    }
+
+    CJBP_INLINE void emit(const Instruction &instruction, uint8_t opcode, uint32_t destination, const uint32_t *registers, uint32_t count) {
+        assert(count <= UINT8_MAX);
+        this->instructions.emplace_back(instruction, opcode, destination, this->sources.size(), count);
+        this->sources.insert(this->sources.end(), registers, registers + count);
+    }
+
+    CJBP_INLINE void move(const Instruction &instruction, uint32_t destination, uint32_t source) {
+        this->emit(instruction, RegisterCode::Move, destination, &source, 1);
+    }
+
+    /// Copies the slots below `limit` that do not hold their value in their own register to it.
+    void flush(const Instruction &instruction, const TypeFrame &frame, uint32_t limit) {
+        // A slot only refers to a deeper stack register if that register holds the deeper slot's value, so no copy
+        // overwrites the source of another
+        for (uint32_t slot = 0; slot < limit; slot++) {
+            uint32_t reg = this->stackRegister(slot);
+            if (this->aliases_[slot] == reg || isSecondHalf(frame, slot)) continue;
+            this->move(instruction, reg, this->aliases_[slot]);
+            this->alias(slot, reg, valueWidth(frame, slot));
+        }
+    }
+
+    /**
+     * Copies the slots below `limit` that refer to a register to their own register, before the register is overwritten.
+     *
+     * @return true if any slot was copied.
+     */
+    bool evict(const Instruction &instruction, const TypeFrame &frame, uint32_t limit, uint32_t reg) {
+        bool evicted = false;
+        for (uint32_t slot = 0; slot < limit; slot++) {
+            if (this->aliases_[slot] != reg || isSecondHalf(frame, slot)) continue;
+            this->move(instruction, this->stackRegister(slot), reg);
+            this->alias(slot, this->stackRegister(slot), valueWidth(frame, slot));
+            evicted = true;
+        }
+        return evicted;
+    }
+
+    void store(const Instruction &instruction, const TypeFrame &before, uint32_t slot, uint32_t local) {
+        uint32_t value = this->aliases_[slot];
+        if (value == local) return;
+        bool evicted = this->evict(instruction, before, slot, local);
+
+        // If the value was just computed into its stack register, which nothing else refers to, compute it into the
+        // local variable instead
+        if (!evicted && value == this->stackRegister(slot) && this->instructions.size() > this->blockStart_ &&
+            this->instructions.back().destination() == value) {
+            RegisterInstruction &last = this->instructions.back();
+            last = RegisterInstruction(last.instruction(), last.opcode(), local, last.firstSource(), last.sourceCount());
+            return;
+        }
+        this->move(instruction, local, value);
+    }
+
+    void shuffle(const Instruction &instruction, const TypeFrame &after, uint32_t depth, const Shuffle &shuffle) {
+        uint32_t base = depth - shuffle.in;
+        uint32_t from[6];
+        for (uint32_t i = 0; i < shuffle.out; i++) from[i] = this->aliases_[base + shuffle.from[i]];
+        for (uint32_t i = 0; i < shuffle.out; i++) this->aliases_[base + i] = from[i];
+
+        // dup and dup2 leave the slots they take in place, so the copies can keep referring to them
+        if (shuffle.from[0] == 0 && (shuffle.in == 1 || shuffle.from[1] == 1)) return;
+
+        // Otherwise, slots that moved must not keep referring to the stack registers of the slots taken, which are about
+        // to be overwritten: copy them all at once
+        std::vector<std::pair<uint32_t, uint32_t>> moves; // Destination and source
+        for (uint32_t slot = base; slot < base + shuffle.out; slot++) {
+            uint32_t reg = this->stackRegister(slot);
+            uint32_t source = this->aliases_[slot];
+            if (source == reg || source < this->stackRegister(base) || isSecondHalf(after, slot)) continue;
+            moves.emplace_back(reg, source);
+            this->alias(slot, reg, valueWidth(after, slot));
+        }
+        this->parallelMove(instruction, moves);
+    }
+
+    /// Sequentializes moves with distinct destinations, as if they all read their source before any writes.
+    void parallelMove(const Instruction &instruction, std::vector<std::pair<uint32_t, uint32_t>> &moves) {
+        while (!moves.empty()) {
+            // Emit a move whose destination is not the source of another, if any
+            bool found = false;
+            for (uint32_t i = 0; i < moves.size() && !found; i++) {
+                bool isSource = false;
+                for (uint32_t j = 0; j < moves.size() && !isSource; j++) isSource = j != i && moves[j].second == moves[i].first;
+                if (isSource) continue;
+                this->move(instruction, moves[i].first, moves[i].second);
+                moves.erase(moves.begin() + i);
+                found = true;
+            }
+            if (found) continue;
+
+            // Every remaining move is part of a cycle: save one source in the scratch register to break it
+            uint32_t source = moves.front().second;
+            this->move(instruction, this->scratch_, source);
+            for (auto &move : moves) {
+                if (move.second == source) move.second = this->scratch_;
+            }
+        }
+    }
+
+    /// @return true if the instruction pushes a value.
+    bool pushes(const Instruction &instruction) const {
+        uint8_t opcode = instruction.opcode();
+        if (Opcode::IAStore <= opcode && opcode <= Opcode::SAStore) return false;
+        if (Opcode::IfEq <= opcode && opcode <= Opcode::Goto) return false;
+        if (Opcode::Ret <= opcode && opcode <= Opcode::Return) return false;
+        switch (opcode) {
+            case Opcode::PutStatic:
+            case Opcode::PutField:
+            case Opcode::AThrow:
+            case Opcode::MonitorEnter:
+            case Opcode::MonitorExit:
+            case Opcode::IfNull:
+            case Opcode::IfNonNull:
+            case Opcode::GotoW: return false;
+            case Opcode::InvokeVirtual:
+            case Opcode::InvokeSpecial:
+            case Opcode::InvokeStatic:
+            case Opcode::InvokeInterface: {
+                // The reference was checked by TypeInference
+                uint16_t index = instruction.poolIndex();
+                const MethodDescriptor &descriptor = this->constantPool_.isValid(index, ConstantPool::Tag::InterfaceMethodRef)
+                                                         ? this->constantPool_.interfaceMethodRefDesc(index)
+                                                         : this->constantPool_.methodRefDesc(index);
+                return descriptor.returnType().type() != Descriptor::Type::Void;
+            }
+            case Opcode::InvokeDynamic: {
+                MethodDescriptor descriptor = MethodDescriptor::read(this->constantPool_.invokeDynamicType(instruction.poolIndex()));
+                return descriptor.returnType().type() != Descriptor::Type::Void;
+            }
+            default: return true;
+        }
+    }
+
+    /// Translates an instruction that pops its operands and pushes at most one value.
+    void compute(const Instruction &instruction, const TypeFrame &before, const TypeFrame &after, bool last) {
+        uint32_t width = 0;
+        if (this->pushes(instruction)) width = after.depth() >= 2 && isSecondHalf(after, after.depth() - 1) ? 2 : 1;
+        uint32_t remaining = after.depth() - width;
+        if (remaining > before.depth()) throw CorruptClassFile("RegisterCode: Instruction pushes more than one value");
+
+        uint32_t operands[UINT8_MAX];
+        uint32_t count = 0;
+        for (uint32_t slot = remaining; slot < before.depth(); slot++) {
+            if (isSecondHalf(before, slot)) continue;
+            if (count == UINT8_MAX) throw CorruptClassFile("RegisterCode: Too many operands");
+            operands[count++] = this->aliases_[slot];
+        }
+
+        // A jump must find the stack in place, but any other instruction that ends a block falls through after it
+        bool transfers = instruction.isBranch() || instruction.isSwitch() || instruction.opcode() == Opcode::Ret;
+        if (last && transfers) this->flush(instruction, before, remaining);
+        uint32_t destination = width == 0 ? RegisterInstruction::NoRegister : this->stackRegister(remaining);
+        this->emit(instruction, instruction.opcode(), destination, operands, count);
+        if (width != 0) this->alias(remaining, destination, width);
+        if (last && !transfers) this->flush(instruction, after, after.depth());
+    }
+};
+
+} // namespace
+
+std::unique_ptr<RegisterCode> RegisterCode::build(TypeInference &types) {
+    CodeAttributeInfo &code = types.code();
+    const ControlFlowGraph &cfg = *code.cfg();
+    uint32_t maxLocals = code.maxLocals();
+    uint32_t maxStack = code.maxStack();
+
+    Translator translator(types.constantPool(), maxLocals, maxStack);
+    translator.instructions.reserve(code.bitmap().instructionCount());
+    std::vector<uint32_t> blockOffsets;
+    blockOffsets.reserve(cfg.size() + 1);
+    UncheckedCodeIterator iterator = code.uncheckedIterator();
+    TypeFrame before(maxLocals, maxStack);
+    for (const BasicBlock &block : cfg.blocks()) {
+        blockOffsets.push_back(translator.instructions.size());
+        std::optional<TypeFrame> frame = types.entry(block.id());
+        if (!frame.has_value()) continue;
+
+        translator.begin();
+        iterator.moveTo(block.start());
+        while (iterator.peek() < block.end()) {
+            Instruction instruction = iterator.nextInstruction();
+            before = *frame;
+            types.execute(instruction, *frame);
+            translator.translate(instruction, before, *frame, instruction.nextIndex() >= block.end());
+        }
+    }
+    blockOffsets.push_back(translator.instructions.size());
+
+    return std::make_unique<RegisterCode>(maxLocals, maxStack, std::move(translator.instructions), std::move(blockOffsets),
+                                          std::move(translator.sources));
+}
+
+RegisterCode::RegisterCode(uint32_t maxLocals, uint32_t maxStack, std::vector<RegisterInstruction> instructions, std::vector<uint32_t> blockOffsets,
+                           std::vector<uint32_t> sources) :
+    maxLocals_(maxLocals), maxStack_(maxStack), instructions_(std::move(instructions)), blockOffsets_(std::move(blockOffsets)),
+    sources_(std::move(sources)) { }
+
+std::string RegisterCode::toString() const {
+    std::string result = "Register code:";
+    for (uint32_t block = 0; block + 1 < this->blockOffsets_.size(); block++) {
+        result += "\n";
+        result += indent("Block " + std::to_string(block) + ":", 1);
+        for (const RegisterInstruction &instruction : this->blockInstructions(block)) {
+            std::string line = std::to_string(instruction.instruction().index()) + ": ";
+            if (instruction.hasDestination()) line += "r" + std::to_string(instruction.destination()) + " = ";
+            line += instruction.isMove() ? "move" : instruction.instruction().toString();
+
+            Span<uint32_t> sources = this->sources(instruction);
+            for (uint32_t i = 0; i < sources.size(); i++) line += (i == 0 ? " " : ", ") + std::string("r") + std::to_string(sources[i]);
+            result += "\n";
+            result += indent(line, 2);
+        }
+    }
+    return result;
+}
+
+} // namespace cjbp
@@ -0,0 +1,112 @@
+#include "cjbp/superinstruction.h"
+
+#include <stdexcept>
+
+#include "cjbp/code_attribute.h"
+#include "cjbp/code_bitmap.h"
+#include "cjbp/control_flow_graph.h"
+#include "string_util.h"
+
+namespace cjbp {
+
+namespace {
+
+const std::vector<uint8_t> ILoads = { Opcode::ILoad, Opcode::ILoad0, Opcode::ILoad1, Opcode::ILoad2, Opcode::ILoad3 };
+const std::vector<uint8_t> ALoads = { Opcode::ALoad, Opcode::ALoad0, Opcode::ALoad1, Opcode::ALoad2, Opcode::ALoad3 };
+const std::vector<uint8_t> IntArithmetic = { Opcode::IAdd, Opcode::ISub, Opcode::IMul, Opcode::IAnd, Opcode::IOr, Opcode::IXor };
+const std::vector<uint8_t> IfICmps = { Opcode::IfICmpEq, Opcode::IfICmpNe, Opcode::IfICmpLt,
+                                       Opcode::IfICmpGe, Opcode::IfICmpGt, Opcode::IfICmpLe };
+const std::vector<uint8_t> Ifs = { Opcode::IfEq, Opcode::IfNe, Opcode::IfLt, Opcode::IfGe, Opcode::IfGt, Opcode::IfLe };
+
+} // namespace
+
+SuperinstructionSet::SuperinstructionSet() : candidates_(256) { }
+
+void SuperinstructionSet::addDefaults() {
+    this->add("iload_iload_iop", { ILoads, ILoads, IntArithmetic });
+    this->add("iload_iload_if_icmp", { ILoads, ILoads, IfICmps });
+    this->add("aload_0_getfield", { { Opcode::ALoad0 }, { Opcode::GetField } });
+    this->add("aload_getfield", { ALoads, { Opcode::GetField } });
+    this->add("iload_if", { ILoads, Ifs });
+    this->add("aload_arraylength", { ALoads, { Opcode::ArrayLength } });
+    this->add("iinc_goto", { { Opcode::IInc }, { Opcode::Goto } });
+    this->add("new_dup", { { Opcode::New }, { Opcode::Dup } });
+}
+
+uint16_t SuperinstructionSet::add(std::string name, const std::vector<std::vector<uint8_t>> &elements) {
+    if (elements.size() < 2 || elements.size() > MaxLength) throw std::invalid_argument("SuperinstructionSet::add: Invalid pattern length");
+    if (this->patterns_.size() >= FusedInstruction::NoPattern) throw std::invalid_argument("SuperinstructionSet::add: Too many patterns");
+
+    Pattern pattern { std::move(name), {} };
+    for (const std::vector<uint8_t> &element : elements) {
+        if (element.empty()) throw std::invalid_argument("SuperinstructionSet::add: Empty pattern element");
+
+        BitSet opcodes(256);
+        for (uint8_t opcode : element) opcodes.set(opcode);
+        pattern.elements.push_back(std::move(opcodes));
+    }
+
+    uint16_t id = this->patterns_.size();
+    pattern.elements[0].forEach([&](uint32_t opcode) { this->candidates_[opcode].push_back(id); });
+    this->patterns_.push_back(std::move(pattern));
+    return id;
+}
+
+
+
+FusedInstructionStream FusedInstructionStream::build(CodeAttributeInfo &code, const SuperinstructionSet &set) {
+    // Every jump target starts a CFG block, so the block starts are the only boundaries
+    const CodeBitmap &bitmap = code.bitmap();
+    BitSet boundaries(code.code().size());
+    for (const BasicBlock &block : code.cfg()->blocks()) boundaries.set(block.start());
+
+    std::vector<Instruction> instructions;
+    instructions.reserve(bitmap.instructionCount());
+    for (const Instruction &instruction : code.uncheckedInstructions()) instructions.push_back(instruction);
+
+    std::vector<FusedInstruction> fused;
+    fused.reserve(instructions.size());
+    for (uint32_t i = 0; i < instructions.size();) {
+        const Instruction &first = instructions[i];
+        uint16_t match = FusedInstruction::NoPattern;
+        uint32_t count = 1;
+        for (uint16_t id : set.candidates(first.opcode())) {
+            const std::vector<BitSet> &elements = set.pattern(id).elements;
+            if (i + elements.size() > instructions.size()) continue;
+
+            uint32_t j = 1;
+            while (j < elements.size() && !boundaries.test(instructions[i + j].index()) && elements[j].test(instructions[i + j].opcode())) j++;
+            if (j == elements.size()) {
+                match = id;
+                count = j;
+                break;
+            }
+        }
+
+        const Instruction &last = instructions[i + count - 1];
+        fused.emplace_back(first.index(), last.nextIndex() - first.index(), i, match, count);
+        i += count;
+    }
+
+    return { std::move(instructions), std::move(fused) };
+}
+
+std::string FusedInstructionStream::toString(const SuperinstructionSet &set) const {
+    std::string result = "Fused instructions:";
+    for (const FusedInstruction &fused : this->fused_) {
+        result += '\n';
+        if (!fused.isFused()) {
+            result += indent(std::to_string(fused.index()) + ": " + this->instruction(fused, 0).toString(), 1);
+            continue;
+        }
+
+        result += indent(std::to_string(fused.index()) + ": " + set.pattern(fused.pattern()).name, 1);
+        for (uint32_t i = 0; i < fused.count(); i++) {
+            result += '\n';
+            result += indent(this->instruction(fused, i).toString(), 2);
+        }
+    }
+    return result;
+}
+
+} // namespace cjbp
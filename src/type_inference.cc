@@ -0,0 +1,608 @@
+#include "cjbp/type_inference.h"
+
+#include <stdexcept>
+
+#include "cjbp/class_file.h"
+#include "cjbp/code_bitmap.h"
+#include "cjbp/control_flow_graph.h"
+#include "cjbp/descriptor.h"
+#include "cjbp/dominator_tree.h"
+#include "cjbp/method_info.h"
+#include "type_util.h"
+
+namespace cjbp {
+
+namespace {
+
+using Tag = ValueType::Tag;
+
+} // namespace
+
+std::unique_ptr<TypeInference> TypeInference::build(const ClassFile &classFile, const MethodInfo &method) {
+    CodeAttributeInfo *code = method.code();
+    if (code == nullptr) throw std::invalid_argument("TypeInference::build: Method has no code");
+    std::unique_ptr<TypeInference> inference(new TypeInference(method.constantPool(), *code, classFile.name()));
+    const ControlFlowGraph &cfg = inference->cfg_;
+
+    // Locals and stack of the current frame, with a long or double as a single entry, as in a StackMapTable. The implicit
+    // initial frame holds the receiver and the parameters.
+    std::vector<ValueType> locals;
+    std::vector<ValueType> stack;
+    if (!method.isStatic()) {
+        bool constructor = method.name() == "<init>" && classFile.name() != "java.lang.Object";
+        locals.push_back(constructor ? ValueType(Tag::UninitializedThis) : inference->this_);
+    }
+    for (const Descriptor &parameter : method.descriptor().params()) locals.push_back(inference->value(parameter));
+
+    auto store = [&](uint32_t start) {
+        uint32_t block = cfg.blockAt(start);
+        if (block == BasicBlock::None || cfg.block(block).start() != start) {
+            throw CorruptClassFile("TypeInference::build: Stack map frame is not at the start of a block");
+        }
+        TypeFrame frame(code->maxLocals(), code->maxStack());
+        uint32_t slot = 0;
+        for (ValueType type : locals) {
+            frame.setLocal(slot, type);
+            slot += width(type.tag());
+        }
+        for (ValueType type : stack) frame.pushValue(type);
+        inference->store(block, frame);
+    };
+    if (cfg.size() > 0) store(0);
+
+    // The table decodes its frames against the same initial frame
+    if (const StackMapTableAttributeInfo *stackMap = code->stackMap(); stackMap != nullptr) {
+        for (const AbsoluteStackMapFrame &frame : stackMap->frames()) {
+            locals.clear();
+            stack.clear();
+            for (const VerificationTypeInfo &type : frame.locals()) locals.push_back(inference->value(type));
+            for (const VerificationTypeInfo &type : frame.stack()) stack.push_back(inference->value(type));
+            store(frame.start());
+        }
+    }
+    return inference;
+}
+
+TypeInference::TypeInference(const ConstantPool &constantPool, CodeAttributeInfo &code, const std::string &className) :
+    constantPool_(constantPool), code_(code), cfg_(*code.cfg()), stride_(code.maxLocals() + code.maxStack()),
+    hasStackMap_(code.stackMap() != nullptr), solved_(false) {
+    uint32_t size = this->cfg_.size();
+    this->entries_.resize(size * this->stride_);
+    this->depths_.resize(size, 0);
+    this->states_.resize(size, State::Pending);
+    this->this_ = this->object(className);
+    this->object_ = this->object("java.lang.Object");
+}
+
+std::string TypeInference::toString(ValueType type) const {
+    switch (type.tag()) {
+        case Tag::Top: return "Top";
+        case Tag::Integer: return "Integer";
+        case Tag::Float: return "Float";
+        case Tag::Long: return "Long";
+        case Tag::Double: return "Double";
+        case Tag::Null: return "Null";
+        case Tag::UninitializedThis: return "UninitializedThis";
+        case Tag::Object: return "Object " + this->className(type);
+        case Tag::Uninitialized: return "Uninitialized " + std::to_string(type.offset());
+        case Tag::ReturnAddress: return "ReturnAddress " + std::to_string(type.offset());
+        default: return "Unknown";
+    }
+}
+
+std::optional<TypeFrame> TypeInference::entry(uint32_t block) {
+    if (!this->hasStackMap_ && !this->solved_) this->solve();
+    if (this->states_[block] == State::Pending) this->derive(block);
+    if (this->states_[block] == State::Unreachable) return std::nullopt;
+    return this->load(block);
+}
+
+std::optional<TypeFrame> TypeInference::frameAt(uint32_t index) {
+    if (index >= this->code_.code().size() || !this->code_.bitmap().isInstructionStart(index)) {
+        throw std::out_of_range("TypeInference::frameAt: No instruction starts at the index");
+    }
+    uint32_t block = this->cfg_.blockAt(index);
+    std::optional<TypeFrame> frame = this->entry(block);
+    if (frame.has_value()) this->replay(block, *frame, index);
+    return frame;
+}
+
+void TypeInference::execute(const Instruction &instruction, TypeFrame &frame) {
+    uint8_t opcode = instruction.opcode();
+
+    // Families of typed opcodes, which only differ in the type they work on
+    if ((Opcode::ILoad <= opcode && opcode <= Opcode::ALoad) || (Opcode::ILoad0 <= opcode && opcode <= Opcode::ALoad3)) {
+        Tag tag = KindTypes[localKind(opcode, Opcode::ILoad, Opcode::ILoad0)];
+        frame.pushValue(tag == Tag::Top ? frame.local(instruction.localIndex()) : ValueType(tag));
+        return;
+    }
+    if ((Opcode::IStore <= opcode && opcode <= Opcode::AStore) || (Opcode::IStore0 <= opcode && opcode <= Opcode::AStore3)) {
+        Tag tag = KindTypes[localKind(opcode, Opcode::IStore, Opcode::IStore0)];
+        frame.pop(width(tag) - 1);
+        ValueType value = frame.pop();
+        frame.setLocal(instruction.localIndex(), tag == Tag::Top ? value : ValueType(tag));
+        return;
+    }
+    if (Opcode::IAdd <= opcode && opcode <= Opcode::DRem) {
+        Tag tag = KindTypes[(opcode - Opcode::IAdd) % 4];
+        frame.pop(2 * width(tag));
+        frame.pushValue(tag);
+        return;
+    }
+    if (Opcode::INeg <= opcode && opcode <= Opcode::DNeg) {
+        Tag tag = KindTypes[(opcode - Opcode::INeg) % 4];
+        frame.pop(width(tag));
+        frame.pushValue(tag);
+        return;
+    }
+    if (Opcode::IShl <= opcode && opcode <= Opcode::LUShr) {
+        // The shift distance is always an int
+        Tag tag = (opcode - Opcode::IShl) % 2 == 0 ? Tag::Integer : Tag::Long;
+        frame.pop(width(tag) + 1);
+        frame.pushValue(tag);
+        return;
+    }
+    if (Opcode::IAnd <= opcode && opcode <= Opcode::LXor) {
+        Tag tag = (opcode - Opcode::IAnd) % 2 == 0 ? Tag::Integer : Tag::Long;
+        frame.pop(2 * width(tag));
+        frame.pushValue(tag);
+        return;
+    }
+    if (Opcode::I2L <= opcode && opcode <= Opcode::I2S) {
+        const Tag *types = ConversionTypes[opcode - Opcode::I2L];
+        frame.pop(width(types[0]));
+        frame.pushValue(types[1]);
+        return;
+    }
+
+    switch (opcode) {
+        case Opcode::Nop:
+        case Opcode::IInc:
+        case Opcode::Goto:
+        case Opcode::GotoW:
+        case Opcode::Ret:
+        case Opcode::Return: break;
+
+        case Opcode::AConstNull: frame.push(Tag::Null); break;
+        case Opcode::IConstM1:
+        case Opcode::IConst0:
+        case Opcode::IConst1:
+        case Opcode::IConst2:
+        case Opcode::IConst3:
+        case Opcode::IConst4:
+        case Opcode::IConst5:
+        case Opcode::BiPush:
+        case Opcode::SiPush: frame.push(Tag::Integer); break;
+        case Opcode::LConst0:
+        case Opcode::LConst1: frame.pushValue(Tag::Long); break;
+        case Opcode::FConst0:
+        case Opcode::FConst1:
+        case Opcode::FConst2: frame.push(Tag::Float); break;
+        case Opcode::DConst0:
+        case Opcode::DConst1: frame.pushValue(Tag::Double); break;
+        case Opcode::Ldc:
+        case Opcode::LdcW:
+        case Opcode::Ldc2W: frame.pushValue(this->constant(instruction.poolIndex())); break;
+
+        case Opcode::AALoad: {
+            frame.pop(1);
+            ValueType array = frame.pop();
+            if (array.tag() != Tag::Object) {
+                frame.push(array.tag() == Tag::Null ? Tag::Null : Tag::Top);
+                break;
+            }
+            const std::string &name = this->className(array);
+            if (name[0] != '[') {
+                frame.push(this->object_);
+            } else if (name[1] == '[') {
+                frame.push(this->object(name.substr(1)));
+            } else if (name[1] == 'L') {
+                frame.push(this->object(name.substr(2, name.size() - 3)));
+            } else {
+                frame.push(Tag::Top);
+            }
+            break;
+        }
+        case Opcode::IALoad:
+        case Opcode::BALoad:
+        case Opcode::CALoad:
+        case Opcode::SALoad: frame.pop(2); frame.push(Tag::Integer); break;
+        case Opcode::LALoad: frame.pop(2); frame.pushValue(Tag::Long); break;
+        case Opcode::FALoad: frame.pop(2); frame.push(Tag::Float); break;
+        case Opcode::DALoad: frame.pop(2); frame.pushValue(Tag::Double); break;
+        case Opcode::LAStore:
+        case Opcode::DAStore: frame.pop(4); break;
+        case Opcode::IAStore:
+        case Opcode::FAStore:
+        case Opcode::AAStore:
+        case Opcode::BAStore:
+        case Opcode::CAStore:
+        case Opcode::SAStore: frame.pop(3); break;
+
+        case Opcode::Pop: frame.pop(1); break;
+        case Opcode::Pop2: frame.pop(2); break;
+        case Opcode::Dup: frame.push(frame.peek(0)); break;
+        case Opcode::DupX1: {
+            ValueType a = frame.pop();
+            ValueType b = frame.pop();
+            frame.push(a);
+            frame.push(b);
+            frame.push(a);
+            break;
+        }
+        case Opcode::DupX2: {
+            ValueType a = frame.pop();
+            ValueType b = frame.pop();
+            ValueType c = frame.pop();
+            frame.push(a);
+            frame.push(c);
+            frame.push(b);
+            frame.push(a);
+            break;
+        }
+        case Opcode::Dup2: {
+            ValueType a = frame.peek(0);
+            ValueType b = frame.peek(1);
+            frame.push(b);
+            frame.push(a);
+            break;
+        }
+        case Opcode::Dup2X1: {
+            ValueType a = frame.pop();
+            ValueType b = frame.pop();
+            ValueType c = frame.pop();
+            frame.push(b);
+            frame.push(a);
+            frame.push(c);
+            frame.push(b);
+            frame.push(a);
+            break;
+        }
+        case Opcode::Dup2X2: {
+            ValueType a = frame.pop();
+            ValueType b = frame.pop();
+            ValueType c = frame.pop();
+            ValueType d = frame.pop();
+            frame.push(b);
+            frame.push(a);
+            frame.push(d);
+            frame.push(c);
+            frame.push(b);
+            frame.push(a);
+            break;
+        }
+        case Opcode::Swap: {
+            ValueType a = frame.pop();
+            ValueType b = frame.pop();
+            frame.push(a);
+            frame.push(b);
+            break;
+        }
+
+        case Opcode::LCmp:
+        case Opcode::DCmpL:
+        case Opcode::DCmpG: {
+            frame.pop(4);
+            frame.push(Tag::Integer);
+            break;
+        }
+        case Opcode::FCmpL:
+        case Opcode::FCmpG: {
+            frame.pop(2);
+            frame.push(Tag::Integer);
+            break;
+        }
+
+        case Opcode::IfEq:
+        case Opcode::IfNe:
+        case Opcode::IfLt:
+        case Opcode::IfGe:
+        case Opcode::IfGt:
+        case Opcode::IfLe:
+        case Opcode::IfNull:
+        case Opcode::IfNonNull:
+        case Opcode::TableSwitch:
+        case Opcode::LookupSwitch:
+        case Opcode::IReturn:
+        case Opcode::FReturn:
+        case Opcode::AReturn:
+        case Opcode::AThrow:
+        case Opcode::MonitorEnter:
+        case Opcode::MonitorExit: frame.pop(1); break;
+        case Opcode::IfICmpEq:
+        case Opcode::IfICmpNe:
+        case Opcode::IfICmpLt:
+        case Opcode::IfICmpGe:
+        case Opcode::IfICmpGt:
+        case Opcode::IfICmpLe:
+        case Opcode::IfACmpEq:
+        case Opcode::IfACmpNe:
+        case Opcode::LReturn:
+        case Opcode::DReturn: frame.pop(2); break;
+        case Opcode::Jsr:
+        case Opcode::JsrW: frame.push(ValueType(Tag::ReturnAddress, instruction.nextIndex())); break;
+
+        case Opcode::GetStatic:
+        case Opcode::PutStatic:
+        case Opcode::GetField:
+        case Opcode::PutField: {
+            uint16_t index = instruction.poolIndex();
+            if (!this->constantPool_.isValid(index, ConstantPool::Tag::FieldRef)) throw CorruptClassFile("TypeInference::execute: Invalid field reference");
+            const Descriptor &descriptor = this->constantPool_.fieldRefDesc(index);
+            if (opcode == Opcode::PutStatic || opcode == Opcode::PutField) frame.pop(descriptor.formalSize());
+            if (opcode == Opcode::GetField || opcode == Opcode::PutField) frame.pop(1);
+            if (opcode == Opcode::GetStatic || opcode == Opcode::GetField) frame.pushValue(this->value(descriptor));
+            break;
+        }
+        case Opcode::InvokeVirtual:
+        case Opcode::InvokeSpecial:
+        case Opcode::InvokeStatic:
+        case Opcode::InvokeInterface: {
+            uint16_t index = instruction.poolIndex();
+            bool interface = this->constantPool_.isValid(index, ConstantPool::Tag::InterfaceMethodRef);
+            if (!interface && !this->constantPool_.isValid(index, ConstantPool::Tag::MethodRef)) {
+                throw CorruptClassFile("TypeInference::execute: Invalid method reference");
+            }
+            const MethodDescriptor &descriptor =
+                interface ? this->constantPool_.interfaceMethodRefDesc(index) : this->constantPool_.methodRefDesc(index);
+            frame.pop(descriptor.formalParamSize());
+            if (opcode != Opcode::InvokeStatic) {
+                ValueType receiver = frame.pop();
+                if (opcode == Opcode::InvokeSpecial && !interface && this->constantPool_.methodRefName(index) == "<init>") {
+                    if (receiver.tag() == Tag::UninitializedThis) {
+                        frame.replace(receiver, this->this_);
+                    } else if (receiver.tag() == Tag::Uninitialized) {
+                        // The class being constructed is the operand of the new that created the object
+                        const std::vector<uint8_t> &code = this->code_.code();
+                        uint32_t offset = receiver.offset();
+                        if (offset + 2 >= code.size() || code[offset] != Opcode::New) {
+                            throw CorruptClassFile("TypeInference::execute: Uninitialized object does not come from a new");
+                        }
+                        uint16_t classIndex = code[offset + 1] << 8 | code[offset + 2];
+                        if (!this->constantPool_.isValid(classIndex, ConstantPool::Tag::Class)) throw CorruptClassFile("TypeInference::execute: Invalid class");
+                        frame.replace(receiver, this->object(this->constantPool_.class_(classIndex)));
+                    }
+                }
+            }
+            if (descriptor.returnType().type() != Descriptor::Type::Void) frame.pushValue(this->value(descriptor.returnType()));
+            break;
+        }
+        case Opcode::InvokeDynamic: {
+            uint16_t index = instruction.poolIndex();
+            if (!this->constantPool_.isValid(index, ConstantPool::Tag::InvokeDynamic)) throw CorruptClassFile("TypeInference::execute: Invalid call site");
+            MethodDescriptor descriptor = MethodDescriptor::read(this->constantPool_.invokeDynamicType(index));
+            frame.pop(descriptor.formalParamSize());
+            if (descriptor.returnType().type() != Descriptor::Type::Void) frame.pushValue(this->value(descriptor.returnType()));
+            break;
+        }
+
+        case Opcode::New: frame.push(ValueType(Tag::Uninitialized, instruction.index())); break;
+        case Opcode::NewArray: {
+            frame.pop(1);
+            frame.push(this->object(std::string("[") + primitiveChar(Descriptor::fromNewArray(static_cast<NewArrayType>(instruction.immediate())))));
+            break;
+        }
+        case Opcode::ANewArray:
+        case Opcode::CheckCast:
+        case Opcode::MultiANewArray: {
+            uint16_t index = instruction.poolIndex();
+            if (!this->constantPool_.isValid(index, ConstantPool::Tag::Class)) throw CorruptClassFile("TypeInference::execute: Invalid class");
+            const std::string &name = this->constantPool_.class_(index);
+            frame.pop(opcode == Opcode::MultiANewArray ? instruction.immediate() : 1);
+            frame.push(this->object(opcode == Opcode::ANewArray ? arrayOf(name) : name));
+            break;
+        }
+        case Opcode::ArrayLength:
+        case Opcode::InstanceOf: {
+            frame.pop(1);
+            frame.push(Tag::Integer);
+            break;
+        }
+
+        default: throw CorruptClassFile("TypeInference::execute: Invalid opcode");
+    }
+}
+
+ValueType TypeInference::object(const std::string &className) {
+    auto [it, inserted] = this->nameIndices_.try_emplace(className, this->names_.size());
+    if (inserted) {
+        if (this->names_.size() > ValueType::MaxData) throw CorruptClassFile("TypeInference: Too many classes");
+        this->names_.push_back(className);
+    }
+    return { Tag::Object, it->second };
+}
+
+ValueType TypeInference::value(const Descriptor &descriptor) {
+    if (descriptor.isArray()) return this->object(referenceName(descriptor));
+    switch (descriptor.type()) {
+        case Descriptor::Type::Byte:
+        case Descriptor::Type::Char:
+        case Descriptor::Type::Int:
+        case Descriptor::Type::Short:
+        case Descriptor::Type::Boolean: return Tag::Integer;
+        case Descriptor::Type::Float: return Tag::Float;
+        case Descriptor::Type::Long: return Tag::Long;
+        case Descriptor::Type::Double: return Tag::Double;
+        case Descriptor::Type::Object: return this->object(descriptor.className());
+        default: throw CorruptClassFile("TypeInference: Invalid value type");
+    }
+}
+
+ValueType TypeInference::value(const VerificationTypeInfo &type) {
+    switch (type.tag()) {
+        case VerificationTypeInfo::Tag::Top: return Tag::Top;
+        case VerificationTypeInfo::Tag::Integer: return Tag::Integer;
+        case VerificationTypeInfo::Tag::Float: return Tag::Float;
+        case VerificationTypeInfo::Tag::Long: return Tag::Long;
+        case VerificationTypeInfo::Tag::Double: return Tag::Double;
+        case VerificationTypeInfo::Tag::Null: return Tag::Null;
+        case VerificationTypeInfo::Tag::UninitializedThis: return Tag::UninitializedThis;
+        case VerificationTypeInfo::Tag::Object: {
+            if (type.className() != nullptr) return this->object(*type.className());
+            if (!this->constantPool_.isValid(type.constantPoolIndex(), ConstantPool::Tag::Class)) {
+                throw CorruptClassFile("TypeInference: Invalid class in stack map frame");
+            }
+            return this->object(this->constantPool_.class_(type.constantPoolIndex()));
+        }
+        case VerificationTypeInfo::Tag::Uninitialized: return { Tag::Uninitialized, type.offset() };
+        default: throw CorruptClassFile("TypeInference: Invalid verification type");
+    }
+}
+
+ValueType TypeInference::constant(uint16_t index) {
+    using PoolTag = ConstantPool::Tag;
+    const ConstantPool &constantPool = this->constantPool_;
+    if (constantPool.isValid(index, PoolTag::Integer)) return Tag::Integer;
+    if (constantPool.isValid(index, PoolTag::Float)) return Tag::Float;
+    if (constantPool.isValid(index, PoolTag::Long)) return Tag::Long;
+    if (constantPool.isValid(index, PoolTag::Double)) return Tag::Double;
+    if (constantPool.isValid(index, PoolTag::String)) return this->object("java.lang.String");
+    if (constantPool.isValid(index, PoolTag::Class)) return this->object("java.lang.Class");
+    if (constantPool.isValid(index, PoolTag::MethodType)) return this->object("java.lang.invoke.MethodType");
+    if (constantPool.isValid(index, PoolTag::MethodHandle)) return this->object("java.lang.invoke.MethodHandle");
+    throw CorruptClassFile("TypeInference::execute: Invalid constant");
+}
+
+ValueType TypeInference::join(ValueType a, ValueType b) {
+    if (a == b) return a;
+    if (a.tag() == Tag::Null && b.tag() == Tag::Object) return b;
+    if (a.tag() == Tag::Object && b.tag() == Tag::Null) return a;
+    if (a.tag() == Tag::Object && b.tag() == Tag::Object) return this->object_;
+    return Tag::Top;
+}
+
+TypeFrame TypeInference::load(uint32_t block) const {
+    TypeFrame frame(this->code_.maxLocals(), this->code_.maxStack());
+    auto first = this->entries_.begin() + block * this->stride_;
+    std::copy(first, first + this->stride_, frame.types_.begin());
+    frame.depth_ = this->depths_[block];
+    return frame;
+}
+
+void TypeInference::store(uint32_t block, const TypeFrame &frame) {
+    std::copy(frame.types_.begin(), frame.types_.end(), this->entries_.begin() + block * this->stride_);
+    this->depths_[block] = frame.depth_;
+    this->states_[block] = State::Ready;
+}
+
+bool TypeInference::merge(uint32_t block, const TypeFrame &frame) {
+    if (this->states_[block] != State::Ready) {
+        this->store(block, frame);
+        return true;
+    }
+    if (this->depths_[block] != frame.depth_) throw CorruptClassFile("TypeInference: Stack depths differ where control flow merges");
+
+    bool changed = false;
+    ValueType *types = this->entries_.data() + block * this->stride_;
+    for (uint32_t i = 0; i < frame.maxLocals_ + frame.depth_; i++) {
+        ValueType joined = this->join(types[i], frame.types_[i]);
+        if (joined != types[i]) {
+            types[i] = joined;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void TypeInference::replay(uint32_t block, TypeFrame &frame, uint32_t end) {
+    UncheckedCodeIterator iterator = this->code_.uncheckedIterator();
+    iterator.moveTo(this->cfg_.block(block).start());
+    while (iterator.peek() < end) this->execute(iterator.nextInstruction(), frame);
+}
+
+void TypeInference::derive(uint32_t block) {
+    // The blocks back to the last one with a known entry have no frame, so they can only be reached by falling through from
+    // the block before them. Block 0 always has a frame: either an explicit one or the implicit initial frame.
+    uint32_t first = block;
+    while (this->states_[first] == State::Pending) {
+        if (this->cfg_.block(first).isHandler()) throw CorruptClassFile("TypeInference: Exception handler has no stack map frame");
+        if (first == 0) throw std::logic_error("TypeInference: Block 0 has no entry frame");
+        first--;
+    }
+
+    TypeFrame frame = this->load(first);
+    for (uint32_t id = first; id < block; id++) {
+        this->replay(id, frame, this->cfg_.block(id).end());
+        Span<uint32_t> successors = this->cfg_.successors(id);
+        if (std::find(successors.begin(), successors.end(), id + 1) == successors.end()) {
+            throw CorruptClassFile("TypeInference: Block is only reached by a jump, but has no stack map frame");
+        }
+        this->store(id + 1, frame);
+    }
+}
+
+void TypeInference::solve() {
+    this->solved_ = true;
+    const DominatorTree &dominators = *this->code_.dominators();
+    Span<uint32_t> order = dominators.reversePostorder();
+    if (order.empty()) return;
+
+    // Blocks that a jsr returns to
+    std::vector<uint32_t> returnSites;
+    for (const Instruction &instruction : this->code_.uncheckedInstructions()) {
+        if ((instruction.opcode() == Opcode::Jsr || instruction.opcode() == Opcode::JsrW) && instruction.nextIndex() < this->code_.code().size()) {
+            returnSites.push_back(this->cfg_.blockAt(instruction.nextIndex()));
+        }
+    }
+
+    // Iterate to a fixed point in reverse postorder, starting from the implicit initial frame of the entry block
+    ValueType throwable = this->object("java.lang.Throwable");
+    BitSet pending(order.size());
+    pending.set(0);
+    for (uint32_t position = 0; position < order.size();) {
+        pending.reset(position);
+        uint32_t id = order[position];
+        const BasicBlock &block = this->cfg_.block(id);
+        Span<ExceptionalEdge> handlers = this->cfg_.exceptionalSuccessors(id);
+        auto schedule = [&](uint32_t successor, const TypeFrame &frame) {
+            if (this->merge(successor, frame)) pending.set(dominators.rpoNumber(successor));
+        };
+
+        // An instruction may throw before it completes, so handlers see the locals from before every instruction
+        TypeFrame frame = this->load(id);
+        UncheckedCodeIterator iterator = this->code_.uncheckedIterator();
+        iterator.moveTo(block.start());
+        Instruction last;
+        while (iterator.peek() < block.end()) {
+            last = iterator.nextInstruction();
+            for (const ExceptionalEdge &edge : handlers) {
+                TypeFrame thrown = frame;
+                thrown.clearStack();
+                if (edge.isCatchAll()) {
+                    thrown.push(throwable);
+                } else {
+                    if (!this->constantPool_.isValid(edge.catchType(), ConstantPool::Tag::Class)) throw CorruptClassFile("TypeInference: Invalid catch type");
+                    thrown.push(this->object(this->constantPool_.class_(edge.catchType())));
+                }
+                schedule(edge.handler(), thrown);
+            }
+            this->execute(last, frame);
+        }
+
+        if (last.opcode() == Opcode::Jsr || last.opcode() == Opcode::JsrW) {
+            // The return site sees the stack from before the jsr, and whatever the subroutine left in the locals
+            for (uint32_t successor : this->cfg_.successors(id)) {
+                if (this->cfg_.block(successor).start() != block.end()) {
+                    schedule(successor, frame);
+                    continue;
+                }
+                TypeFrame returned = frame;
+                returned.pop(1);
+                schedule(successor, returned);
+            }
+        } else if (last.opcode() == Opcode::Ret) {
+            for (uint32_t returnSite : returnSites) schedule(returnSite, frame);
+        } else {
+            for (uint32_t successor : this->cfg_.successors(id)) schedule(successor, frame);
+        }
+
+        position = pending.nextSetBit(position + 1);
+        if (position >= order.size()) position = pending.nextSetBit(0);
+    }
+
+    for (State &state : this->states_) {
+        if (state == State::Pending) state = State::Unreachable;
+    }
+}
+
+} // namespace cjbp
@@ -0,0 +1,67 @@
+// Helpers shared by the analyses that interpret the types of bytecode instructions.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "cjbp/descriptor.h"
+#include "cjbp/exception.h"
+#include "cjbp/inline.h"
+#include "cjbp/type_inference.h"
+
+namespace cjbp {
+
+/// The types of values that the typed load, store, array and arithmetic opcodes work on, in the order i, l, f, d, a.
+constexpr ValueType::Tag KindTypes[5] = {
+    ValueType::Tag::Integer, ValueType::Tag::Long, ValueType::Tag::Float, ValueType::Tag::Double, ValueType::Tag::Top,
+};
+
+/// The source and result types of the conversion opcodes, i2l to i2s.
+constexpr ValueType::Tag ConversionTypes[15][2] = {
+    { ValueType::Tag::Integer, ValueType::Tag::Long }, { ValueType::Tag::Integer, ValueType::Tag::Float },
+    { ValueType::Tag::Integer, ValueType::Tag::Double }, { ValueType::Tag::Long, ValueType::Tag::Integer },
+    { ValueType::Tag::Long, ValueType::Tag::Float }, { ValueType::Tag::Long, ValueType::Tag::Double },
+    { ValueType::Tag::Float, ValueType::Tag::Integer }, { ValueType::Tag::Float, ValueType::Tag::Long },
+    { ValueType::Tag::Float, ValueType::Tag::Double }, { ValueType::Tag::Double, ValueType::Tag::Integer },
+    { ValueType::Tag::Double, ValueType::Tag::Long }, { ValueType::Tag::Double, ValueType::Tag::Float },
+    { ValueType::Tag::Integer, ValueType::Tag::Integer }, { ValueType::Tag::Integer, ValueType::Tag::Integer },
+    { ValueType::Tag::Integer, ValueType::Tag::Integer },
+};
+
+CJBP_INLINE uint32_t width(ValueType::Tag tag) { return tag == ValueType::Tag::Long || tag == ValueType::Tag::Double ? 2 : 1; }
+
+/// @return The kind (see KindTypes) of an xload, xstore, xload_<n> or xstore_<n> opcode.
+CJBP_INLINE uint32_t localKind(uint8_t opcode, uint8_t first, uint8_t firstImplicit) {
+    return opcode >= firstImplicit ? (opcode - firstImplicit) / 4 : opcode - first;
+}
+
+/// @return The descriptor character of a primitive type, as used in the names of array classes.
+CJBP_INLINE char primitiveChar(Descriptor::Type type) {
+    switch (type) {
+        case Descriptor::Type::Byte: return 'B';
+        case Descriptor::Type::Char: return 'C';
+        case Descriptor::Type::Double: return 'D';
+        case Descriptor::Type::Float: return 'F';
+        case Descriptor::Type::Int: return 'I';
+        case Descriptor::Type::Long: return 'J';
+        case Descriptor::Type::Short: return 'S';
+        case Descriptor::Type::Boolean: return 'Z';
+        default: throw CorruptClassFile("TypeInference: Invalid array element type");
+    }
+}
+
+/// @return The name of the class of a reference type: its class, or its array class, as TypeInference names them.
+CJBP_INLINE std::string referenceName(const Descriptor &descriptor) {
+    if (!descriptor.isArray()) return descriptor.className();
+    std::string name(descriptor.arrayDimensions(), '[');
+    if (descriptor.type() == Descriptor::Type::Object) return name + 'L' + descriptor.className() + ';';
+    return name + primitiveChar(descriptor.type());
+}
+
+/// @return The name of the class of arrays whose elements are of the named class.
+CJBP_INLINE std::string arrayOf(const std::string &className) {
+    return className[0] == '[' ? '[' + className : "[L" + className + ';';
+}
+
+} // namespace cjbp
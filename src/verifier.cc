@@ -0,0 +1,850 @@
+#include "cjbp/verifier.h"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "cjbp/class_file.h"
+#include "cjbp/class_path.h"
+#include "cjbp/code_attribute.h"
+#include "cjbp/control_flow_graph.h"
+#include "cjbp/descriptor.h"
+#include "cjbp/exception.h"
+#include "cjbp/method_info.h"
+#include "cjbp/type_inference.h"
+#include "type_util.h"
+
+namespace cjbp {
+
+namespace {
+
+using Tag = ValueType::Tag;
+
+/// Superclass chains longer than this are taken to be cycles.
+constexpr uint32_t MaxClassDepth = 1024;
+
+/**
+ * Sha256 computes the SHA-256 digest (FIPS 180-4) of a stream of bytes, so that content hashes do not collide, even for
+ * class files crafted to.
+ */
+class Sha256 {
+public:
+    void update(const uint8_t *data, size_t size) {
+        this->length_ += size;
+        while (size > 0) {
+            size_t count = std::min(size, sizeof(this->block_) - this->used_);
+            std::memcpy(this->block_ + this->used_, data, count);
+            this->used_ += count;
+            data += count;
+            size -= count;
+            if (this->used_ == sizeof(this->block_)) {
+                this->compress();
+                this->used_ = 0;
+            }
+        }
+    }
+
+    Verifier::ContentHash finish() {
+        // A 1 bit, zeros up to 8 bytes before the end of a block, then the length in bits
+        uint64_t bits = this->length_ * 8;
+        uint8_t padding[72] = { 0x80 };
+        size_t zeros = (this->used_ < 56 ? 56 : 120) - this->used_;
+        for (uint32_t i = 0; i < 8; i++) padding[zeros + i] = bits >> (56 - i * 8);
+        this->update(padding, zeros + 8);
+
+        Verifier::ContentHash digest;
+        for (uint32_t i = 0; i < 32; i++) digest[i] = this->state_[i / 4] >> (24 - i % 4 * 8);
+        return digest;
+    }
+
+private:
+    static constexpr uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+        0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+        0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+        0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    uint32_t state_[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    uint8_t block_[64] {};
+    size_t used_ = 0;
+    uint64_t length_ = 0;
+
+    CJBP_INLINE static uint32_t rotate(uint32_t x, uint32_t n) { return x >> n | x << (32 - n); }
+
+    void compress() {
+        uint32_t w[64];
+        for (uint32_t i = 0; i < 16; i++) {
+            w[i] = static_cast<uint32_t>(this->block_[i * 4]) << 24 | this->block_[i * 4 + 1] << 16 | this->block_[i * 4 + 2] << 8 | this->block_[i * 4 + 3];
+        }
+        for (uint32_t i = 16; i < 64; i++) {
+            uint32_t s0 = rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ w[i - 15] >> 3;
+            uint32_t s1 = rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ w[i - 2] >> 10;
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = this->state_[0], b = this->state_[1], c = this->state_[2], d = this->state_[3];
+        uint32_t e = this->state_[4], f = this->state_[5], g = this->state_[6], h = this->state_[7];
+        for (uint32_t i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        this->state_[0] += a;
+        this->state_[1] += b;
+        this->state_[2] += c;
+        this->state_[3] += d;
+        this->state_[4] += e;
+        this->state_[5] += f;
+        this->state_[6] += g;
+        this->state_[7] += h;
+    }
+};
+
+/// @return The name of the class of the components of an array class whose components are references.
+CJBP_INLINE std::string componentOf(const std::string &arrayName) {
+    return arrayName[1] == '[' ? arrayName.substr(1) : arrayName.substr(2, arrayName.size() - 3);
+}
+
+/**
+ * MethodVerifier checks the code of one method in a single pass, instruction by instruction, carrying the types of the
+ * locals and operand stack from one instruction to the next. Wherever another path may join (at a StackMapTable frame),
+ * the types must be assignable to those of the frame, which then replaces them.
+ */
+class MethodVerifier {
+public:
+    MethodVerifier(Verifier &verifier, const ClassFile &classFile, const MethodInfo &method);
+
+    void verify();
+
+private:
+    static constexpr uint32_t NoIndex = UINT32_MAX;
+
+    Verifier &verifier_;
+    const ClassFile &classFile_;
+    const MethodInfo &method_;
+    const ConstantPool &constantPool_;
+    CodeAttributeInfo &code_;
+    std::unique_ptr<TypeInference> types_;
+    const ControlFlowGraph *cfg_;
+    bool hasStackMap_;
+    uint32_t index_; // Of the instruction being checked, or NoIndex
+    std::vector<std::optional<TypeFrame>> frames_; // Stack map frame at the start of every block, if any
+    std::vector<ValueType> catchTypes_;            // Of every entry of the exception table
+    std::unordered_map<uint64_t, bool> assignable_; // Answers of the Verifier, by pair of class name indices
+    ValueType object_;
+
+    [[noreturn]] void fail(const std::string &message) const;
+
+    bool isAssignable(ValueType from, ValueType to);
+    bool isAssignable(const TypeFrame &from, const TypeFrame &to);
+
+    TypeFrame initialFrame();
+    void checkHandlers(const TypeFrame &frame);
+    void jump(uint32_t target, const TypeFrame &frame);
+
+    void pop(TypeFrame &frame, Tag expected);
+    void pop(TypeFrame &frame, ValueType expected);
+    ValueType popReference(TypeFrame &frame);
+    ValueType popArray(TypeFrame &frame, const char *components);
+    void checkSplit(const TypeFrame &frame, uint32_t depth) const;
+    void checkReturn(const TypeFrame &frame, Tag expected);
+
+    bool execute(const Instruction &instruction, TypeFrame &frame);
+    void invoke(const Instruction &instruction, TypeFrame &frame);
+};
+
+MethodVerifier::MethodVerifier(Verifier &verifier, const ClassFile &classFile, const MethodInfo &method) :
+    verifier_(verifier), classFile_(classFile), method_(method), constantPool_(method.constantPool()), code_(*method.code()),
+    cfg_(nullptr), hasStackMap_(this->code_.stackMap() != nullptr), index_(NoIndex) { }
+
+void MethodVerifier::fail(const std::string &message) const {
+    std::string where = this->classFile_.name() + '.' + this->method_.name() + this->method_.type();
+    if (this->index_ != NoIndex) where += " at " + std::to_string(this->index_);
+    throw VerifyError("Verifier: " + where + ": " + message);
+}
+
+void MethodVerifier::verify() {
+    try {
+        this->types_ = TypeInference::build(this->classFile_, this->method_);
+        this->cfg_ = this->code_.cfg();
+        this->object_ = this->types_->object("java.lang.Object");
+
+        uint32_t size = this->cfg_->size();
+        this->frames_.resize(size);
+        for (uint32_t id = 0; id < size; id++) {
+            // Without a StackMapTable, the inferred types at every block stand in for its frames
+            if (!this->hasStackMap_ || this->cfg_->stackMap(id) != nullptr) this->frames_[id] = this->types_->entry(id);
+        }
+
+        ValueType throwable = this->types_->object("java.lang.Throwable");
+        for (const ExceptionTableEntry &entry : this->code_.exceptionTable()) {
+            ValueType catchType = throwable;
+            if (entry.catchType() != 0) {
+                if (!this->constantPool_.isValid(entry.catchType(), ConstantPool::Tag::Class)) this->fail("Invalid catch type");
+                catchType = this->types_->object(this->constantPool_.class_(entry.catchType()));
+                if (!this->isAssignable(catchType, throwable)) this->fail("Catch type is not a Throwable");
+            }
+            this->catchTypes_.push_back(catchType);
+        }
+
+        std::optional<TypeFrame> current = this->initialFrame();
+        uint32_t nextBlock = 0;
+        UncheckedCodeIterator iterator = this->code_.uncheckedIterator();
+        while (!iterator.eof()) {
+            Instruction instruction = iterator.nextInstruction();
+            this->index_ = instruction.index();
+            if (nextBlock < size && this->cfg_->block(nextBlock).start() == this->index_) {
+                const std::optional<TypeFrame> &frame = this->frames_[nextBlock++];
+                if (frame.has_value()) {
+                    if (current.has_value() && !this->isAssignable(*current, *frame)) this->fail("Types do not match the stack map frame");
+                    current = frame;
+                } else if (!this->hasStackMap_) {
+                    current.reset(); // Unreachable
+                }
+            }
+            if (!current.has_value()) {
+                if (this->hasStackMap_) this->fail("Expected a stack map frame after an unconditional branch");
+                continue;
+            }
+
+            this->checkHandlers(*current);
+            if (!this->execute(instruction, *current)) current.reset();
+        }
+        this->index_ = NoIndex;
+        if (current.has_value()) this->fail("Execution falls off the end of the code");
+    } catch (const CorruptClassFile &e) {
+        this->fail(e.what());
+    } catch (const std::invalid_argument &e) {
+        this->fail(e.what()); // Bad constant pool references, from the ConstantPool accessors
+    } catch (const std::out_of_range &e) {
+        this->fail(e.what());
+    }
+}
+
+bool MethodVerifier::isAssignable(ValueType from, ValueType to) {
+    if (from == to || to.tag() == Tag::Top) return true;
+    if (to.tag() != Tag::Object) return false;
+    if (from.tag() == Tag::Null || to == this->object_) return true;
+    if (from.tag() != Tag::Object) return false;
+
+    // TypeInference joins different classes to java.lang.Object, which the type inference verifier would not
+    if (!this->hasStackMap_ && from == this->object_) return true;
+
+    uint64_t key = static_cast<uint64_t>(from.nameIndex()) << 32 | to.nameIndex();
+    auto it = this->assignable_.find(key);
+    if (it == this->assignable_.end()) {
+        it = this->assignable_.emplace(key, this->verifier_.isAssignable(this->types_->className(from), this->types_->className(to))).first;
+    }
+    return it->second;
+}
+
+bool MethodVerifier::isAssignable(const TypeFrame &from, const TypeFrame &to) {
+    if (from.depth() != to.depth()) return false;
+    for (uint32_t i = 0; i < from.maxLocals(); i++) {
+        if (!this->isAssignable(from.locals()[i], to.locals()[i])) return false;
+    }
+    for (uint32_t i = 0; i < from.depth(); i++) {
+        if (!this->isAssignable(from.stack()[i], to.stack()[i])) return false;
+    }
+    return true;
+}
+
+TypeFrame MethodVerifier::initialFrame() {
+    TypeFrame frame(this->code_.maxLocals(), this->code_.maxStack());
+    uint32_t slot = 0;
+    if (!this->method_.isStatic()) {
+        bool constructor = this->method_.name() == "<init>" && this->classFile_.name() != "java.lang.Object";
+        frame.setLocal(slot++, constructor ? ValueType(Tag::UninitializedThis) : this->types_->thisType());
+    }
+    for (const Descriptor &parameter : this->method_.descriptor().params()) {
+        ValueType type = this->types_->value(parameter);
+        frame.setLocal(slot, type);
+        slot += width(type.tag());
+    }
+    return frame;
+}
+
+void MethodVerifier::checkHandlers(const TypeFrame &frame) {
+    // A handler sees the locals from before the instruction, and the exception alone on the stack
+    const std::vector<ExceptionTableEntry> &exceptionTable = this->code_.exceptionTable();
+    for (uint32_t i = 0; i < exceptionTable.size(); i++) {
+        const ExceptionTableEntry &entry = exceptionTable[i];
+        if (this->index_ < entry.start() || this->index_ >= entry.end()) continue;
+        const std::optional<TypeFrame> &handler = this->frames_[this->cfg_->blockAt(entry.handler())];
+        if (!handler.has_value()) this->fail("No stack map frame at exception handler " + std::to_string(entry.handler()));
+        bool matches = handler->depth() == 1 && this->isAssignable(this->catchTypes_[i], handler->stack()[0]);
+        for (uint32_t local = 0; matches && local < frame.maxLocals(); local++) {
+            matches = this->isAssignable(frame.locals()[local], handler->locals()[local]);
+        }
+        if (!matches) this->fail("Types do not match the stack map frame of exception handler " + std::to_string(entry.handler()));
+    }
+}
+
+void MethodVerifier::jump(uint32_t target, const TypeFrame &frame) {
+    const std::optional<TypeFrame> &targetFrame = this->frames_[this->cfg_->blockAt(target)];
+    if (!targetFrame.has_value()) this->fail("No stack map frame at branch target " + std::to_string(target));
+    if (!this->isAssignable(frame, *targetFrame)) this->fail("Types do not match the stack map frame at branch target " + std::to_string(target));
+}
+
+void MethodVerifier::pop(TypeFrame &frame, Tag expected) {
+    if (width(expected) == 2 && frame.pop() != Tag::Top) this->fail("Expected a long or double on the stack");
+    ValueType value = frame.pop();
+    if (value.tag() != expected) this->fail("Expected " + this->types_->toString(expected) + " on the stack, found " + this->types_->toString(value));
+}
+
+void MethodVerifier::pop(TypeFrame &frame, ValueType expected) {
+    if (expected.tag() != Tag::Object) return this->pop(frame, expected.tag());
+    ValueType value = frame.pop();
+    if (!this->isAssignable(value, expected)) {
+        this->fail("Expected " + this->types_->toString(expected) + " on the stack, found " + this->types_->toString(value));
+    }
+}
+
+ValueType MethodVerifier::popReference(TypeFrame &frame) {
+    ValueType value = frame.pop();
+    if (!value.isReference()) this->fail("Expected a reference on the stack, found " + this->types_->toString(value));
+    return value;
+}
+
+ValueType MethodVerifier::popArray(TypeFrame &frame, const char *components) {
+    ValueType array = frame.pop();
+    if (array.tag() == Tag::Null) return array;
+    if (array.tag() != Tag::Object || this->types_->className(array)[0] != '[') {
+        this->fail("Expected an array on the stack, found " + this->types_->toString(array));
+    }
+    if (components != nullptr && std::strchr(components, this->types_->className(array)[1]) == nullptr) {
+        this->fail("Array of the wrong type: " + this->types_->toString(array));
+    }
+    return array;
+}
+
+void MethodVerifier::checkSplit(const TypeFrame &frame, uint32_t depth) const {
+    // The slots above the given depth must not end in the middle of a long or double
+    if (depth < frame.depth() && frame.peek(depth - 1) == Tag::Top && frame.peek(depth).isCategory2()) {
+        this->fail("Instruction splits a long or double");
+    }
+}
+
+void MethodVerifier::checkReturn(const TypeFrame &frame, Tag expected) {
+    const Descriptor &returnType = this->method_.descriptor().returnType();
+    Tag actual = returnType.type() == Descriptor::Type::Void ? Tag::Top : this->types_->value(returnType).tag();
+    if (actual != expected) this->fail("Return instruction does not match the return type of the method");
+    if (this->method_.name() == "<init>") {
+        for (ValueType local : frame.locals()) {
+            if (local.tag() == Tag::UninitializedThis) this->fail("Constructor returns before calling a superclass constructor");
+        }
+    }
+}
+
+bool MethodVerifier::execute(const Instruction &instruction, TypeFrame &frame) {
+    uint8_t opcode = instruction.opcode();
+
+    // Families of typed opcodes, which only differ in the type they work on
+    if ((Opcode::ILoad <= opcode && opcode <= Opcode::ALoad) || (Opcode::ILoad0 <= opcode && opcode <= Opcode::ALoad3)) {
+        Tag tag = KindTypes[localKind(opcode, Opcode::ILoad, Opcode::ILoad0)];
+        ValueType value = frame.local(instruction.localIndex());
+        if (tag == Tag::Top ? !value.isReference() : value.tag() != tag) {
+            this->fail("Unexpected " + this->types_->toString(value) + " in local " + std::to_string(instruction.localIndex()));
+        }
+        frame.pushValue(value);
+        return true;
+    }
+    if ((Opcode::IStore <= opcode && opcode <= Opcode::AStore) || (Opcode::IStore0 <= opcode && opcode <= Opcode::AStore3)) {
+        Tag tag = KindTypes[localKind(opcode, Opcode::IStore, Opcode::IStore0)];
+        ValueType value = tag;
+        if (tag == Tag::Top) {
+            value = frame.pop();
+            if (!value.isReference() && value.tag() != Tag::ReturnAddress) this->fail("Expected a reference on the stack, found " + this->types_->toString(value));
+        } else {
+            this->pop(frame, tag);
+        }
+        frame.setLocal(instruction.localIndex(), value);
+        return true;
+    }
+    if (Opcode::IAdd <= opcode && opcode <= Opcode::DRem) {
+        Tag tag = KindTypes[(opcode - Opcode::IAdd) % 4];
+        this->pop(frame, tag);
+        this->pop(frame, tag);
+        frame.pushValue(tag);
+        return true;
+    }
+    if (Opcode::INeg <= opcode && opcode <= Opcode::DNeg) {
+        Tag tag = KindTypes[(opcode - Opcode::INeg) % 4];
+        this->pop(frame, tag);
+        frame.pushValue(tag);
+        return true;
+    }
+    if (Opcode::IShl <= opcode && opcode <= Opcode::LXor) {
+        // Shift distances are ints
+        Tag tag = (opcode - Opcode::IShl) % 2 == 0 ? Tag::Integer : Tag::Long;
+        this->pop(frame, opcode <= Opcode::LUShr ? Tag::Integer : tag);
+        this->pop(frame, tag);
+        frame.pushValue(tag);
+        return true;
+    }
+    if (Opcode::I2L <= opcode && opcode <= Opcode::I2S) {
+        const Tag *types = ConversionTypes[opcode - Opcode::I2L];
+        this->pop(frame, types[0]);
+        frame.pushValue(types[1]);
+        return true;
+    }
+
+    switch (opcode) {
+        case Opcode::Nop: break;
+        case Opcode::AConstNull:
+        case Opcode::IConstM1:
+        case Opcode::IConst0:
+        case Opcode::IConst1:
+        case Opcode::IConst2:
+        case Opcode::IConst3:
+        case Opcode::IConst4:
+        case Opcode::IConst5:
+        case Opcode::LConst0:
+        case Opcode::LConst1:
+        case Opcode::FConst0:
+        case Opcode::FConst1:
+        case Opcode::FConst2:
+        case Opcode::DConst0:
+        case Opcode::DConst1:
+        case Opcode::BiPush:
+        case Opcode::SiPush: this->types_->execute(instruction, frame); break;
+        case Opcode::Ldc:
+        case Opcode::LdcW:
+        case Opcode::Ldc2W: {
+            ValueType value = this->types_->constant(instruction.poolIndex());
+            if (value.isCategory2() != (opcode == Opcode::Ldc2W)) this->fail("Constant of the wrong size for " + std::string(opcode == Opcode::Ldc2W ? "ldc2_w" : "ldc"));
+            frame.pushValue(value);
+            break;
+        }
+
+        case Opcode::IALoad:
+        case Opcode::LALoad:
+        case Opcode::FALoad:
+        case Opcode::DALoad:
+        case Opcode::BALoad:
+        case Opcode::CALoad:
+        case Opcode::SALoad: {
+            static constexpr const char *Components[] = { "I", "J", "F", "D", nullptr, "BZ", "C", "S" };
+            static constexpr Tag Results[] = { Tag::Integer, Tag::Long, Tag::Float, Tag::Double, Tag::Top, Tag::Integer, Tag::Integer, Tag::Integer };
+            this->pop(frame, Tag::Integer);
+            this->popArray(frame, Components[opcode - Opcode::IALoad]);
+            frame.pushValue(Results[opcode - Opcode::IALoad]);
+            break;
+        }
+        case Opcode::AALoad: {
+            this->pop(frame, Tag::Integer);
+            ValueType array = this->popArray(frame, "L[");
+            frame.push(array.tag() == Tag::Null ? array : this->types_->object(componentOf(this->types_->className(array))));
+            break;
+        }
+        case Opcode::IAStore:
+        case Opcode::LAStore:
+        case Opcode::FAStore:
+        case Opcode::DAStore:
+        case Opcode::BAStore:
+        case Opcode::CAStore:
+        case Opcode::SAStore: {
+            static constexpr const char *Components[] = { "I", "J", "F", "D", nullptr, "BZ", "C", "S" };
+            static constexpr Tag Values[] = { Tag::Integer, Tag::Long, Tag::Float, Tag::Double, Tag::Top, Tag::Integer, Tag::Integer, Tag::Integer };
+            this->pop(frame, Values[opcode - Opcode::IAStore]);
+            this->pop(frame, Tag::Integer);
+            this->popArray(frame, Components[opcode - Opcode::IAStore]);
+            break;
+        }
+        case Opcode::AAStore: {
+            // Whether the value fits the array is checked when the code runs
+            this->popReference(frame);
+            this->pop(frame, Tag::Integer);
+            this->popArray(frame, "L[");
+            break;
+        }
+
+        case Opcode::Pop:
+        case Opcode::Dup: this->checkSplit(frame, 1); this->types_->execute(instruction, frame); break;
+        case Opcode::Pop2:
+        case Opcode::Dup2: this->checkSplit(frame, 2); this->types_->execute(instruction, frame); break;
+        case Opcode::DupX1:
+        case Opcode::Swap: {
+            this->checkSplit(frame, 1);
+            this->checkSplit(frame, 2);
+            this->types_->execute(instruction, frame);
+            break;
+        }
+        case Opcode::DupX2: {
+            this->checkSplit(frame, 1);
+            this->checkSplit(frame, 3);
+            this->types_->execute(instruction, frame);
+            break;
+        }
+        case Opcode::Dup2X1: {
+            this->checkSplit(frame, 2);
+            this->checkSplit(frame, 3);
+            this->types_->execute(instruction, frame);
+            break;
+        }
+        case Opcode::Dup2X2: {
+            this->checkSplit(frame, 2);
+            this->checkSplit(frame, 4);
+            this->types_->execute(instruction, frame);
+            break;
+        }
+
+        case Opcode::IInc: {
+            if (frame.local(instruction.localIndex()).tag() != Tag::Integer) this->fail("Expected Integer in local " + std::to_string(instruction.localIndex()));
+            break;
+        }
+        case Opcode::LCmp:
+        case Opcode::FCmpL:
+        case Opcode::FCmpG:
+        case Opcode::DCmpL:
+        case Opcode::DCmpG: {
+            Tag tag = opcode == Opcode::LCmp ? Tag::Long : opcode <= Opcode::FCmpG ? Tag::Float : Tag::Double;
+            this->pop(frame, tag);
+            this->pop(frame, tag);
+            frame.push(Tag::Integer);
+            break;
+        }
+
+        case Opcode::IfEq:
+        case Opcode::IfNe:
+        case Opcode::IfLt:
+        case Opcode::IfGe:
+        case Opcode::IfGt:
+        case Opcode::IfLe: this->pop(frame, Tag::Integer); this->jump(instruction.branchTarget(), frame); break;
+        case Opcode::IfICmpEq:
+        case Opcode::IfICmpNe:
+        case Opcode::IfICmpLt:
+        case Opcode::IfICmpGe:
+        case Opcode::IfICmpGt:
+        case Opcode::IfICmpLe: {
+            this->pop(frame, Tag::Integer);
+            this->pop(frame, Tag::Integer);
+            this->jump(instruction.branchTarget(), frame);
+            break;
+        }
+        case Opcode::IfACmpEq:
+        case Opcode::IfACmpNe: {
+            this->popReference(frame);
+            this->popReference(frame);
+            this->jump(instruction.branchTarget(), frame);
+            break;
+        }
+        case Opcode::IfNull:
+        case Opcode::IfNonNull: this->popReference(frame); this->jump(instruction.branchTarget(), frame); break;
+        case Opcode::Goto:
+        case Opcode::GotoW: this->jump(instruction.branchTarget(), frame); return false;
+        case Opcode::TableSwitch:
+        case Opcode::LookupSwitch: {
+            this->pop(frame, Tag::Integer);
+            SwitchTable table = instruction.switchTable();
+            this->jump(table.defaultTarget(), frame);
+            for (uint32_t i = 0; i < table.size(); i++) this->jump(table.target(i), frame);
+            return false;
+        }
+        case Opcode::Jsr:
+        case Opcode::JsrW: {
+            // The return site is a block of its own, whose inferred types account for what the subroutine did
+            if (this->hasStackMap_) this->fail("jsr is not allowed in code with a StackMapTable");
+            frame.push(ValueType(Tag::ReturnAddress, instruction.nextIndex()));
+            this->jump(instruction.branchTarget(), frame);
+            return false;
+        }
+        case Opcode::Ret: {
+            if (this->hasStackMap_) this->fail("ret is not allowed in code with a StackMapTable");
+            if (frame.local(instruction.localIndex()).tag() != Tag::ReturnAddress) this->fail("Expected a return address in local " + std::to_string(instruction.localIndex()));
+            return false;
+        }
+
+        case Opcode::IReturn:
+        case Opcode::LReturn:
+        case Opcode::FReturn:
+        case Opcode::DReturn: {
+            Tag tag = KindTypes[opcode - Opcode::IReturn];
+            this->pop(frame, tag);
+            this->checkReturn(frame, tag);
+            return false;
+        }
+        case Opcode::AReturn: {
+            this->checkReturn(frame, Tag::Object);
+            this->pop(frame, this->types_->value(this->method_.descriptor().returnType()));
+            return false;
+        }
+        case Opcode::Return: this->checkReturn(frame, Tag::Top); return false;
+        case Opcode::AThrow: this->pop(frame, this->types_->object("java.lang.Throwable")); return false;
+
+        case Opcode::GetStatic:
+        case Opcode::PutStatic:
+        case Opcode::GetField:
+        case Opcode::PutField: {
+            uint16_t index = instruction.poolIndex();
+            if (!this->constantPool_.isValid(index, ConstantPool::Tag::FieldRef)) this->fail("Invalid field reference");
+            ValueType value = this->types_->value(this->constantPool_.fieldRefDesc(index));
+            if (opcode == Opcode::PutStatic || opcode == Opcode::PutField) this->pop(frame, value);
+            if (opcode == Opcode::GetField || opcode == Opcode::PutField) {
+                // A constructor may set the fields of its own class before calling the superclass constructor
+                const std::string &owner = this->constantPool_.fieldRefClass(index);
+                ValueType receiver = frame.pop();
+                bool ownField = opcode == Opcode::PutField && receiver.tag() == Tag::UninitializedThis && owner == this->classFile_.name();
+                if (!ownField && !(receiver.isReference() && this->isAssignable(receiver, this->types_->object(owner)))) {
+                    this->fail("Field receiver " + this->types_->toString(receiver) + " is not a " + owner);
+                }
+            }
+            if (opcode == Opcode::GetStatic || opcode == Opcode::GetField) frame.pushValue(value);
+            break;
+        }
+        case Opcode::InvokeVirtual:
+        case Opcode::InvokeSpecial:
+        case Opcode::InvokeStatic:
+        case Opcode::InvokeInterface:
+        case Opcode::InvokeDynamic: this->invoke(instruction, frame); break;
+
+        case Opcode::New: {
+            uint16_t index = instruction.poolIndex();
+            if (!this->constantPool_.isValid(index, ConstantPool::Tag::Class)) this->fail("Invalid class");
+            if (this->constantPool_.class_(index)[0] == '[') this->fail("new of an array class");
+
+            // The object is new, so a stale one from an earlier pass through a loop is dead
+            ValueType uninitialized(Tag::Uninitialized, instruction.index());
+            for (ValueType value : frame.stack()) {
+                if (value == uninitialized) this->fail("Uninitialized object from an earlier new is still on the stack");
+            }
+            frame.replace(uninitialized, Tag::Top);
+            frame.push(uninitialized);
+            break;
+        }
+        case Opcode::NewArray: {
+            NewArrayType type = static_cast<NewArrayType>(instruction.immediate());
+            this->pop(frame, Tag::Integer);
+            frame.push(this->types_->object(std::string("[") + primitiveChar(Descriptor::fromNewArray(type))));
+            break;
+        }
+        case Opcode::ANewArray: {
+            uint16_t index = instruction.poolIndex();
+            if (!this->constantPool_.isValid(index, ConstantPool::Tag::Class)) this->fail("Invalid class");
+            this->pop(frame, Tag::Integer);
+            frame.push(this->types_->object(arrayOf(this->constantPool_.class_(index))));
+            break;
+        }
+        case Opcode::MultiANewArray: {
+            uint16_t index = instruction.poolIndex();
+            if (!this->constantPool_.isValid(index, ConstantPool::Tag::Class)) this->fail("Invalid class");
+            const std::string &name = this->constantPool_.class_(index);
+            uint32_t dimensions = instruction.immediate();
+            if (dimensions == 0 || name.find_first_not_of('[') < dimensions) this->fail("multianewarray with too many dimensions");
+            for (uint32_t i = 0; i < dimensions; i++) this->pop(frame, Tag::Integer);
+            frame.push(this->types_->object(name));
+            break;
+        }
+        case Opcode::ArrayLength: this->popArray(frame, nullptr); frame.push(Tag::Integer); break;
+        case Opcode::CheckCast:
+        case Opcode::InstanceOf: {
+            uint16_t index = instruction.poolIndex();
+            if (!this->constantPool_.isValid(index, ConstantPool::Tag::Class)) this->fail("Invalid class");
+            this->popReference(frame);
+            frame.push(opcode == Opcode::CheckCast ? this->types_->object(this->constantPool_.class_(index)) : ValueType(Tag::Integer));
+            break;
+        }
+        case Opcode::MonitorEnter:
+        case Opcode::MonitorExit: this->popReference(frame); break;
+
+        default: this->fail("Invalid opcode");
+    }
+    return true;
+}
+
+void MethodVerifier::invoke(const Instruction &instruction, TypeFrame &frame) {
+    uint8_t opcode = instruction.opcode();
+    uint16_t index = instruction.poolIndex();
+    if (opcode == Opcode::InvokeDynamic) {
+        if (!this->constantPool_.isValid(index, ConstantPool::Tag::InvokeDynamic)) this->fail("Invalid call site");
+        MethodDescriptor descriptor = MethodDescriptor::read(this->constantPool_.invokeDynamicType(index));
+        for (auto it = descriptor.params().rbegin(); it != descriptor.params().rend(); ++it) this->pop(frame, this->types_->value(*it));
+        if (descriptor.returnType().type() != Descriptor::Type::Void) frame.pushValue(this->types_->value(descriptor.returnType()));
+        return;
+    }
+
+    bool interface = this->constantPool_.isValid(index, ConstantPool::Tag::InterfaceMethodRef);
+    if (!interface && !this->constantPool_.isValid(index, ConstantPool::Tag::MethodRef)) this->fail("Invalid method reference");
+    if (interface ? opcode == Opcode::InvokeVirtual : opcode == Opcode::InvokeInterface) this->fail("Method reference of the wrong kind");
+    const std::string &owner = interface ? this->constantPool_.interfaceMethodRefClass(index) : this->constantPool_.methodRefClass(index);
+    const std::string &name = interface ? this->constantPool_.interfaceMethodRefName(index) : this->constantPool_.methodRefName(index);
+    const MethodDescriptor &descriptor = interface ? this->constantPool_.interfaceMethodRefDesc(index) : this->constantPool_.methodRefDesc(index);
+    bool constructor = name == "<init>";
+    if (name[0] == '<' && !(constructor && opcode == Opcode::InvokeSpecial && descriptor.returnType().type() == Descriptor::Type::Void)) {
+        this->fail("Invalid call of " + name);
+    }
+    if (opcode == Opcode::InvokeInterface && static_cast<uint32_t>(instruction.immediate()) != descriptor.formalParamSize() + 1) {
+        this->fail("invokeinterface count does not match the descriptor");
+    }
+
+    for (auto it = descriptor.params().rbegin(); it != descriptor.params().rend(); ++it) this->pop(frame, this->types_->value(*it));
+    if (opcode != Opcode::InvokeStatic) {
+        ValueType receiver = frame.pop();
+        if (constructor) {
+            // The constructor must be one of the class that is being created: for `this`, of the class or its superclass
+            if (receiver.tag() == Tag::UninitializedThis) {
+                const std::string *superName = this->classFile_.superName();
+                if (owner != this->classFile_.name() && (superName == nullptr || owner != *superName)) this->fail("Wrong constructor called on this");
+                frame.replace(receiver, this->types_->thisType());
+            } else if (receiver.tag() == Tag::Uninitialized) {
+                const std::vector<uint8_t> &code = this->code_.code();
+                uint32_t offset = receiver.offset();
+                if (offset + 2 >= code.size() || code[offset] != Opcode::New) this->fail("Uninitialized object does not come from a new");
+                uint16_t classIndex = code[offset + 1] << 8 | code[offset + 2];
+                if (!this->constantPool_.isValid(classIndex, ConstantPool::Tag::Class) || this->constantPool_.class_(classIndex) != owner) {
+                    this->fail("Constructor of " + owner + " called on an object of another class");
+                }
+                frame.replace(receiver, this->types_->object(owner));
+            } else {
+                this->fail("Constructor called on an initialized object");
+            }
+        } else {
+            // invokespecial calls a method of the current class or its supertypes, on an object of the current class. An
+            // interface method must be of the current class or of one of its direct superinterfaces (JVMS 4.9.2).
+            if (opcode == Opcode::InvokeSpecial && owner != this->classFile_.name()) {
+                if (interface) {
+                    const std::vector<const std::string *> &interfaces = this->classFile_.interfaces();
+                    bool direct = std::any_of(interfaces.begin(), interfaces.end(), [&](const std::string *name) { return *name == owner; });
+                    if (!direct) this->fail(owner + " is not a direct superinterface of the current class");
+                } else if (!this->isAssignable(this->types_->thisType(), this->types_->object(owner))) {
+                    this->fail("Current class is not assignable to " + owner);
+                }
+            }
+            ValueType expected = opcode == Opcode::InvokeSpecial ? this->types_->thisType() : this->types_->object(owner);
+            if (!receiver.isReference() || !this->isAssignable(receiver, expected)) {
+                this->fail("Receiver " + this->types_->toString(receiver) + " is not a " + this->types_->toString(expected));
+            }
+        }
+    }
+    if (descriptor.returnType().type() != Descriptor::Type::Void) frame.pushValue(this->types_->value(descriptor.returnType()));
+}
+
+} // namespace
+
+
+
+Verifier::Verifier(ClassPath *classPath) : classPath_(classPath), cacheHits_(0) {
+    // The root of every hierarchy, which a class path of application classes does not hold
+    this->classes_.emplace("java.lang.Object", ClassInfo { "", false, true });
+}
+
+Verifier::ContentHash Verifier::hash(std::istream &s) {
+    std::istream::pos_type start = s.tellg();
+    if (start == std::istream::pos_type(-1)) throw std::runtime_error("Verifier::hash: Stream cannot be rewound");
+
+    Sha256 sha256;
+    char buffer[4096];
+    while (s.read(buffer, sizeof(buffer)) || s.gcount() > 0) sha256.update(reinterpret_cast<const uint8_t *>(buffer), s.gcount());
+
+    s.clear();
+    s.seekg(start);
+    if (!s) throw std::runtime_error("Verifier::hash: Stream cannot be rewound");
+    return sha256.finish();
+}
+
+void Verifier::verify(const ClassFile &classFile) {
+    this->remember(classFile);
+    for (const auto &method : classFile.methods()) this->verify(classFile, *method);
+}
+
+void Verifier::verify(const ClassFile &classFile, const ContentHash &contentHash) {
+    {
+        std::lock_guard<std::mutex> lock(this->cacheMutex_);
+        auto it = this->results_.find(contentHash);
+        if (it != this->results_.end()) {
+            this->cacheHits_++;
+            if (it->second.empty()) return;
+            throw VerifyError(it->second);
+        }
+    }
+
+    std::string result;
+    try {
+        this->verify(classFile);
+    } catch (const VerifyError &e) {
+        result = e.what();
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->cacheMutex_);
+        this->results_.emplace(contentHash, result);
+    }
+    if (!result.empty()) throw VerifyError(result);
+}
+
+void Verifier::verify(const ClassFile &classFile, const MethodInfo &method) {
+    if (method.code() == nullptr) return;
+    MethodVerifier(*this, classFile, method).verify();
+}
+
+uint64_t Verifier::cacheHits() const {
+    std::lock_guard<std::mutex> lock(this->cacheMutex_);
+    return this->cacheHits_;
+}
+
+bool Verifier::isAssignable(const std::string &from, const std::string &to) {
+    if (from == to || to == "java.lang.Object") return true;
+
+    // Arrays are assignable to arrays of assignable references, and to the interfaces that every array implements
+    if (to[0] == '[') {
+        if (from[0] != '[') return false;
+        bool references = (from[1] == 'L' || from[1] == '[') && (to[1] == 'L' || to[1] == '[');
+        return references && this->isAssignable(componentOf(from), componentOf(to));
+    }
+    if (from[0] == '[') return to == "java.lang.Cloneable" || to == "java.io.Serializable";
+
+    // Every reference is assignable to an interface (JVMS 4.10.1.2). Unknown classes are assumed to be assignable, whether
+    // the target or a class on the way up to it, but a chain that reaches java.lang.Object without meeting it is not
+    ClassInfo target = this->classInfo(to);
+    if (!target.found || target.interface) return true;
+    std::string name = from;
+    for (uint32_t i = 0; i < MaxClassDepth; i++) {
+        ClassInfo info = this->classInfo(name);
+        if (!info.found) return true;
+        if (info.superName.empty()) return false;
+        if (info.superName == to) return true;
+        name = info.superName;
+    }
+    return false;
+}
+
+Verifier::ClassInfo Verifier::classInfo(const std::string &name) {
+    std::lock_guard<std::mutex> lock(this->classMutex_);
+    auto it = this->classes_.find(name);
+    if (it != this->classes_.end()) return it->second;
+
+    ClassInfo info { "", false, false };
+    if (this->classPath_ != nullptr) {
+        try {
+            std::shared_ptr<std::istream> stream = this->classPath_->findClass(name);
+            if (stream != nullptr) {
+                std::unique_ptr<ClassFile> classFile = ClassFile::read(*stream);
+                info = { classFile->superName() == nullptr ? "" : *classFile->superName(), (classFile->accessFlags() & 0x0200) != 0, true };
+            }
+        } catch (const CorruptClassFile &) {
+            // Left unknown, like a missing class
+        }
+    }
+    this->classes_.emplace(name, info);
+    return info;
+}
+
+void Verifier::remember(const ClassFile &classFile) {
+    std::lock_guard<std::mutex> lock(this->classMutex_);
+    ClassInfo info { classFile.superName() == nullptr ? "" : *classFile.superName(), (classFile.accessFlags() & 0x0200) != 0, true };
+    this->classes_.emplace(classFile.name(), info);
+}
+
+} // namespace cjbp
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cjbp {
+
+/**
+ * WorkStealingPool runs tasks on a fixed set of threads. Every worker has its own deque of tasks: a task submitted from a
+ * worker goes to the back of that worker's deque, where the worker takes its next task from, so work spawned by a task
+ * (e.g. the methods of a class) tends to stay on the thread that has its data in cache. A worker whose deque is empty
+ * steals from the front of the other workers' deques.
+ *
+ * Tasks must not throw.
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(uint32_t threadCount) {
+        for (uint32_t i = 0; i < threadCount; i++) this->workers_.push_back(std::make_unique<Worker>());
+        for (uint32_t i = 0; i < threadCount; i++) this->threads_.emplace_back([this, i] { this->work(i); });
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    /// Waits for every submitted task, then stops the workers.
+    ~WorkStealingPool() {
+        this->wait();
+        {
+            std::lock_guard<std::mutex> lock(this->mutex_);
+            this->stopping_ = true;
+        }
+        this->wake_.notify_all();
+        for (std::thread &thread : this->threads_) thread.join();
+    }
+
+    uint32_t threadCount() const { return this->workers_.size(); }
+
+    /// @return The index of the worker that runs the calling task, below threadCount(). Only valid within a task.
+    uint32_t workerIndex() const { return WorkStealingPool::current().index; }
+
+    /// Queues a task: on the current worker's deque if called from a task, otherwise on the workers' deques in turn.
+    void submit(Task task) {
+        Current &current = WorkStealingPool::current();
+        uint32_t index = current.pool == this ? current.index : this->next_.fetch_add(1, std::memory_order_relaxed) % this->workers_.size();
+        this->pending_.fetch_add(1, std::memory_order_relaxed);
+        {
+            Worker &worker = *this->workers_[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(this->mutex_);
+            this->queued_++;
+        }
+        this->wake_.notify_one();
+    }
+
+    /// Blocks until every submitted task, including the tasks that those submit, has finished.
+    void wait() {
+        std::unique_lock<std::mutex> lock(this->mutex_);
+        this->done_.wait(lock, [this] { return this->pending_.load(std::memory_order_acquire) == 0; });
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    /// The pool and worker index of the calling thread, if it is a worker.
+    struct Current {
+        WorkStealingPool *pool = nullptr;
+        uint32_t index = 0;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;               // Guards queued_ and stopping_, for sleeping workers and waiters
+    std::condition_variable wake_;   // Signaled when a task is queued or the pool stops
+    std::condition_variable done_;   // Signaled when the last pending task finishes
+    uint64_t queued_ = 0;            // Tasks in the deques
+    bool stopping_ = false;
+    std::atomic<uint64_t> pending_ { 0 }; // Tasks submitted but not finished
+    std::atomic<uint32_t> next_ { 0 };    // Deque for the next task submitted from outside the pool
+
+    static Current &current() {
+        static thread_local Current current;
+        return current;
+    }
+
+    bool take(uint32_t index, Task &task) {
+        // Own deque first, newest task first; then the other deques, oldest task first
+        for (uint32_t i = 0; i < this->workers_.size(); i++) {
+            Worker &worker = *this->workers_[(index + i) % this->workers_.size()];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty()) continue;
+            if (i == 0) {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+            } else {
+                task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void work(uint32_t index) {
+        WorkStealingPool::current() = { this, index };
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(this->mutex_);
+                this->wake_.wait(lock, [this] { return this->stopping_ || this->queued_ > 0; });
+                if (this->queued_ == 0) return; // Stopping
+                this->queued_--;
+            }
+
+            // Every queued task is counted once, so the task reserved above is in one of the deques
+            Task task;
+            while (!this->take(index, task)) std::this_thread::yield();
+            task();
+            task = nullptr;
+
+            if (this->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(this->mutex_);
+                this->done_.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace cjbp